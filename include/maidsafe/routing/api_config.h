@@ -17,6 +17,7 @@ License.
 #define MAIDSAFE_ROUTING_API_CONFIG_H_
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -46,16 +47,17 @@ enum class GroupRangeStatus {
 };
 
 // This struct needs to be moved to common
+// The unique node ids of the group matrix before and after a change, sorted by distance from this
+// node.  The snapshots are immutable and shared, so consumers must not copy them to keep them.
+// |added| and |removed| are computed by GroupMatrix::GetMatrixChange; OldEqualsToNew reads only
+// them.
 struct MatrixChange {
-  std::vector<NodeId> old_matrix, new_matrix;
+  typedef std::shared_ptr<const std::vector<NodeId>> Snapshot;
+  MatrixChange() : old_matrix(), new_matrix(), added(), removed() {}
+  Snapshot old_matrix, new_matrix;
+  std::vector<NodeId> added, removed;
   static uint16_t close_count, proximal_count;
-  bool OldEqualsToNew() const {
-    if (old_matrix.size() != new_matrix.size())
-      return false;
-    return std::equal(new_matrix.begin(),
-                      new_matrix.end(),
-                      old_matrix.begin());
-  }
+  bool OldEqualsToNew() const { return added.empty() && removed.empty(); }
 };
 
 typedef std::function<void(std::string)> ResponseFunctor;
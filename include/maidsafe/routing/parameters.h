@@ -37,6 +37,7 @@ struct Parameters {
   static uint16_t max_routing_table_size_for_client;  // max size of RoutingTable owned by client
   static uint16_t max_client_routing_table_size;      // max size of ClientRoutingTable
   static uint16_t bucket_target_size;
+  static uint16_t validated_key_cache_size;  // public keys remembered as already validated
   static uint32_t max_data_size;
   static boost::posix_time::time_duration default_response_timeout;
   static boost::posix_time::time_duration find_node_interval;
@@ -46,12 +47,51 @@ struct Parameters {
   static uint16_t find_node_repeats_per_num_requested;
   static uint16_t maximum_find_close_node_failures;
   static uint16_t max_route_history;
+  static uint16_t next_hop_cache_size;
+  static uint16_t routing_table_change_log_size;
+  // Minimum time between full routing table dumps to the log
+  static boost::posix_time::time_duration routing_table_dump_interval;
+  // Close group changes are sent once none has followed for this long, but never later than the
+  // maximum delay after the first of them.  Zero sends each change immediately.
+  static boost::posix_time::time_duration group_change_propagation_delay;
+  static boost::posix_time::time_duration max_group_change_propagation_delay;
+  // A client re-sends its subscription to a close node this often until the node's first
+  // ClosestNodesUpdate arrives.
+  static boost::posix_time::time_duration closest_nodes_subscribe_retry_interval;
+  // Updates aren't acknowledged, so a node also sends its whole list to every subscriber this
+  // often.
+  static boost::posix_time::time_duration closest_nodes_full_update_interval;
+  // Failed sends are retried after the base delay, doubling per attempt up to the maximum.
+  static boost::posix_time::time_duration recursive_send_retry_delay;
+  static boost::posix_time::time_duration max_recursive_send_retry_delay;
+  // A peer is skipped as a next hop for the open period once at least this many of its recent
+  // sends have failed and they make up half or more of those sends.
+  static uint16_t circuit_breaker_failure_threshold;
+  static boost::posix_time::time_duration circuit_breaker_open_period;
+  // Routing messages no bigger than max_coalesced_message_size are held for up to the coalescing
+  // window and sent to their connection together in one MessageBatch of at most
+  // max_coalesced_batch_size bytes.  A zero window sends every message on its own.  Nodes which
+  // predate MessageBatch drop batches, so the window is zero until the whole network handles them.
+  static boost::posix_time::time_duration send_coalescing_window;
+  static uint32_t max_coalesced_message_size;
+  static uint32_t max_coalesced_batch_size;
+  // Next hops are chosen by lowest measured round trip time among this many of the XOR-closest
+  // peers which are closer to the target than this node.  One routes purely by XOR distance.
+  static uint16_t proximity_routing_candidates;
+  // Number of distinct next hops Routing::SendDirectMultipath forwards a copy of its message to,
+  // and how many such requests a destination remembers in order to drop the later copies.
+  static uint16_t multipath_send_paths;
+  static uint16_t multipath_request_cache_size;
   static uint16_t hops_to_live;
   static uint16_t greedy_fraction;
   static uint16_t split_avoidance;
   static uint16_t routing_table_ready_to_response;
   static uint16_t accepted_distance_tolerance;
   static boost::posix_time::time_duration connect_rpc_prune_timeout;
+  // Peers connected to because of one FindNodes response, or one peer's list of close nodes, are
+  // added to the routing table together once all have been validated, or this long after their
+  // Connect RPCs were sent.  Any still outstanding after that are added one at a time.
+  static boost::posix_time::time_duration connect_batch_window;
   static bool append_maidsafe_endpoints;
   static bool append_maidsafe_local_endpoints;
   static bool append_local_live_port_endpoint;
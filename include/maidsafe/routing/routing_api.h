@@ -105,6 +105,14 @@ class Routing {
                   const bool& cacheable,                  // to cache message content
                   ResponseFunctor response_functor);      // Called on response
 
+  // As SendDirect, but for latency-critical requests: copies of the message leave via
+  // Parameters::multipath_send_paths different next hops and the destination only handles the
+  // first to arrive.  The response functor is called once, for the first response.
+  void SendDirectMultipath(const NodeId& destination_id,
+                           const std::string& message,
+                           const bool& cacheable,
+                           ResponseFunctor response_functor);
+
   // Sends message to Parameters::node_group_size most closest nodes to destination_id. The node
   // having id equal to destination id is not considered as part of group and will not receive
   // group message
@@ -133,6 +133,10 @@ class GenericNode {
   void RemoveNodeFromRandomNodeHelper(const NodeId& node_id);
   bool NodeSubscribedForGroupUpdate(const NodeId& node_id);
   std::vector<NodeInfo> GetGroupMatrixConnectedPeers();
+  // Passes close_nodes to the node as a change of its close group, as its routing table does.
+  void ConnectedGroupChange(const std::vector<NodeInfo>& close_nodes);
+  // Close node list last sent to subscribers, and its version, which is 0 until one is sent.
+  std::vector<NodeInfo> ClosestNodesSent(uint64_t& version);
   void SetMatrixChangeFunctor(MatrixChangedFunctor group_matrix_functor);
 
   void PostTaskToAsioService(std::function<void()> functor);
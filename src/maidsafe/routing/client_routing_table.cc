@@ -15,6 +15,9 @@ License.
 
 #include "maidsafe/routing/client_routing_table.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "maidsafe/common/log.h"
 
 #include "maidsafe/routing/node_info.h"
@@ -31,10 +34,15 @@ typedef boost::asio::ip::udp::endpoint Endpoint;
 
 }  // unnamed namespace
 
+const size_t ClientRoutingTable::kShardCount;
+
 ClientRoutingTable::ClientRoutingTable(const NodeId& node_id)
     : kNodeId_(node_id),
-      nodes_(),
-      mutex_() {}
+      shards_(),
+      size_(0),
+      connections_mutex_(),
+      node_ids_(),
+      add_mutex_() {}
 
 bool ClientRoutingTable::AddNode(NodeInfo& node, const NodeId& furthest_close_node_id) {
   return AddOrCheckNode(node, furthest_close_node_id, true);
@@ -49,10 +57,19 @@ bool ClientRoutingTable::AddOrCheckNode(NodeInfo& node,
                                      const bool& add) {
   if (node.node_id == kNodeId_)
     return false;
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<std::mutex> add_lock(add_mutex_);
   if (CheckRangeForNodeToBeAdded(node, furthest_close_node_id, add)) {
     if (add) {
-      nodes_.push_back(node);
+      {
+        Shard& shard(GetShard(node.node_id));
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.nodes[node.node_id].push_back(node);
+        ++size_;
+      }
+      {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        node_ids_.insert(std::make_pair(node.connection_id, node.node_id));
+      }
       LOG(kInfo) << "Added to ClientRoutingTable :" << DebugId(node.node_id);
       LOG(kVerbose) << PrintClientRoutingTable();
     }
@@ -63,49 +80,64 @@ bool ClientRoutingTable::AddOrCheckNode(NodeInfo& node,
 
 std::vector<NodeInfo> ClientRoutingTable::DropNodes(const NodeId &node_to_drop) {
   std::vector<NodeInfo> nodes_info;
-  std::lock_guard<std::mutex> lock(mutex_);
-  uint16_t i(0);
-  while (i < nodes_.size()) {
-    if (nodes_.at(i).node_id == node_to_drop) {
-      nodes_info.push_back(nodes_.at(i));
-      nodes_.erase(nodes_.begin() + i);
-    } else {
-      ++i;
-    }
+  {
+    Shard& shard(GetShard(node_to_drop));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found(shard.nodes.find(node_to_drop));
+    if (found == shard.nodes.end())
+      return nodes_info;
+    nodes_info.swap(found->second);
+    shard.nodes.erase(found);
+    size_ -= nodes_info.size();
+  }
+  std::lock_guard<std::mutex> lock(connections_mutex_);
+  for (const auto& node_info : nodes_info) {
+    auto node_id(node_ids_.find(node_info.connection_id));
+    if (node_id != node_ids_.end() && node_id->second == node_to_drop)
+      node_ids_.erase(node_id);
   }
   return nodes_info;
 }
 
 NodeInfo ClientRoutingTable::DropConnection(const NodeId& connection_to_drop) {
   NodeInfo node_info;
-  std::lock_guard<std::mutex> lock(mutex_);
-  for (auto it = nodes_.begin(); it != nodes_.end(); ++it) {
-    if ((*it).connection_id == connection_to_drop) {
-      node_info = *it;
-      nodes_.erase(it);
-      break;
-    }
-  }
+  std::lock_guard<std::mutex> connections_lock(connections_mutex_);
+  auto node_id(node_ids_.find(connection_to_drop));
+  if (node_id == node_ids_.end())
+    return node_info;
+  Shard& shard(GetShard(node_id->second));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  // DropNodes may have removed the client from its shard already.
+  auto connections(shard.nodes.find(node_id->second));
+  node_ids_.erase(node_id);
+  if (connections == shard.nodes.end())
+    return node_info;
+  auto connection(std::find_if(connections->second.begin(),
+                               connections->second.end(),
+                               [&connection_to_drop](const NodeInfo& node) {
+                                 return node.connection_id == connection_to_drop;
+                               }));
+  if (connection == connections->second.end())
+    return node_info;
+  node_info = *connection;
+  connections->second.erase(connection);
+  if (connections->second.empty())
+    shard.nodes.erase(connections);
+  --size_;
   return node_info;
 }
 
 std::vector<NodeInfo> ClientRoutingTable::GetNodesInfo(const NodeId& node_id) const {
-  std::vector<NodeInfo> nodes_info;
-  std::lock_guard<std::mutex> lock(mutex_);
-  for (auto it = nodes_.begin(); it != nodes_.end(); ++it) {
-    if ((*it).node_id == node_id)
-      nodes_info.push_back(*it);
-  }
-  return nodes_info;
+  const Shard& shard(GetShard(node_id));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto found(shard.nodes.find(node_id));
+  return found == shard.nodes.end() ? std::vector<NodeInfo>() : found->second;
 }
 
 bool ClientRoutingTable::Contains(const NodeId& node_id) const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return std::find_if(nodes_.begin(),
-                      nodes_.end(),
-                      [node_id](const NodeInfo& node_info) {
-                        return node_info.node_id == node_id;
-                      }) != nodes_.end();
+  const Shard& shard(GetShard(node_id));
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.nodes.count(node_id) != 0;
 }
 
 bool ClientRoutingTable::IsConnected(const NodeId& node_id) const {
@@ -113,8 +145,21 @@ bool ClientRoutingTable::IsConnected(const NodeId& node_id) const {
 }
 
 size_t ClientRoutingTable::size() const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return nodes_.size();
+  return size_;
+}
+
+ClientRoutingTable::Shard& ClientRoutingTable::GetShard(const NodeId& node_id) const {
+  return shards_[NodeIdHash()(node_id) % kShardCount];
+}
+
+std::vector<NodeInfo> ClientRoutingTable::nodes() const {
+  std::vector<NodeInfo> nodes;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (const auto& connections : shard.nodes)
+      nodes.insert(nodes.end(), connections.second.begin(), connections.second.end());
+  }
+  return nodes;
 }
 
 // TODO(Prakash): re-order checks to increase performance if needed
@@ -129,13 +174,12 @@ bool ClientRoutingTable::CheckValidParameters(const NodeInfo& node) const {
 
 bool ClientRoutingTable::CheckParametersAreUnique(const NodeInfo& node) const {
   // If we already have a duplicate endpoint return false
-  if (std::find_if(nodes_.begin(),
-                   nodes_.end(),
-                   [node](const NodeInfo& node_info) {
-                     return (node_info.connection_id == node.connection_id);
-                   }) != nodes_.end()) {
-    LOG(kInfo) << "Already have node with this connection_id.";
-    return false;
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    if (node_ids_.count(node.connection_id) != 0) {
+      LOG(kInfo) << "Already have node with this connection_id.";
+      return false;
+    }
   }
 
   // If we already have a duplicate public key under different node ID return false
@@ -154,7 +198,7 @@ bool ClientRoutingTable::CheckParametersAreUnique(const NodeInfo& node) const {
 bool ClientRoutingTable::CheckRangeForNodeToBeAdded(NodeInfo& node,
                                                  const NodeId& furthest_close_node_id,
                                                  const bool& add) const {
-  if (nodes_.size() >= Parameters::max_client_routing_table_size) {
+  if (size_ >= Parameters::max_client_routing_table_size) {
     LOG(kInfo) << "ClientRoutingTable full.";
     return false;
   }
@@ -177,7 +221,7 @@ bool ClientRoutingTable::IsThisNodeInRange(const NodeId& node_id,
 }
 
 std::string ClientRoutingTable::PrintClientRoutingTable() {
-  auto rt(nodes_);
+  auto rt(nodes());
   std::string s = "\n\n[" + DebugId(kNodeId_) +
       "] This node's own ClientRoutingTable and peer connections:\n";
   for (const auto& node : rt) {
@@ -16,9 +16,12 @@ License.
 #ifndef MAIDSAFE_ROUTING_CLIENT_ROUTING_TABLE_H_
 #define MAIDSAFE_ROUTING_CLIENT_ROUTING_TABLE_H_
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "boost/asio/ip/udp.hpp"
@@ -27,6 +30,7 @@ License.
 #include "maidsafe/common/rsa.h"
 
 #include "maidsafe/routing/api_config.h"
+#include "maidsafe/routing/node_id_hash.h"
 
 
 namespace maidsafe {
@@ -62,8 +66,19 @@ class ClientRoutingTable {
   friend class GroupChangeHandler;
 
  private:
+  // Clients are spread over the shards by node id, each shard having its own lock.  A client's
+  // connections are listed in the order they were added.
+  struct Shard {
+    Shard() : mutex(), nodes() {}
+    mutable std::mutex mutex;
+    std::unordered_map<NodeId, std::vector<NodeInfo>, NodeIdHash> nodes;
+  };
+  static const size_t kShardCount = 16;
+
   ClientRoutingTable(const ClientRoutingTable&);
   ClientRoutingTable& operator=(const ClientRoutingTable&);
+  Shard& GetShard(const NodeId& node_id) const;
+  std::vector<NodeInfo> nodes() const;
   bool AddOrCheckNode(NodeInfo& node, const NodeId& furthest_close_node_id, const bool& add);
   bool CheckValidParameters(const NodeInfo& node) const;
   bool CheckParametersAreUnique(const NodeInfo& node) const;
@@ -77,8 +92,14 @@ class ClientRoutingTable {
   friend class test::BasicClientRoutingTableTest_BEH_IsThisNodeInRange_Test;
 
   const NodeId kNodeId_;
-  std::vector<NodeInfo> nodes_;
-  mutable std::mutex mutex_;
+  mutable std::array<Shard, kShardCount> shards_;
+  std::atomic<size_t> size_;
+  // Node id of each connection, so a connection is found without searching the shards.  Where both
+  // are held, connections_mutex_ is locked before a shard's mutex.
+  mutable std::mutex connections_mutex_;
+  std::unordered_map<NodeId, NodeId, NodeIdHash> node_ids_;
+  // Serialises additions, so that the size limit and connection id uniqueness hold across shards.
+  std::mutex add_mutex_;
 };
 
 }  // namespace routing
@@ -0,0 +1,138 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+
+#include "maidsafe/routing/distance.h"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+
+namespace maidsafe {
+
+namespace routing {
+
+namespace {
+
+const uint64_t kLowHalfMask(0xFFFFFFFF);
+
+}  // unnamed namespace
+
+Distance::Distance() : words_() {
+  words_.fill(0);
+}
+
+Distance::Distance(const NodeId& distance) : words_() {
+  words_.fill(0);
+  const std::string raw_id(distance.string());
+  assert(raw_id.size() == NodeId::kSize);
+  for (size_t i(0); i != raw_id.size(); ++i) {
+    uint64_t& word(words_[1 + i / sizeof(uint64_t)]);
+    word = (word << 8) | static_cast<unsigned char>(raw_id[i]);
+  }
+}
+
+NodeId Distance::ToNodeId() const {
+  if (words_[0] != 0)
+    return NodeId(NodeId::kMaxId);
+  std::string raw_id(NodeId::kSize, '\0');
+  for (size_t i(0); i != raw_id.size(); ++i) {
+    size_t shift(8 * (sizeof(uint64_t) - 1 - i % sizeof(uint64_t)));
+    raw_id[i] = static_cast<char>((words_[1 + i / sizeof(uint64_t)] >> shift) & 0xFF);
+  }
+  return NodeId(raw_id);
+}
+
+Distance& Distance::operator+=(const Distance& other) {
+  uint64_t carry(0);
+  for (size_t i(kWordCount); i-- != 0;) {
+    uint64_t sum(words_[i] + other.words_[i]);
+    uint64_t next_carry(sum < words_[i] ? 1 : 0);
+    words_[i] = sum + carry;
+    if (words_[i] < sum)
+      next_carry = 1;
+    carry = next_carry;
+  }
+  assert(carry == 0 && "Distance overflow");
+  return *this;
+}
+
+Distance& Distance::operator*=(uint32_t multiplier) {
+  // Multiply each word in 32-bit halves so that no partial product exceeds 64 bits.
+  uint64_t carry(0);
+  for (size_t i(kWordCount); i-- != 0;) {
+    uint64_t low((words_[i] & kLowHalfMask) * multiplier + carry);
+    uint64_t high((words_[i] >> 32) * multiplier + (low >> 32));
+    words_[i] = (high << 32) | (low & kLowHalfMask);
+    carry = high >> 32;
+  }
+  assert(carry == 0 && "Distance overflow");
+  return *this;
+}
+
+Distance& Distance::operator/=(uint32_t divisor) {
+  assert(divisor != 0);
+  // Schoolbook long division in 32-bit digits; the remainder is always less than divisor.
+  uint64_t remainder(0);
+  for (auto& word : words_) {
+    uint64_t high((remainder << 32) | (word >> 32));
+    remainder = high % divisor;
+    uint64_t low((remainder << 32) | (word & kLowHalfMask));
+    remainder = low % divisor;
+    word = ((high / divisor) << 32) | (low / divisor);
+  }
+  return *this;
+}
+
+bool operator==(const Distance& lhs, const Distance& rhs) {
+  return lhs.words_ == rhs.words_;
+}
+
+bool operator<(const Distance& lhs, const Distance& rhs) {
+  return std::lexicographical_compare(lhs.words_.begin(), lhs.words_.end(),
+                                      rhs.words_.begin(), rhs.words_.end());
+}
+
+Distance operator+(Distance lhs, const Distance& rhs) {
+  return lhs += rhs;
+}
+
+Distance operator*(Distance lhs, uint32_t multiplier) {
+  return lhs *= multiplier;
+}
+
+Distance operator/(Distance lhs, uint32_t divisor) {
+  return lhs /= divisor;
+}
+
+bool operator!=(const Distance& lhs, const Distance& rhs) {
+  return !(lhs == rhs);
+}
+
+bool operator>(const Distance& lhs, const Distance& rhs) {
+  return rhs < lhs;
+}
+
+bool operator<=(const Distance& lhs, const Distance& rhs) {
+  return !(rhs < lhs);
+}
+
+bool operator>=(const Distance& lhs, const Distance& rhs) {
+  return !(lhs < rhs);
+}
+
+}  // namespace routing
+
+}  // namespace maidsafe
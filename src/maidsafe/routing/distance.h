@@ -0,0 +1,65 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+
+#ifndef MAIDSAFE_ROUTING_DISTANCE_H_
+#define MAIDSAFE_ROUTING_DISTANCE_H_
+
+#include <array>
+#include <cstdint>
+
+#include "maidsafe/common/node_id.h"
+
+
+namespace maidsafe {
+
+namespace routing {
+
+// Fixed-width unsigned integer for XOR distances between NodeIds, supporting the little arithmetic
+// needed for group range estimates without round-tripping through hex strings and crypto::BigInt.
+// One word of headroom is kept above the 512 bits of a NodeId so that sums of many distances (or
+// small multiples of one) can't overflow.
+class Distance {
+ public:
+  Distance();
+  explicit Distance(const NodeId& distance);
+  // Returns the low 512 bits as a NodeId, or kMaxId if the value doesn't fit in one.
+  NodeId ToNodeId() const;
+
+  Distance& operator+=(const Distance& other);
+  Distance& operator*=(uint32_t multiplier);
+  Distance& operator/=(uint32_t divisor);
+
+  friend bool operator==(const Distance& lhs, const Distance& rhs);
+  friend bool operator<(const Distance& lhs, const Distance& rhs);
+
+ private:
+  static const size_t kWordCount = (NodeId::kSize / sizeof(uint64_t)) + 1;
+  // Most significant word first.
+  std::array<uint64_t, kWordCount> words_;
+};
+
+Distance operator+(Distance lhs, const Distance& rhs);
+Distance operator*(Distance lhs, uint32_t multiplier);
+Distance operator/(Distance lhs, uint32_t divisor);
+bool operator!=(const Distance& lhs, const Distance& rhs);
+bool operator>(const Distance& lhs, const Distance& rhs);
+bool operator<=(const Distance& lhs, const Distance& rhs);
+bool operator>=(const Distance& lhs, const Distance& rhs);
+
+}  // namespace routing
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ROUTING_DISTANCE_H_
@@ -15,6 +15,7 @@ License.
 
 #include "maidsafe/routing/group_change_handler.h"
 
+#include <set>
 #include <string>
 #include <vector>
 #include <algorithm>
@@ -40,7 +41,16 @@ GroupChangeHandler::GroupChangeHandler(RoutingTable& routing_table,
                                        NetworkUtils& network)
   : routing_table_(routing_table),
     client_routing_table_(client_routing_table),
-    network_(network) {}
+    network_(network),
+    mutex_(),
+    closest_nodes_(),
+    closest_nodes_version_(0),
+    subscriber_versions_(),
+    client_subscribers_(),
+    subscriptions_(),
+    unconfirmed_subscriptions_(),
+    subscribe_retry_pending_(false),
+    full_update_pending_(false) {}
 
 GroupChangeHandler::~GroupChangeHandler() {}
 
@@ -71,24 +81,110 @@ void GroupChangeHandler::ClosestNodesUpdate(protobuf::Message& message) {
       closest_nodes.push_back(node_info);
     }
   }
-  assert(!closest_nodes.empty());
-  UpdateGroupChange(NodeId(closest_node_update.node()), closest_nodes);
+  NodeId node_id(closest_node_update.node());
+  if (routing_table_.client_mode()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    unconfirmed_subscriptions_.erase(node_id);
+  }
+  if (closest_node_update.has_base_version()) {
+    std::vector<NodeId> removed_nodes;
+    for (const auto& removed_node : closest_node_update.removed_nodes()) {
+      if (CheckId(removed_node))
+        removed_nodes.push_back(NodeId(removed_node));
+    }
+    if (closest_node_update.base_version() >= closest_node_update.version() ||
+        !UpdateGroupChange(node_id, closest_nodes, removed_nodes,
+                           closest_node_update.base_version(), closest_node_update.version())) {
+      SendClosestNodesUpdateResync(node_id);
+    }
+  } else {
+    assert(!closest_nodes.empty());
+    UpdateGroupChange(node_id, closest_nodes, closest_node_update.version());
+  }
   if (!routing_table_.client_mode())
     message.Clear();
 }
 
+void GroupChangeHandler::ClosestNodesUpdateResync(protobuf::Message& message) {
+  if (message.destination_id() != routing_table_.kNodeId().string()) {
+    LOG(kError) << "Message not for this node.";
+    message.Clear();
+    return;
+  }
+  protobuf::ClosestNodesUpdateResync closest_nodes_update_resync;
+  if (!closest_nodes_update_resync.ParseFromString(message.data(0))) {
+    LOG(kError) << "No Data.";
+    message.Clear();
+    return;
+  }
+  message.Clear();
+  if (!CheckId(closest_nodes_update_resync.node_id()) ||
+      !CheckId(closest_nodes_update_resync.connection_id())) {
+    LOG(kError) << "Invalid node id provided.";
+    return;
+  }
+  NodeId node_id(closest_nodes_update_resync.node_id());
+  NodeInfo node_info;
+  if (!GetNodeInfo(node_id, NodeId(closest_nodes_update_resync.connection_id()), node_info)) {
+    LOG(kWarning) << "Resync requested by " << DebugId(node_id) << " which is not connected.";
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (closest_nodes_.empty())
+    return;
+  LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId()) << "] Resending version "
+                << closest_nodes_version_ << " to: " << DebugId(node_info.node_id);
+  protobuf::Message closest_nodes_update_rpc(
+      rpcs::ClosestNodesUpdate(node_info.node_id, routing_table_.kNodeId(), closest_nodes_,
+                               closest_nodes_version_));
+  network_.SendToDirect(closest_nodes_update_rpc, node_info.node_id, node_info.connection_id);
+  subscriber_versions_[node_info.connection_id] = closest_nodes_version_;
+}
+
 void GroupChangeHandler::UpdateGroupChange(const NodeId& node_id,
-                                           std::vector<NodeInfo> close_nodes) {
+                                           std::vector<NodeInfo> close_nodes,
+                                           uint64_t version) {
   if (routing_table_.Contains(node_id)) {
     LOG(kVerbose) << DebugId(routing_table_.kNodeId()) << " UpdateGroupChange for "
                   << DebugId(node_id) << " size of update: " << close_nodes.size();
-    routing_table_.GroupUpdateFromConnectedPeer(node_id, close_nodes);
+    routing_table_.GroupUpdateFromConnectedPeer(node_id, close_nodes, version);
   } else {
     LOG(kVerbose) << DebugId(routing_table_.kNodeId()) << "UpdateGroupChange for failed"
                   << DebugId(node_id) << " size of update: " << close_nodes.size();
   }
 }
 
+bool GroupChangeHandler::UpdateGroupChange(const NodeId& node_id,
+                                           const std::vector<NodeInfo>& added_nodes,
+                                           const std::vector<NodeId>& removed_nodes,
+                                           uint64_t base_version,
+                                           uint64_t version) {
+  if (!routing_table_.Contains(node_id)) {
+    LOG(kVerbose) << DebugId(routing_table_.kNodeId()) << "UpdateGroupChange for failed"
+                  << DebugId(node_id) << " version: " << version;
+    return true;
+  }
+  LOG(kVerbose) << DebugId(routing_table_.kNodeId()) << " UpdateGroupChange for "
+                << DebugId(node_id) << " from version " << base_version << " to " << version
+                << ", added: " << added_nodes.size() << ", removed: " << removed_nodes.size();
+  return routing_table_.GroupUpdateFromConnectedPeer(node_id, added_nodes, removed_nodes,
+                                                     base_version, version);
+}
+
+void GroupChangeHandler::SendClosestNodesUpdateResync(const NodeId& node_id) {
+  NodeInfo node_info;
+  if (!routing_table_.GetNodeInfo(node_id, node_info))
+    return;
+  LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId())
+                << "] Requesting resync from: " << DebugId(node_id);
+  protobuf::Message closest_nodes_update_resync_rpc(
+      rpcs::ClosestNodesUpdateResync(node_id, routing_table_.kNodeId(),
+                                     routing_table_.kConnectionId(),
+                                     routing_table_.client_mode()));
+  network_.SendToDirect(closest_nodes_update_resync_rpc, node_info.node_id,
+                        node_info.connection_id);
+}
+
 void GroupChangeHandler::SendClosestNodesUpdateRpcs(std::vector<NodeInfo> closest_nodes) {
   NodeId node_id(routing_table_.kNodeId());
   closest_nodes.erase(std::remove_if(closest_nodes.begin(),
@@ -96,20 +192,233 @@ void GroupChangeHandler::SendClosestNodesUpdateRpcs(std::vector<NodeInfo> closes
                                      [node_id] (const NodeInfo& node_info) {
                                        return node_info.node_id == node_id;
                                      }), closest_nodes.end());
+  if (routing_table_.client_mode())
+    return UpdateSubscriptions(closest_nodes);
   if (closest_nodes.size() < Parameters::closest_nodes_size)
     return;
   LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId())
                 << "] SendClosestNodesUpdateRpcs: " << closest_nodes.size();
   std::vector<NodeInfo> update_subscribers(closest_nodes);
-  // clients are also notified of changes in connected close nodes
-  for (auto& client : client_routing_table_.nodes_)
-    update_subscribers.push_back(client);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  AddClientSubscribers(update_subscribers);
+  auto contains([](const std::vector<NodeInfo>& nodes, const NodeId& node_id) {
+    return std::find_if(nodes.begin(),
+                        nodes.end(),
+                        [&node_id](const NodeInfo& node_info) {
+                          return node_info.node_id == node_id;
+                        }) != nodes.end();
+  });
+  std::vector<NodeInfo> added_nodes;
+  std::vector<NodeId> removed_nodes;
+  for (const auto& node_info : closest_nodes) {
+    if (!contains(closest_nodes_, node_info.node_id))
+      added_nodes.push_back(node_info);
+  }
+  for (const auto& node_info : closest_nodes_) {
+    if (!contains(closest_nodes, node_info.node_id))
+      removed_nodes.push_back(node_info.node_id);
+  }
+  if (!added_nodes.empty() || !removed_nodes.empty()) {
+    closest_nodes_ = closest_nodes;
+    ++closest_nodes_version_;
+  }
+
+  std::map<NodeId, uint64_t> subscriber_versions;
   for (auto itr(update_subscribers.begin()); itr != update_subscribers.end(); ++itr) {
+    auto sent(subscriber_versions_.find(itr->connection_id));
+    subscriber_versions[itr->connection_id] = closest_nodes_version_;
+    if (sent != subscriber_versions_.end() && sent->second == closest_nodes_version_)
+      continue;
     LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId())
                   << "] Sending update to: " << DebugId(itr->node_id);
+    if (sent != subscriber_versions_.end() && sent->second + 1 == closest_nodes_version_) {
+      protobuf::Message closest_nodes_update_rpc(
+          rpcs::ClosestNodesUpdateDelta(itr->node_id, routing_table_.kNodeId(),
+                                        closest_nodes_version_, added_nodes, removed_nodes));
+      network_.SendToDirect(closest_nodes_update_rpc, itr->node_id, itr->connection_id);
+    } else {
+      protobuf::Message closest_nodes_update_rpc(
+          rpcs::ClosestNodesUpdate(itr->node_id, routing_table_.kNodeId(), closest_nodes_,
+                                   closest_nodes_version_));
+      network_.SendToDirect(closest_nodes_update_rpc, itr->node_id, itr->connection_id);
+    }
+  }
+  // Subscribers no longer sent updates get the whole list if they are sent one again.
+  subscriber_versions_.swap(subscriber_versions);
+  if (!full_update_pending_) {
+    full_update_pending_ = true;
+    network_.ScheduleTask(Parameters::closest_nodes_full_update_interval,
+                          [this] { SendFullClosestNodesUpdates(); });
+  }
+}
+
+void GroupChangeHandler::AddClientSubscribers(std::vector<NodeInfo>& subscribers) {
+  // Subscribed clients are also notified of changes in connected close nodes.  Those which have
+  // disconnected since subscribing are forgotten.
+  for (auto itr(client_subscribers_.begin()); itr != client_subscribers_.end();) {
+    if (!IsConnectedClient(itr->second, itr->first)) {
+      itr = client_subscribers_.erase(itr);
+      continue;
+    }
+    NodeInfo client;
+    client.node_id = itr->second;
+    client.connection_id = itr->first;
+    subscribers.push_back(client);
+    ++itr;
+  }
+}
+
+void GroupChangeHandler::SendFullClosestNodesUpdates() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<NodeInfo> update_subscribers(closest_nodes_);
+  AddClientSubscribers(update_subscribers);
+  LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId()) << "] Sending version "
+                << closest_nodes_version_ << " to " << update_subscribers.size()
+                << " subscribers.";
+  for (const auto& subscriber : update_subscribers) {
     protobuf::Message closest_nodes_update_rpc(
-        rpcs::ClosestNodesUpdate(itr->node_id, routing_table_.kNodeId(), closest_nodes));
-    network_.SendToDirect(closest_nodes_update_rpc, itr->node_id, itr->connection_id);
+        rpcs::ClosestNodesUpdate(subscriber.node_id, routing_table_.kNodeId(), closest_nodes_,
+                                 closest_nodes_version_));
+    network_.SendToDirect(closest_nodes_update_rpc, subscriber.node_id,
+                          subscriber.connection_id);
+    subscriber_versions_[subscriber.connection_id] = closest_nodes_version_;
+  }
+  network_.ScheduleTask(Parameters::closest_nodes_full_update_interval,
+                        [this] { SendFullClosestNodesUpdates(); });
+}
+
+void GroupChangeHandler::ClosestNodesUpdateSubscribe(protobuf::Message& message) {
+  if (message.destination_id() != routing_table_.kNodeId().string()) {
+    LOG(kError) << "Message not for this node.";
+    message.Clear();
+    return;
+  }
+  protobuf::ClosestNodesUpdateSubscrirbe closest_nodes_update_subscribe;
+  if (!closest_nodes_update_subscribe.ParseFromString(message.data(0))) {
+    LOG(kError) << "No Data.";
+    message.Clear();
+    return;
+  }
+  message.Clear();
+  if (routing_table_.client_mode()) {
+    LOG(kError) << "Clients don't send updates.";
+    return;
+  }
+  if (!CheckId(closest_nodes_update_subscribe.node_id()) ||
+      !CheckId(closest_nodes_update_subscribe.connection_id())) {
+    LOG(kError) << "Invalid node id provided.";
+    return;
+  }
+  NodeId node_id(closest_nodes_update_subscribe.node_id()),
+         connection_id(closest_nodes_update_subscribe.connection_id());
+  if (closest_nodes_update_subscribe.subscribe())
+    Subscribe(node_id, connection_id);
+  else
+    Unsubscribe(node_id, connection_id);
+}
+
+void GroupChangeHandler::SendSubscribeRpc(const bool& subscribe, const NodeInfo& node_info) {
+  LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId()) << "] "
+                << (subscribe ? "Subscribing to " : "Unsubscribing from ")
+                << DebugId(node_info.node_id);
+  protobuf::Message subscribe_rpc(
+      rpcs::ClosestNodesUpdateSubscribe(node_info.node_id, routing_table_.kNodeId(),
+                                        routing_table_.kConnectionId(),
+                                        routing_table_.client_mode(), subscribe));
+  network_.SendToDirect(subscribe_rpc, node_info.node_id, node_info.connection_id);
+}
+
+void GroupChangeHandler::Subscribe(const NodeId& node_id, const NodeId& connection_id) {
+  if (!IsConnectedClient(node_id, connection_id)) {
+    LOG(kWarning) << "Subscription from " << DebugId(node_id)
+                  << " which is not a connected client.";
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!client_subscribers_.insert(std::make_pair(connection_id, node_id)).second)
+    return;
+  LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId()) << "] Subscribed "
+                << DebugId(node_id);
+  // The list may have been sent while the client was unsubscribed.
+  subscriber_versions_.erase(connection_id);
+  if (closest_nodes_.empty())
+    return;
+  protobuf::Message closest_nodes_update_rpc(
+      rpcs::ClosestNodesUpdate(node_id, routing_table_.kNodeId(), closest_nodes_,
+                               closest_nodes_version_));
+  network_.SendToDirect(closest_nodes_update_rpc, node_id, connection_id);
+  subscriber_versions_[connection_id] = closest_nodes_version_;
+}
+
+void GroupChangeHandler::Unsubscribe(const NodeId& node_id, const NodeId& connection_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (client_subscribers_.erase(connection_id) == 0)
+    return;
+  LOG(kVerbose) << "["  << DebugId(routing_table_.kNodeId()) << "] Unsubscribed "
+                << DebugId(node_id);
+  subscriber_versions_.erase(connection_id);
+}
+
+void GroupChangeHandler::UpdateSubscriptions(const std::vector<NodeInfo>& close_nodes) {
+  std::vector<NodeInfo> subscribe, unsubscribe;
+  bool schedule_retry(false);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto contains([](const std::vector<NodeInfo>& nodes, const NodeInfo& node) {
+      return std::find_if(nodes.begin(),
+                          nodes.end(),
+                          [&node](const NodeInfo& node_info) {
+                            return node_info.node_id == node.node_id &&
+                                   node_info.connection_id == node.connection_id;
+                          }) != nodes.end();
+    });
+    for (const auto& node_info : close_nodes) {
+      if (!contains(subscriptions_, node_info)) {
+        subscribe.push_back(node_info);
+        unconfirmed_subscriptions_.insert(node_info.node_id);
+      }
+    }
+    for (const auto& node_info : subscriptions_) {
+      if (!contains(close_nodes, node_info)) {
+        unsubscribe.push_back(node_info);
+        unconfirmed_subscriptions_.erase(node_info.node_id);
+      }
+    }
+    subscriptions_ = close_nodes;
+    if (!subscribe.empty() && !subscribe_retry_pending_)
+      subscribe_retry_pending_ = schedule_retry = true;
+  }
+  for (const auto& node_info : subscribe)
+    SendSubscribeRpc(true, node_info);
+  if (schedule_retry) {
+    network_.ScheduleTask(Parameters::closest_nodes_subscribe_retry_interval,
+                          [this] { ResendSubscribeRpcs(); });
+  }
+  // Nodes no longer connected have dropped this client already.
+  NodeInfo connected_node;
+  for (const auto& node_info : unsubscribe) {
+    if (routing_table_.GetNodeInfo(node_info.node_id, connected_node) &&
+        connected_node.connection_id == node_info.connection_id)
+      SendSubscribeRpc(false, node_info);
+  }
+}
+
+void GroupChangeHandler::ResendSubscribeRpcs() {
+  std::vector<NodeInfo> subscribe;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& node_info : subscriptions_) {
+      if (unconfirmed_subscriptions_.count(node_info.node_id) != 0)
+        subscribe.push_back(node_info);
+    }
+    subscribe_retry_pending_ = !subscribe.empty();
+  }
+  for (const auto& node_info : subscribe)
+    SendSubscribeRpc(true, node_info);
+  if (!subscribe.empty()) {
+    network_.ScheduleTask(Parameters::closest_nodes_subscribe_retry_interval,
+                          [this] { ResendSubscribeRpcs(); });
   }
 }
 
@@ -127,6 +436,16 @@ bool GroupChangeHandler::GetNodeInfo(const NodeId& node_id, const NodeId& connec
   return false;
 }
 
+bool GroupChangeHandler::IsConnectedClient(const NodeId& node_id,
+                                           const NodeId& connection_id) const {
+  auto nodes_info(client_routing_table_.GetNodesInfo(node_id));
+  return std::find_if(nodes_info.begin(),
+                      nodes_info.end(),
+                      [&connection_id](const NodeInfo& node_info) {
+                        return node_info.connection_id == connection_id;
+                      }) != nodes_info.end();
+}
+
 }  // namespace routing
 
 }  // namespace maidsafe
@@ -16,6 +16,10 @@ License.
 #ifndef MAIDSAFE_ROUTING_GROUP_CHANGE_HANDLER_H_
 #define MAIDSAFE_ROUTING_GROUP_CHANGE_HANDLER_H_
 
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
 #include <vector>
 
 #include "maidsafe/common/node_id.h"
@@ -44,9 +48,20 @@ class GroupChangeHandler {
                      ClientRoutingTable& client_routing_table,
                      NetworkUtils& network);
   ~GroupChangeHandler();
+  // Sends each subscriber the changes since the version of the list it was last sent, or the whole
+  // list if it hasn't been sent the previous version.  Close nodes are always subscribed; clients
+  // only once they have asked to be.  As updates aren't acknowledged, the whole list is also sent
+  // to every subscriber each Parameters::closest_nodes_full_update_interval.  A client instead
+  // subscribes to its new close nodes, until each has sent it an update, and unsubscribes from
+  // those it has lost.
   void SendClosestNodesUpdateRpcs(std::vector<NodeInfo> new_close_nodes);
-  void UpdateGroupChange(const NodeId& node_id, std::vector<NodeInfo> close_nodes);
+  void UpdateGroupChange(const NodeId& node_id,
+                         std::vector<NodeInfo> close_nodes,
+                         uint64_t version = 0);
   void ClosestNodesUpdate(protobuf::Message& message);
+  // Handles a subscriber's request for the whole list, after an update it couldn't apply.
+  void ClosestNodesUpdateResync(protobuf::Message& message);
+  void ClosestNodesUpdateSubscribe(protobuf::Message& message);
   void SendSubscribeRpc(const bool& subscribe, const NodeInfo& node_info);
 
   friend class test::GenericNode;
@@ -55,11 +70,42 @@ class GroupChangeHandler {
   GroupChangeHandler& operator=(const GroupChangeHandler&);
 
   void Subscribe(const NodeId& node_id, const NodeId& connection_id);
+  void Unsubscribe(const NodeId& node_id, const NodeId& connection_id);
+  void UpdateSubscriptions(const std::vector<NodeInfo>& close_nodes);
+  // Re-sends the subscriptions still awaiting their first update, and schedules itself again while
+  // any are left.
+  void ResendSubscribeRpcs();
+  // Appends the subscribed clients still connected to |subscribers|, forgetting the others.  Must
+  // be called with mutex_ held.
+  void AddClientSubscribers(std::vector<NodeInfo>& subscribers);
+  // Sends the whole list to every subscriber, so one which missed an update catches up even if the
+  // list doesn't change again, and schedules itself again.
+  void SendFullClosestNodesUpdates();
+  bool UpdateGroupChange(const NodeId& node_id,
+                         const std::vector<NodeInfo>& added_nodes,
+                         const std::vector<NodeId>& removed_nodes,
+                         uint64_t base_version,
+                         uint64_t version);
+  void SendClosestNodesUpdateResync(const NodeId& node_id);
   bool GetNodeInfo(const NodeId& node_id, const NodeId& connection_id, NodeInfo& out_node_info);
+  bool IsConnectedClient(const NodeId& node_id, const NodeId& connection_id) const;
 
   RoutingTable& routing_table_;
   ClientRoutingTable& client_routing_table_;
   NetworkUtils& network_;
+  std::mutex mutex_;
+  // The list last sent, and its version, incremented each time the list changes.
+  std::vector<NodeInfo> closest_nodes_;
+  uint64_t closest_nodes_version_;
+  // Version last sent to each subscriber, by connection id as clients may share a node id.
+  std::map<NodeId, uint64_t> subscriber_versions_;
+  // Node ids of the clients subscribed to this node's updates, by connection id.
+  std::map<NodeId, NodeId> client_subscribers_;
+  // Close nodes this client is subscribed to, and the ids of those yet to send it an update.
+  std::vector<NodeInfo> subscriptions_;
+  std::set<NodeId> unconfirmed_subscriptions_;
+  bool subscribe_retry_pending_;
+  bool full_update_pending_;
 };
 
 }  // namespace routing
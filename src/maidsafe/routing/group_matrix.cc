@@ -18,7 +18,9 @@ License.
 #include <algorithm>
 #include <bitset>
 #include <cstdint>
-#include <set>
+#include <memory>
+#include <string>
+#include <utility>
 
 #include "maidsafe/common/log.h"
 
@@ -30,93 +32,136 @@ namespace maidsafe {
 
 namespace routing {
 
+namespace {
+
+bool Bit(const std::string& raw_id, size_t index) {
+  return ((static_cast<unsigned char>(raw_id[index / 8]) >> (7 - index % 8)) & 1) != 0;
+}
+
+// Index of the most significant bit in which the (unequal) ids differ.
+size_t FirstDifferingBit(const std::string& lhs, const std::string& rhs) {
+  size_t byte(0);
+  while (lhs[byte] == rhs[byte])
+    ++byte;
+  size_t index(byte * 8);
+  unsigned char difference(static_cast<unsigned char>(lhs[byte] ^ rhs[byte]));
+  while ((difference & 0x80) == 0) {
+    difference <<= 1;
+    ++index;
+  }
+  return index;
+}
+
+NodeInfo ToNodeInfo(const NodeId& node_id, const NodeId& connection_id = NodeId()) {
+  NodeInfo node_info;
+  node_info.node_id = node_id;
+  node_info.connection_id = connection_id;
+  return node_info;
+}
+
+NodeInfo ToNodeInfo(const NextHop& entry) {
+  return ToNodeInfo(entry.node_id, entry.connection_id);
+}
+
+}  // unnamed namespace
+
+GroupMatrix::UniqueNode::UniqueNode(const NodeId& node_id_in)
+    : node_id(node_id_in),
+      raw_id(node_id_in.string()),
+      rows() {}
+
 GroupMatrix::GroupMatrix(const NodeId& this_node_id, bool client_mode)
     : kNodeId_(this_node_id),
       unique_nodes_(),
+      unique_node_ids_(),
+      unique_node_ids_snapshot_(),
       client_mode_(client_mode),
-      matrix_() {}
+      matrix_(),
+      irrelevant_rows_(),
+      row_versions_() {}
+
+GroupMatrix::GroupMatrix(const GroupMatrix& other)
+    : kNodeId_(other.kNodeId_),
+      unique_nodes_(other.unique_nodes_),
+      unique_node_ids_(other.unique_node_ids_),
+      unique_node_ids_snapshot_(other.unique_node_ids_snapshot_),
+      client_mode_(other.client_mode_),
+      matrix_(other.matrix_),
+      irrelevant_rows_(other.irrelevant_rows_),
+      row_versions_(other.row_versions_) {}
 
 void GroupMatrix::AddConnectedPeer(const NodeInfo& node_info) {
   LOG(kVerbose) << DebugId(kNodeId_) << " AddConnectedPeer : " << DebugId(node_info.node_id);
-  auto node_id(node_info.node_id);
-  auto found(std::find_if(matrix_.begin(),
-                          matrix_.end(),
-                          [node_id] (const std::vector<NodeInfo>& info) {
-                            return info.begin()->node_id == node_id;
-                          }));
-  if (found != matrix_.end()) {
+  if (FindRow(node_info.node_id) != matrix_.end()) {
     LOG(kWarning) << "Already Added in matrix";
     return;
   }
-  matrix_.push_back(std::vector<NodeInfo>(1, node_info));
-  UpdateUniqueNodeList();
+  AddOwnNode();
+  auto row(matrix_.insert(RowPosition(node_info.node_id),
+                          Row(1, NextHop(node_info.node_id, node_info.connection_id))));
+  UpdateRowRelevance(*row);
+  AddUniqueNode(node_info.node_id, node_info.node_id);
+  // Any version kept from a pruned row doesn't describe the new, empty one.
+  row_versions_.erase(node_info.node_id);
 }
 
 void GroupMatrix::RemoveConnectedPeer(const NodeInfo& node_info, MatrixChange& matrix_change) {
-  matrix_change.old_matrix = GetUniqueNodeIds();
-  matrix_.erase(std::remove_if(matrix_.begin(),
-                               matrix_.end(),
-                               [node_info](const std::vector<NodeInfo> nodes) {
-                                 return (node_info.node_id == nodes.begin()->node_id);
-                               }), matrix_.end());
+  MatrixChange::Snapshot old_matrix(GetUniqueNodeIdsSnapshot());
+  AddOwnNode();
+  auto row(FindRow(node_info.node_id));
+  if (row != matrix_.end())
+    EraseRow(row);
+  row_versions_.erase(node_info.node_id);
   Prune();
-  UpdateUniqueNodeList();
-  matrix_change.new_matrix = GetUniqueNodeIds();
+  matrix_change = GetMatrixChange(old_matrix);
 }
 
 std::vector<NodeInfo> GroupMatrix::GetConnectedPeers() const {
   std::vector<NodeInfo> connected_peers;
   for (const auto& nodes : matrix_) {
     if (nodes.begin()->node_id != kNodeId_)
-      connected_peers.push_back(nodes.at(0));
+      connected_peers.push_back(ToNodeInfo(nodes.front()));
   }
   return connected_peers;
 }
 
-NodeInfo GroupMatrix::GetConnectedPeerFor(const NodeId& target_node_id) {
-/*
-  for (const auto& nodes : matrix_) {
-    if (nodes.at(0).node_id == target_node_id) {
-      assert(false && "Shouldn't request connected peer for node in first column of group matrix.");
-      return NodeInfo();
-    }
-  }*/
-  for (const auto& nodes : matrix_) {
-    if (std::find_if(nodes.begin(), nodes.end(),
-                     [target_node_id](const NodeInfo& node_info) {
-                       return (node_info.node_id == target_node_id);
-                     }) != nodes.end()) {
-      return nodes.at(0);
-    }
+NodeInfo GroupMatrix::GetConnectedPeerFor(const NodeId& target_node_id) const {
+  auto unique_node(FindUniqueNode(target_node_id));
+  if (unique_node == unique_nodes_.end())
+    return NodeInfo();
+  for (const auto& row_id : unique_node->rows) {
+    if (row_id != kNodeId_)
+      return ToNodeInfo(FindRow(row_id)->front());
   }
   return NodeInfo();
 }
 
 void GroupMatrix::GetBetterNodeForSendingMessage(const NodeId& target_node_id,
-                                                 const std::vector<std::string>& exclude,
+                                                 const std::string& packed_exclude,
                                                  bool ignore_exact_match,
-                                                 NodeInfo& current_closest_peer) {
+                                                 NextHop& current_closest_peer) const {
   NodeId closest_id(current_closest_peer.node_id);
-
-  for (const auto& row : matrix_) {
-    if (ignore_exact_match && row.at(0).node_id == target_node_id)
-      continue;
-    if (std::find(exclude.begin(), exclude.end(), row.at(0).node_id.string()) != exclude.end())
-      continue;
-
-    for (const auto& node : row) {
-      if (node.node_id == kNodeId_)
-        continue;
-      if (ignore_exact_match && node.node_id == target_node_id)
-        continue;
-      if (std::find(exclude.begin(), exclude.end(), node.node_id.string()) != exclude.end())
+  auto is_excluded([&](const NodeId& node_id) {
+    return (ignore_exact_match && node_id == target_node_id) ||
+           PackedNodeIdsContain(packed_exclude, node_id);
+  });
+
+  // The first acceptable node visited is the closest one; once nodes are no further forward than
+  // the current choice, none of the remaining ones can be.
+  VisitByDistance(target_node_id, [&](const UniqueNode& node)->bool {
+    if (!NodeId::CloserToTarget(node.node_id, closest_id, target_node_id))
+      return false;
+    if (node.node_id == kNodeId_ || is_excluded(node.node_id))
+      return true;
+    for (const auto& row_id : node.rows) {
+      if (row_id == kNodeId_ || is_excluded(row_id))
         continue;
-      if (NodeId::CloserToTarget(node.node_id, closest_id, target_node_id)) {
-        closest_id = node.node_id;
-        current_closest_peer = row.at(0);
-      }
+      closest_id = node.node_id;
+      current_closest_peer = FindRow(row_id)->front();
+      return false;
     }
-  }
+    return true;
+  });
   LOG(kVerbose) << "[" << DebugId(kNodeId_)
                 << "]\ttarget: " << DebugId(target_node_id)
                 << "\tfound node in matrix: " << DebugId(closest_id)
@@ -125,43 +170,43 @@ void GroupMatrix::GetBetterNodeForSendingMessage(const NodeId& target_node_id,
 
 void GroupMatrix::GetBetterNodeForSendingMessage(const NodeId& target_node_id,
                                                  bool ignore_exact_match,
-                                                 NodeId& current_closest_peer_id) {
+                                                 NodeId& current_closest_peer_id) const {
   NodeId closest_id(current_closest_peer_id);
 
-  for (const auto& row : matrix_) {
-    if (ignore_exact_match && row.at(0).node_id == target_node_id)
-      continue;
-
-    for (const auto& node : row) {
-      if (ignore_exact_match && node.node_id == target_node_id)
+  VisitByDistance(target_node_id, [&](const UniqueNode& node)->bool {
+    if (!NodeId::CloserToTarget(node.node_id, closest_id, target_node_id))
+      return false;
+    if (ignore_exact_match && node.node_id == target_node_id)
+      return true;
+    for (const auto& row_id : node.rows) {
+      if (row_id == kNodeId_ || (ignore_exact_match && row_id == target_node_id))
         continue;
-      if (NodeId::CloserToTarget(node.node_id, closest_id, target_node_id)) {
-        closest_id = node.node_id;
-        current_closest_peer_id = row.at(0).node_id;
-      }
+      closest_id = node.node_id;
+      current_closest_peer_id = row_id;
+      return false;
     }
-  }
+    return true;
+  });
   LOG(kVerbose) << "[" << DebugId(kNodeId_)
                 << "]\ttarget: " << DebugId(target_node_id)
                 << "\tfound node in matrix: " << DebugId(closest_id)
                 << "\treccommend sending to: " << DebugId(current_closest_peer_id);
 }
 
-std::vector<NodeInfo> GroupMatrix::GetAllConnectedPeersFor(const NodeId& target_id) {
+std::vector<NodeInfo> GroupMatrix::GetAllConnectedPeersFor(const NodeId& target_id) const {
   std::vector<NodeInfo> connected_nodes;
-  for (const auto& row : matrix_) {
-    if (std::find_if(row.begin(),
-                     row.end(),
-                     [&target_id] (const NodeInfo& node_info) {
-                       return target_id == node_info.node_id;
-                     }) != row.end()) {
-      connected_nodes.push_back(row.at(0));
-    }
+  auto unique_node(FindUniqueNode(target_id));
+  if (unique_node == unique_nodes_.end())
+    return connected_nodes;
+  for (auto itr(unique_node->rows.begin()); itr != unique_node->rows.end(); ++itr) {
+    // A row listing the node more than once appears once.
+    if (*itr != kNodeId_ && std::find(unique_node->rows.begin(), itr, *itr) == itr)
+      connected_nodes.push_back(ToNodeInfo(FindRow(*itr)->front()));
   }
   return connected_nodes;
 }
 
-bool GroupMatrix::IsThisNodeGroupLeader(const NodeId& target_id, NodeId& connected_peer) {
+bool GroupMatrix::IsThisNodeGroupLeader(const NodeId& target_id, NodeId& connected_peer) const {
   assert(!client_mode_ && "Client should not call IsThisNodeGroupLeader.");
   if (client_mode_)
     return false;
@@ -174,20 +219,21 @@ bool GroupMatrix::IsThisNodeGroupLeader(const NodeId& target_id, NodeId& connect
   }
 
   std::string log("unique_nodes_ for " + DebugId(kNodeId_) + " are ");
-  for (const auto& node : unique_nodes_) {
-    log += DebugId(node.node_id) + ", ";
+  for (const auto& node_id : unique_node_ids_) {
+    log += DebugId(node_id) + ", ";
   }
   LOG(kVerbose) << log;
 
-  for (const auto& node : unique_nodes_) {
+  // Only the closest node other than target_id needs checking.
+  VisitByDistance(target_id, [&](const UniqueNode& node)->bool {
     if (node.node_id == target_id)
-      continue;
+      return true;
     if (NodeId::CloserToTarget(node.node_id, kNodeId_, target_id)) {
       LOG(kVerbose) << DebugId(node.node_id) << " could be leader";
       is_group_leader = false;
-      break;
     }
-  }
+    return false;
+  });
   if (!is_group_leader) {
     NodeId better_id(kNodeId_);
     GetBetterNodeForSendingMessage(target_id, true, better_id);
@@ -197,107 +243,214 @@ bool GroupMatrix::IsThisNodeGroupLeader(const NodeId& target_id, NodeId& connect
   return is_group_leader;
 }
 
-bool GroupMatrix::ClosestToId(const NodeId& target_id) {
+bool GroupMatrix::ClosestToId(const NodeId& target_id) const {
   if (unique_nodes_.size() == 0)
     return true;
 
-  PartialSortFromTarget(target_id, 2, unique_nodes_);
-  if (unique_nodes_.at(0).node_id == kNodeId_)
+  // Find the two closest without reordering unique_nodes_, so a shared matrix can be queried.
+  auto first(unique_nodes_.end()), second(unique_nodes_.end());
+  for (auto itr(unique_nodes_.begin()); itr != unique_nodes_.end(); ++itr) {
+    if (first == unique_nodes_.end() ||
+        NodeId::CloserToTarget(itr->node_id, first->node_id, target_id)) {
+      second = first;
+      first = itr;
+    } else if (second == unique_nodes_.end() ||
+               NodeId::CloserToTarget(itr->node_id, second->node_id, target_id)) {
+      second = itr;
+    }
+  }
+
+  if (first->node_id == kNodeId_)
     return true;
 
-  if (unique_nodes_.at(0).node_id == target_id) {
-    if (unique_nodes_.at(1).node_id == kNodeId_)
+  if (first->node_id == target_id) {
+    if (second == unique_nodes_.end() || second->node_id == kNodeId_)
       return true;
     else
-      return NodeId::CloserToTarget(kNodeId_, unique_nodes_.at(1).node_id, target_id);
+      return NodeId::CloserToTarget(kNodeId_, second->node_id, target_id);
   }
 
-  return NodeId::CloserToTarget(kNodeId_, unique_nodes_.at(0).node_id, target_id);
+  return NodeId::CloserToTarget(kNodeId_, first->node_id, target_id);
 }
 
-bool GroupMatrix::IsNodeIdInGroupRange(const NodeId& target_id) {
+bool GroupMatrix::IsNodeIdInGroupRange(const NodeId& target_id) const {
   if (unique_nodes_.size() < Parameters::node_group_size) {
     return true;
   }
 
-  PartialSortFromTarget(kNodeId_, Parameters::node_group_size, unique_nodes_);
-
-  NodeInfo furthest_group_node(unique_nodes_.at(Parameters::node_group_size - 1));
-  return !NodeId::CloserToTarget(furthest_group_node.node_id, target_id, kNodeId_);
+  // In range unless at least node_group_size nodes are closer to this node than target_id is.
+  // unique_node_ids_ is sorted by distance from kNodeId_, so those nodes precede the lower bound.
+  auto first_not_closer(std::lower_bound(unique_node_ids_.begin(), unique_node_ids_.end(),
+                                         target_id,
+                                         [this](const NodeId& lhs, const NodeId& rhs) {
+                                           return NodeId::CloserToTarget(lhs, rhs, kNodeId_);
+                                         }));
+  return static_cast<size_t>(first_not_closer - unique_node_ids_.begin()) <
+         Parameters::node_group_size;
 }
 
 void GroupMatrix::UpdateFromConnectedPeer(const NodeId& peer,
-                                          const std::vector<NodeInfo>& nodes) {
+                                          const std::vector<NodeInfo>& nodes,
+                                          uint64_t version) {
   assert(nodes.size() < Parameters::max_routing_table_size);
   if (peer.IsZero()) {
     assert(false && "Invalid peer node id.");
     return;
   }
   // If peer is in my group
-  auto group_itr(matrix_.begin());
-  for (; group_itr != matrix_.end(); ++group_itr) {
-    if (group_itr->begin()->node_id == peer)
-      break;
-  }
-
+  auto group_itr(FindRow(peer));
   if (group_itr == matrix_.end()) {
     LOG(kWarning) << "Peer Node : " << DebugId(peer)
                   << " is not in closest group of this node.";
     return;
   }
 
-  // Update peer's row
-  if (group_itr->size() > 1) {
-    group_itr->erase(group_itr->begin() + 1, group_itr->end());
+  // Update peer's row, and the unique node list along with it
+  AddOwnNode();
+  for (auto itr(group_itr->begin() + 1); itr != group_itr->end(); ++itr)
+    RemoveUniqueNode(itr->node_id, peer);
+  group_itr->erase(group_itr->begin() + 1, group_itr->end());
+  for (const auto& i : nodes) {
+    group_itr->push_back(NextHop(i.node_id, i.connection_id));
+    AddUniqueNode(i.node_id, peer);
   }
-  for (const auto& i : nodes)
-    group_itr->push_back(i);
+  std::sort(group_itr->begin() + 1,
+            group_itr->end(),
+            [&peer](const NextHop& lhs, const NextHop& rhs) {
+              return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, peer);
+            });
+  UpdateRowRelevance(*group_itr);
+  if (version != 0)
+    row_versions_[peer] = version;
+  else
+    row_versions_.erase(peer);
 
-  // Update unique node vector
   Prune();
-  UpdateUniqueNodeList();
 }
 
-bool GroupMatrix::GetRow(const NodeId& row_id, std::vector<NodeInfo>& row_entries) {
-  if (row_id.IsZero()) {
-    assert(false && "Invalid node id.");
+bool GroupMatrix::UpdateFromConnectedPeer(const NodeId& peer,
+                                          const std::vector<NodeInfo>& added_nodes,
+                                          const std::vector<NodeId>& removed_nodes,
+                                          uint64_t base_version,
+                                          uint64_t version) {
+  assert(base_version < version);
+  auto row_version(row_versions_.find(peer));
+  if (row_version == row_versions_.end())
     return false;
+  if (version <= row_version->second) {
+    LOG(kVerbose) << "Ignoring stale update " << version << " from " << DebugId(peer);
+    return true;
   }
-  auto group_itr(matrix_.begin());
-  for (group_itr = matrix_.begin(); group_itr != matrix_.end(); ++group_itr) {
-    if ((*group_itr).at(0).node_id == row_id)
-      break;
+  if (row_version->second != base_version)
+    return false;
+  auto group_itr(FindRow(peer));
+  if (group_itr == matrix_.end()) {
+    LOG(kVerbose) << "Peer Node : " << DebugId(peer) << " is not in closest group of this node, "
+                  << "only following its version.";
+    row_version->second = version;
+    return true;
   }
 
+  auto in_row([&](const NodeId& node_id) {
+    auto entry(EntryPosition(*group_itr, node_id));
+    return entry != group_itr->end() && entry->node_id == node_id;
+  });
+  for (const auto& node_id : removed_nodes) {
+    if (!in_row(node_id))
+      return false;
+  }
+  for (const auto& node_info : added_nodes) {
+    if (in_row(node_info.node_id) &&
+        std::find(removed_nodes.begin(), removed_nodes.end(), node_info.node_id) ==
+            removed_nodes.end())
+      return false;
+  }
+
+  AddOwnNode();
+  for (const auto& node_id : removed_nodes) {
+    auto removed(EntryPosition(*group_itr, node_id));
+    if (removed == group_itr->end() || removed->node_id != node_id)
+      continue;
+    RemoveUniqueNode(node_id, peer);
+    group_itr->erase(removed);
+  }
+  for (const auto& node_info : added_nodes) {
+    group_itr->insert(EntryPosition(*group_itr, node_info.node_id),
+                      NextHop(node_info.node_id, node_info.connection_id));
+    AddUniqueNode(node_info.node_id, peer);
+  }
+  assert(group_itr->size() <= Parameters::max_routing_table_size);
+  UpdateRowRelevance(*group_itr);
+  row_version->second = version;
+
+  Prune();
+  return true;
+}
+
+bool GroupMatrix::GetRow(const NodeId& row_id, std::vector<NodeInfo>& row_entries) const {
+  if (row_id.IsZero()) {
+    assert(false && "Invalid node id.");
+    return false;
+  }
+  auto group_itr(FindRow(row_id));
   if (group_itr == matrix_.end())
     return false;
 
   row_entries.clear();
   for (uint32_t i(0); i < (*group_itr).size(); ++i) {
     if (i != 0) {
-      row_entries.push_back((*group_itr).at(i));
+      row_entries.push_back(ToNodeInfo((*group_itr).at(i)));
     }
   }
   return true;
 }
 
 std::vector<NodeInfo> GroupMatrix::GetUniqueNodes() const {
-  return unique_nodes_;
+  std::vector<NodeInfo> unique_nodes;
+  unique_nodes.reserve(unique_nodes_.size());
+  for (const auto& node : unique_nodes_)
+    unique_nodes.push_back(ToNodeInfo(node.node_id));
+  return unique_nodes;
 }
 
-std::vector<NodeId> GroupMatrix::GetUniqueNodeIds() const {
-  std::vector<NodeId> unique_node_ids;
-  for (auto& node_info : unique_nodes_)
-    unique_node_ids.push_back(node_info.node_id);
-  return unique_node_ids;
+const std::vector<NodeId>& GroupMatrix::GetUniqueNodeIds() const {
+  return unique_node_ids_;
 }
 
-bool GroupMatrix::IsRowEmpty(const NodeInfo& node_info) {
-  auto group_itr(matrix_.begin());
-  for (group_itr = matrix_.begin(); group_itr != matrix_.end(); ++group_itr) {
-    if ((*group_itr).at(0).node_id == node_info.node_id)
-      break;
+MatrixChange::Snapshot GroupMatrix::GetUniqueNodeIdsSnapshot() const {
+  if (!unique_node_ids_snapshot_)
+    unique_node_ids_snapshot_ = std::make_shared<const std::vector<NodeId>>(unique_node_ids_);
+  return unique_node_ids_snapshot_;
+}
+
+// Both snapshots are sorted by distance from kNodeId_, so a single merge finds the added and
+// removed ids.
+MatrixChange GroupMatrix::GetMatrixChange(const MatrixChange::Snapshot& old_matrix) const {
+  MatrixChange matrix_change;
+  matrix_change.old_matrix = old_matrix ? old_matrix :
+                                          std::make_shared<const std::vector<NodeId>>();
+  matrix_change.new_matrix = GetUniqueNodeIdsSnapshot();
+  if (matrix_change.old_matrix == matrix_change.new_matrix)
+    return matrix_change;
+  auto old_itr(matrix_change.old_matrix->begin()), new_itr(matrix_change.new_matrix->begin());
+  while (old_itr != matrix_change.old_matrix->end() ||
+         new_itr != matrix_change.new_matrix->end()) {
+    if (new_itr == matrix_change.new_matrix->end() ||
+        (old_itr != matrix_change.old_matrix->end() &&
+         NodeId::CloserToTarget(*old_itr, *new_itr, kNodeId_))) {
+      matrix_change.removed.push_back(*old_itr++);
+    } else if (old_itr == matrix_change.old_matrix->end() || *old_itr != *new_itr) {
+      matrix_change.added.push_back(*new_itr++);
+    } else {
+      ++old_itr;
+      ++new_itr;
+    }
   }
+  return matrix_change;
+}
+
+bool GroupMatrix::IsRowEmpty(const NodeInfo& node_info) const {
+  auto group_itr(FindRow(node_info.node_id));
   assert(group_itr != matrix_.end());
   if (group_itr == matrix_.end())
     return false;
@@ -305,90 +458,176 @@ bool GroupMatrix::IsRowEmpty(const NodeInfo& node_info) {
   return (group_itr->size() < 2);
 }
 
-std::vector<NodeInfo> GroupMatrix::GetClosestNodes(const uint16_t& size) {
-  uint16_t size_to_sort(std::min(size, static_cast<uint16_t>(unique_nodes_.size())));
-  PartialSortFromTarget(kNodeId_, size_to_sort, unique_nodes_);
-  return std::vector<NodeInfo>(unique_nodes_.begin(), unique_nodes_.begin() + size_to_sort);
+std::vector<NodeInfo> GroupMatrix::GetClosestNodes(const uint16_t& size) const {
+  std::vector<NodeInfo> closest_nodes;
+  for (auto itr(unique_nodes_.begin());
+       itr != unique_nodes_.end() && closest_nodes.size() < size;
+       ++itr) {
+    closest_nodes.push_back(ToNodeInfo(itr->node_id));
+  }
+  return closest_nodes;
 }
 
-bool GroupMatrix::Contains(const NodeId& node_id) {
-  return std::find_if(unique_nodes_.begin(), unique_nodes_.end(),
-                      [&node_id] (const NodeInfo& node_info) {
-                        return node_info.node_id == node_id;
-                      }) != unique_nodes_.end();
+bool GroupMatrix::Contains(const NodeId& node_id) const {
+  return FindUniqueNode(node_id) != unique_nodes_.end();
 }
 
-void GroupMatrix::UpdateUniqueNodeList() {
-  std::set<NodeInfo, std::function<bool(const NodeInfo&, const NodeInfo&)>> sorted_to_owner(
-      [&](const NodeInfo& lhs, const NodeInfo& rhs) {
-          return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, kNodeId_);
-      });
-  if (!client_mode_) {
-    NodeInfo node_info;
-    node_info.node_id = kNodeId_;
-    sorted_to_owner.insert(node_info);
-  }
-  for (const auto& node_ids : matrix_) {
-    for (const auto& node_id : node_ids)
-      sorted_to_owner.insert(node_id);
+GroupMatrix::Matrix::iterator GroupMatrix::FindRow(const NodeId& row_id) {
+  auto row(RowPosition(row_id));
+  if (row == matrix_.end() || row->front().node_id != row_id)
+    return matrix_.end();
+  return row;
+}
+
+GroupMatrix::Matrix::const_iterator GroupMatrix::FindRow(const NodeId& row_id) const {
+  auto row(std::lower_bound(matrix_.begin(), matrix_.end(), row_id,
+                            [this](const Row& row, const NodeId& node_id) {
+                              return NodeId::CloserToTarget(row.front().node_id, node_id,
+                                                            kNodeId_);
+                            }));
+  if (row == matrix_.end() || row->front().node_id != row_id)
+    return matrix_.end();
+  return row;
+}
+
+GroupMatrix::Matrix::iterator GroupMatrix::RowPosition(const NodeId& row_id) {
+  return std::lower_bound(matrix_.begin(), matrix_.end(), row_id,
+                          [this](const Row& row, const NodeId& node_id) {
+                            return NodeId::CloserToTarget(row.front().node_id, node_id, kNodeId_);
+                          });
+}
+
+GroupMatrix::Row::iterator GroupMatrix::EntryPosition(Row& row, const NodeId& node_id) {
+  const NodeId& row_id(row.front().node_id);
+  return std::lower_bound(row.begin() + 1, row.end(), node_id,
+                          [&row_id](const NextHop& entry, const NodeId& target) {
+                            return NodeId::CloserToTarget(entry.node_id, target, row_id);
+                          });
+}
+
+// A row stays relevant while its owner has fewer than closest_nodes_size nodes closer to it than
+// this node is.  Clients keep only their closest rows.
+void GroupMatrix::UpdateRowRelevance(const Row& row) {
+  const NodeId& row_id(row.front().node_id);
+  if (!client_mode_ && row.size() > Parameters::closest_nodes_size &&
+      !NodeId::CloserToTarget(row[Parameters::closest_nodes_size].node_id, kNodeId_, row_id))
+    irrelevant_rows_.erase(row_id);
+  else
+    irrelevant_rows_.insert(row_id);
+}
+
+std::vector<GroupMatrix::UniqueNode>::const_iterator GroupMatrix::FindUniqueNode(
+    const NodeId& node_id) const {
+  auto itr(std::lower_bound(unique_node_ids_.begin(), unique_node_ids_.end(), node_id,
+                            [this](const NodeId& lhs, const NodeId& rhs) {
+                              return NodeId::CloserToTarget(lhs, rhs, kNodeId_);
+                            }));
+  if (itr == unique_node_ids_.end() || *itr != node_id)
+    return unique_nodes_.end();
+  return unique_nodes_.begin() + (itr - unique_node_ids_.begin());
+}
+
+// This node joins the unique node list on the first modification of the matrix, not on
+// construction.
+// Rows can only refer to it after that, so it is never counted before being added here.
+void GroupMatrix::AddOwnNode() {
+  if (client_mode_ || Contains(kNodeId_))
+    return;
+  AddUniqueNode(kNodeId_, kNodeId_);
+}
+
+void GroupMatrix::AddUniqueNode(const NodeId& node_id, const NodeId& row_id) {
+  auto itr(std::lower_bound(unique_node_ids_.begin(), unique_node_ids_.end(), node_id,
+                            [this](const NodeId& lhs, const NodeId& rhs) {
+                              return NodeId::CloserToTarget(lhs, rhs, kNodeId_);
+                            }));
+  auto unique_node(unique_nodes_.begin() + (itr - unique_node_ids_.begin()));
+  if (itr == unique_node_ids_.end() || *itr != node_id) {
+    unique_node_ids_.insert(itr, node_id);
+    unique_node_ids_snapshot_.reset();
+    unique_node = unique_nodes_.insert(unique_node, UniqueNode(node_id));
   }
+  unique_node->rows.push_back(row_id);
+}
 
-  unique_nodes_.assign(std::begin(sorted_to_owner), std::end(sorted_to_owner));
+void GroupMatrix::RemoveUniqueNode(const NodeId& node_id, const NodeId& row_id) {
+  auto itr(std::lower_bound(unique_node_ids_.begin(), unique_node_ids_.end(), node_id,
+                            [this](const NodeId& lhs, const NodeId& rhs) {
+                              return NodeId::CloserToTarget(lhs, rhs, kNodeId_);
+                            }));
+  assert(itr != unique_node_ids_.end() && *itr == node_id);
+  if (itr == unique_node_ids_.end() || *itr != node_id)
+    return;
+  auto unique_node(unique_nodes_.begin() + (itr - unique_node_ids_.begin()));
+  auto row(std::find(unique_node->rows.begin(), unique_node->rows.end(), row_id));
+  assert(row != unique_node->rows.end());
+  if (row != unique_node->rows.end())
+    unique_node->rows.erase(row);
+  if (!unique_node->rows.empty())
+    return;
+  unique_node_ids_.erase(itr);
+  unique_node_ids_snapshot_.reset();
+  unique_nodes_.erase(unique_node);
 }
 
-void GroupMatrix::PartialSortFromTarget(const NodeId& target,
-                                        const uint16_t& number,
-                                        std::vector<NodeInfo>& nodes) {
-  uint16_t count = std::min(number, static_cast<uint16_t>(nodes.size()));
-  std::partial_sort(nodes.begin(),
-                    nodes.begin() + count,
-                    nodes.end(),
-                    [target](const NodeInfo& lhs, const NodeInfo& rhs) {
-                      return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, target);
-                    });
+void GroupMatrix::EraseRow(Matrix::iterator row) {
+  const NodeId row_id(row->at(0).node_id);
+  for (const auto& entry : *row)
+    RemoveUniqueNode(entry.node_id, row_id);
+  matrix_.erase(row);
+  irrelevant_rows_.erase(row_id);
 }
 
-void GroupMatrix::Prune() {
-  if (matrix_.size() <= Parameters::closest_nodes_size)
+// unique_nodes_ is sorted by distance from kNodeId_, which is the order of the ids XORed with
+// kNodeId_.  So any run of it whose ids share a prefix splits at the first bit where those ids
+// differ, into the nodes matching kNodeId_ at that bit and then the rest.  The half matching
+// target_id at that bit holds the closer nodes to target_id, so descending into it first yields the
+// nodes closest to target_id first, without looking at the others until they are needed.
+void GroupMatrix::VisitByDistance(const NodeId& target_id,
+                                  const std::function<bool(const UniqueNode&)>& visit) const {
+  if (unique_nodes_.empty())
     return;
-  NodeId node_id;
-  std::vector<NodeId> peers_to_remove;
-  std::partial_sort(matrix_.begin(),
-                    matrix_.begin() + Parameters::closest_nodes_size,
-                    matrix_.end(),
-                    [this](const std::vector<NodeInfo>& lhs, const std::vector<NodeInfo>& rhs) {
-                      return NodeId::CloserToTarget(lhs.begin()->node_id,
-                                                    rhs.begin()->node_id,
-                                                    kNodeId_);
-                    });
-  auto itr(matrix_.begin());
-  std::advance(itr, Parameters::closest_nodes_size);
-  for (; itr != matrix_.end(); ++itr) {
-    if (client_mode_) {
-      peers_to_remove.push_back(itr->begin()->node_id);
+  const std::string raw_target_id(target_id.string());
+  std::vector<std::pair<size_t, size_t>> ranges(1, std::make_pair(0, unique_nodes_.size()));
+  while (!ranges.empty()) {
+    size_t begin(ranges.back().first), end(ranges.back().second);
+    ranges.pop_back();
+    if (end - begin == 1) {
+      if (!visit(unique_nodes_.at(begin)))
+        return;
       continue;
     }
-    node_id = itr->begin()->node_id;
-    if (itr->size() < Parameters::closest_nodes_size) {
-      peers_to_remove.push_back(node_id);
-      continue;
+    const size_t bit(FirstDifferingBit(unique_nodes_.at(begin).raw_id,
+                                       unique_nodes_.at(end - 1).raw_id));
+    const bool first_half_bit(Bit(unique_nodes_.at(begin).raw_id, bit));
+    size_t split(std::partition_point(unique_nodes_.begin() + begin,
+                                      unique_nodes_.begin() + end,
+                                      [&](const UniqueNode& node) {
+                                        return Bit(node.raw_id, bit) == first_half_bit;
+                                      }) - unique_nodes_.begin());
+    if (Bit(raw_target_id, bit) == first_half_bit) {
+      ranges.push_back(std::make_pair(split, end));
+      ranges.push_back(std::make_pair(begin, split));
+    } else {
+      ranges.push_back(std::make_pair(begin, split));
+      ranges.push_back(std::make_pair(split, end));
     }
-    std::partial_sort(itr->begin() + 1,
-                      itr->begin() + Parameters::closest_nodes_size + 1,
-                      itr->end(),
-                      [node_id] (const NodeInfo& lhs, const NodeInfo& rhs) {
-                        return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, node_id);
-                      });
-    if (NodeId::CloserToTarget(itr->at(Parameters::closest_nodes_size).node_id, kNodeId_, node_id))
-      peers_to_remove.push_back(node_id);
+  }
+}
+
+// Rows are kept in order of distance from this node, so the rows past the closest ones are the only
+// candidates for removal, and each row's relevance is already known from when it was last written.
+void GroupMatrix::Prune() {
+  if (matrix_.size() <= Parameters::closest_nodes_size)
+    return;
+  std::vector<NodeId> peers_to_remove;
+  for (auto itr(matrix_.begin() + Parameters::closest_nodes_size); itr != matrix_.end(); ++itr) {
+    if (irrelevant_rows_.count(itr->front().node_id) != 0)
+      peers_to_remove.push_back(itr->front().node_id);
   }
   for (auto& peer : peers_to_remove) {
     LOG(kInfo) << DebugId(kNodeId_) << " matrix conected removes " << DebugId(peer);
-    matrix_.erase(std::remove_if(matrix_.begin(),
-                                 matrix_.end(),
-                                 [peer] (const std::vector<NodeInfo>& row) {
-                                   return row.begin()->node_id == peer;
-                                 }));
+    EraseRow(FindRow(peer));
   }
 }
 
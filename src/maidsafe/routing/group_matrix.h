@@ -17,13 +17,18 @@ License.
 #define MAIDSAFE_ROUTING_GROUP_MATRIX_H_
 
 #include <cstdint>
+#include <functional>
 #include <mutex>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "maidsafe/common/node_id.h"
 #include "maidsafe/routing/node_info.h"
 #include "maidsafe/routing/api_config.h"
+#include "maidsafe/routing/next_hop.h"
+#include "maidsafe/routing/node_id_hash.h"
 
 namespace maidsafe {
 
@@ -43,6 +48,7 @@ struct NodeInfo;
 class GroupMatrix {
  public:
   explicit GroupMatrix(const NodeId& this_node_id, bool client_mode);
+  GroupMatrix(const GroupMatrix& other);
 
   void AddConnectedPeer(const NodeInfo& node_info);
 
@@ -52,29 +58,49 @@ class GroupMatrix {
   std::vector<NodeInfo> GetConnectedPeers() const;
 
   // Returns the peer which has target_info in its row (1st occurrence).
-  NodeInfo GetConnectedPeerFor(const NodeId& target_node_id);
+  NodeInfo GetConnectedPeerFor(const NodeId& target_node_id) const;
 
-  // Returns the peer which has node closest to target_id in its row (1st occurrence).
+  // Returns the peer which has node closest to target_id in its row (1st occurrence).  Excluded
+  // IDs are packed as for PackNodeIds.
   void GetBetterNodeForSendingMessage(const NodeId& target_node_id,
-                                      const std::vector<std::string>& exclude,
+                                      const std::string& packed_exclude,
                                       bool ignore_exact_match,
-                                      NodeInfo& current_closest_peer);
+                                      NextHop& current_closest_peer) const;
   void GetBetterNodeForSendingMessage(const NodeId& target_node_id,
                                       bool ignore_exact_match,
-                                      NodeId& current_closest_peer_id);
-  std::vector<NodeInfo> GetAllConnectedPeersFor(const NodeId& target_id);
-  bool IsThisNodeGroupLeader(const NodeId& target_id, NodeId& connected_peer);
-  bool ClosestToId(const NodeId& target_id);
-  bool IsNodeIdInGroupRange(const NodeId& target_id);
-
-  // Updates group matrix if peer is present in 1st column of matrix
-  void UpdateFromConnectedPeer(const NodeId& peer, const std::vector<NodeInfo>& nodes);
-  bool IsRowEmpty(const NodeInfo& node_info);
-  bool GetRow(const NodeId& row_id, std::vector<NodeInfo>& row_entries);
+                                      NodeId& current_closest_peer_id) const;
+  std::vector<NodeInfo> GetAllConnectedPeersFor(const NodeId& target_id) const;
+  bool IsThisNodeGroupLeader(const NodeId& target_id, NodeId& connected_peer) const;
+  bool ClosestToId(const NodeId& target_id) const;
+  bool IsNodeIdInGroupRange(const NodeId& target_id) const;
+
+  // Updates group matrix if peer is present in 1st column of matrix.  A non-zero version is
+  // recorded as the version of the row, which later deltas build on.
+  void UpdateFromConnectedPeer(const NodeId& peer,
+                               const std::vector<NodeInfo>& nodes,
+                               uint64_t version = 0);
+  // Applies the changes between versions base_version and version of peer's row.  Returns false if
+  // the row isn't at base_version (or the changes don't fit it), in which case it is left unchanged
+  // and only a complete update can bring it up to date.  That includes a peer with no row and no
+  // version, whose row must be seeded from its complete list.  Deltas older than the row are
+  // ignored, as are the contents of those for a row which Prune has removed; only its version is
+  // followed.
+  bool UpdateFromConnectedPeer(const NodeId& peer,
+                               const std::vector<NodeInfo>& added_nodes,
+                               const std::vector<NodeId>& removed_nodes,
+                               uint64_t base_version,
+                               uint64_t version);
+  bool IsRowEmpty(const NodeInfo& node_info) const;
+  bool GetRow(const NodeId& row_id, std::vector<NodeInfo>& row_entries) const;
   std::vector<NodeInfo> GetUniqueNodes() const;
-  std::vector<NodeId> GetUniqueNodeIds() const;
-  std::vector<NodeInfo> GetClosestNodes(const uint16_t& size);
-  bool Contains(const NodeId& node_id);
+  // Sorted by distance from this node.  Valid until the matrix is next modified.
+  const std::vector<NodeId>& GetUniqueNodeIds() const;
+  // Immutable copy of GetUniqueNodeIds(), shared until the unique nodes next change.
+  MatrixChange::Snapshot GetUniqueNodeIdsSnapshot() const;
+  // The change from old_matrix, an earlier snapshot, to the current unique nodes.
+  MatrixChange GetMatrixChange(const MatrixChange::Snapshot& old_matrix) const;
+  std::vector<NodeInfo> GetClosestNodes(const uint16_t& size) const;
+  bool Contains(const NodeId& node_id) const;
   void Prune();
 
   friend class test::GenericNode;
@@ -82,17 +108,55 @@ class GroupMatrix {
   friend class test::GroupMatrixTest_BEH_Prune_Test;
 
  private:
-  GroupMatrix(const GroupMatrix&);
+  struct UniqueNode {
+    explicit UniqueNode(const NodeId& node_id_in);
+    NodeId node_id;
+    // node_id.string(), kept for walking the list in order of distance from a target.
+    std::string raw_id;
+    // Ids of the rows holding this node, one per matrix entry, in the order the entries were made.
+    // This node's own entry is listed under kNodeId_.
+    std::vector<NodeId> rows;
+  };
+  // Only node and connection IDs are kept; NodeInfos are built for the callers which want them.
+  typedef std::vector<NextHop> Row;
+  typedef std::vector<Row> Matrix;
+
   GroupMatrix& operator=(const GroupMatrix&);
-  void UpdateUniqueNodeList();
-  void PartialSortFromTarget(const NodeId& target, const uint16_t& number,
-                             std::vector<NodeInfo> &nodes);
+  Matrix::iterator FindRow(const NodeId& row_id);
+  Matrix::const_iterator FindRow(const NodeId& row_id) const;
+  // Where a row for row_id is, or would be inserted, in matrix_.
+  Matrix::iterator RowPosition(const NodeId& row_id);
+  // Where node_id is, or would be inserted, among the entries of row.
+  Row::iterator EntryPosition(Row& row, const NodeId& node_id);
+  void UpdateRowRelevance(const Row& row);
+  std::vector<UniqueNode>::const_iterator FindUniqueNode(const NodeId& node_id) const;
+  void AddOwnNode();
+  void AddUniqueNode(const NodeId& node_id, const NodeId& row_id);
+  void RemoveUniqueNode(const NodeId& node_id, const NodeId& row_id);
+  void EraseRow(Matrix::iterator row);
+  // Calls 'visit' on the unique nodes in order of increasing distance from target_id, until it
+  // returns false.
+  void VisitByDistance(const NodeId& target_id,
+                       const std::function<bool(const UniqueNode&)>& visit) const;
   void PrintGroupMatrix();
 
-  const NodeId& kNodeId_;
-  std::vector<NodeInfo> unique_nodes_;
+  // Held by value so that copies can be published as snapshots independently of their source.
+  const NodeId kNodeId_;
+  // Every distinct node in matrix_ (plus this node unless in client mode), sorted by distance from
+  // kNodeId_, and the ids of those nodes.
+  std::vector<UniqueNode> unique_nodes_;
+  std::vector<NodeId> unique_node_ids_;
+  // Reset whenever unique_node_ids_ changes.
+  mutable MatrixChange::Snapshot unique_node_ids_snapshot_;
   bool client_mode_;
-  std::vector<std::vector<NodeInfo>> matrix_;
+  // Rows in order of distance of their owner (first entry) from kNodeId_.  The other entries of
+  // each row are in order of distance from its owner.
+  Matrix matrix_;
+  // Rows which Prune removes if they are not among the closest_nodes_size closest ones.
+  std::unordered_set<NodeId, NodeIdHash> irrelevant_rows_;
+  // Version of each row last updated with one.  Kept when Prune removes the row, until the peer is
+  // removed or its row is added again.
+  std::unordered_map<NodeId, uint64_t, NodeIdHash> row_versions_;
 };
 
 }  // namespace routing
@@ -55,7 +55,10 @@ MessageHandler::MessageHandler(RoutingTable& routing_table,
       response_handler_(new ResponseHandler(routing_table, client_routing_table, network_,
                                             group_change_handler)),
       service_(new Service(routing_table, client_routing_table, network_)),
-      message_received_functor_() {}
+      message_received_functor_(),
+      multipath_requests_mutex_(),
+      multipath_requests_(),
+      multipath_requests_order_() {}
 
 void MessageHandler::HandleRoutingMessage(protobuf::Message& message) {
   bool request(message.request());
@@ -89,6 +92,12 @@ void MessageHandler::HandleRoutingMessage(protobuf::Message& message) {
       message.request() ? service_->GetGroup(message) : response_handler_->GetGroup(timer_,
                                                                                     message);
       break;
+    case MessageType::kClosestNodesUpdateSubscribe :
+      group_change_handler_.ClosestNodesUpdateSubscribe(message);
+      break;
+    case MessageType::kClosestNodesUpdateResync :
+      group_change_handler_.ClosestNodesUpdateResync(message);
+      break;
     default:  // unknown (silent drop)
       return;
   }
@@ -105,6 +114,12 @@ void MessageHandler::HandleRoutingMessage(protobuf::Message& message) {
 }
 
 void MessageHandler::HandleNodeLevelMessageForThisNode(protobuf::Message& message) {
+  if (IsRequest(message) && message.multipath() && IsDuplicateMultipathRequest(message)) {
+    LOG(kVerbose) << "[" << DebugId(routing_table_.kNodeId()) << "] dropping duplicate copy of "
+                  << "multipath request from " << HexSubstr(message.source_id())
+                  << " id: " << message.id();
+    return;
+  }
   if (IsRequest(message) && (!routing_table_.client_mode() ||
       (routing_table_.client_mode() &&
       (routing_table_.Contains(NodeId(message.source_id())) ||
@@ -182,24 +197,26 @@ void MessageHandler::HandleMessageForThisNode(protobuf::Message& message) {
     HandleNodeLevelMessageForThisNode(message);
 }
 
-void MessageHandler::HandleMessageAsClosestNode(protobuf::Message& message) {
+void MessageHandler::HandleMessageAsClosestNode(protobuf::Message& message,
+                                                const RoutingTable::Snapshot& snapshot) {
   LOG(kVerbose) << "This node is in closest proximity to this message destination ID [ "
                 <<  HexSubstr(message.destination_id())
                 << " ]." << " id: " << message.id();
   if (IsDirect(message)) {
-    return HandleDirectMessageAsClosestNode(message);
+    return HandleDirectMessageAsClosestNode(message, snapshot);
   } else {
-    return HandleGroupMessageAsClosestNode(message);
+    return HandleGroupMessageAsClosestNode(message, snapshot);
   }
 }
 
-void MessageHandler::HandleDirectMessageAsClosestNode(protobuf::Message& message) {
+void MessageHandler::HandleDirectMessageAsClosestNode(protobuf::Message& message,
+                                                      const RoutingTable::Snapshot& snapshot) {
   assert(message.direct());
   // Dropping direct messages if this node is closest and destination node is not in routing_table_
   // or client_routing_table_.
   NodeId destination_node_id(message.destination_id());
-  if (routing_table_.IsThisNodeClosestToIncludingMatrix(destination_node_id)) {
-    if (routing_table_.Contains(destination_node_id) ||
+  if (routing_table_.IsThisNodeClosestToIncludingMatrix(snapshot, destination_node_id)) {
+    if (routing_table_.Contains(snapshot, destination_node_id) ||
         client_routing_table_.Contains(destination_node_id)) {
       return network_.SendToClosestNode(message);
     } else if (!message.has_visited() || !message.visited()) {
@@ -225,11 +242,13 @@ void MessageHandler::HandleDirectMessageAsClosestNode(protobuf::Message& message
   }
 }
 
-void MessageHandler::HandleGroupMessageAsClosestNode(protobuf::Message& message) {
+void MessageHandler::HandleGroupMessageAsClosestNode(protobuf::Message& message,
+                                                     const RoutingTable::Snapshot& snapshot) {
   assert(!message.direct());
-  bool have_node_with_group_id(routing_table_.Contains(NodeId(message.destination_id())));
+  bool have_node_with_group_id(routing_table_.Contains(snapshot, NodeId(message.destination_id())));
   // This node is not closest to the destination node for non-direct message.
-  if (!routing_table_.IsThisNodeClosestTo(NodeId(message.destination_id()), !IsDirect(message)) &&
+  if (!routing_table_.IsThisNodeClosestTo(snapshot, NodeId(message.destination_id()),
+                                          !IsDirect(message)) &&
       !have_node_with_group_id) {
     LOG(kInfo) << "This node is not closest, passing it on." << " id: " << message.id();
     // if (IsCacheableRequest(message))
@@ -241,27 +260,22 @@ void MessageHandler::HandleGroupMessageAsClosestNode(protobuf::Message& message)
 
   if (message.has_visited() &&
       !message.visited() &&
-      (routing_table_.size() > Parameters::closest_nodes_size) &&
-      (!routing_table_.IsThisNodeInRange(NodeId(message.destination_id()),
+      (snapshot.nodes.size() > Parameters::closest_nodes_size) &&
+      (!routing_table_.IsThisNodeInRange(snapshot, NodeId(message.destination_id()),
                                          Parameters::closest_nodes_size))) {
     message.set_visited(true);
     return network_.SendToClosestNode(message);
   }
 
-  std::vector<std::string> route_history;
-  if (message.route_history().size() > 1)
-    route_history = std::vector<std::string>(message.route_history().begin(),
-                                             message.route_history().end() - 1);
-  else if ((message.route_history().size() == 1) &&
-           (message.route_history(0) != routing_table_.kNodeId().string()))
-    route_history.push_back(message.route_history(0));
+  const std::string kRouteHistory(RouteHistoryExclusions(message, routing_table_.kNodeId(),
+                                                         false));
 
   // Confirming from group matrix. If this node is closest to the target id or else passing on to
   // the connected peer which has the closer node.
-  NodeInfo closest_to_group_leader_node;
-  if (!routing_table_.IsThisNodeGroupLeader(NodeId(message.destination_id()),
+  NextHop closest_to_group_leader_node;
+  if (!routing_table_.IsThisNodeGroupLeader(snapshot, NodeId(message.destination_id()),
                                             closest_to_group_leader_node,
-                                            route_history)) {
+                                            kRouteHistory)) {
     assert(NodeId(message.destination_id()) != closest_to_group_leader_node.node_id);
     return network_.SendToDirectAdjustedRoute(message,
                                               closest_to_group_leader_node.node_id,
@@ -277,10 +291,11 @@ void MessageHandler::HandleGroupMessageAsClosestNode(protobuf::Message& message)
 
   --replication;  // Will send to self as well
   message.set_direct(true);
-  message.clear_route_history();
+  message.clear_route_history_ring();
   NodeId destination_id(message.destination_id());
   NodeId own_node_id(routing_table_.kNodeId());
-  auto close_from_matrix(routing_table_.GetClosestMatrixNodes(destination_id, replication + 2));
+  auto close_from_matrix(routing_table_.GetClosestMatrixNodes(snapshot, destination_id,
+                                                              replication + 2));
   close_from_matrix.erase(std::remove_if(close_from_matrix.begin(),
                                          close_from_matrix.end(),
                                          [&destination_id](const NodeInfo& node_info) {
@@ -302,18 +317,20 @@ void MessageHandler::HandleGroupMessageAsClosestNode(protobuf::Message& message)
   LOG(kInfo) << "Group nodes for group_id " << HexSubstr(group_id) << " : "
              << group_members;
 
+  std::vector<NodeInfo> connected_replicas;
   for (const auto& i : close_from_matrix) {
     LOG(kInfo) << "[" << DebugId(own_node_id) << "] - "
                << "Replicating message to : " << HexSubstr(i.node_id.string())
                << " [ group_id : " << HexSubstr(group_id)  << "]" << " id: " << message.id();
-    message.set_destination_id(i.node_id.string());
     NodeInfo node;
-    if (routing_table_.GetNodeInfo(i.node_id, node)) {
-      network_.SendToDirect(message, node.node_id, node.connection_id);
+    if (routing_table_.GetNodeInfo(snapshot, i.node_id, node)) {
+      connected_replicas.push_back(node);
     } else {
+      message.set_destination_id(i.node_id.string());
       network_.SendToClosestNode(message);
     }
   }
+  network_.SendToDirectReplicas(message, connected_replicas);
 
   message.set_destination_id(routing_table_.kNodeId().string());
 
@@ -326,9 +343,11 @@ void MessageHandler::HandleGroupMessageAsClosestNode(protobuf::Message& message)
   }
 }
 
-void MessageHandler::HandleMessageAsFarNode(protobuf::Message& message) {
+void MessageHandler::HandleMessageAsFarNode(protobuf::Message& message,
+                                            const RoutingTable::Snapshot& snapshot) {
   if (message.has_visited() &&
-      routing_table_.IsThisNodeClosestTo(NodeId(message.destination_id()), !message.direct()) &&
+      routing_table_.IsThisNodeClosestTo(snapshot, NodeId(message.destination_id()),
+                                         !message.direct()) &&
       !message.direct() &&
       !message.visited())
     message.set_visited(true);
@@ -362,9 +381,12 @@ void MessageHandler::HandleMessage(protobuf::Message& message) {
   if (routing_table_.client_mode())
     return HandleClientMessage(message);
 
+  // Every routing decision below is made against this one version of the routing table.
+  RoutingTable::SnapshotPtr snapshot(routing_table_.GetSnapshot());
+
   // Relay mode message
   if (message.source_id().empty())
-    return HandleRelayRequest(message);
+    return HandleRelayRequest(message, *snapshot);
 
   // Invalid source id, unknown message
   if (NodeId(message.source_id()).IsZero()) {
@@ -385,13 +407,14 @@ void MessageHandler::HandleMessage(protobuf::Message& message) {
   }
 
   // This node is in closest proximity to this message
-  if (routing_table_.IsThisNodeInRange(NodeId(message.destination_id()),
+  if (routing_table_.IsThisNodeInRange(*snapshot, NodeId(message.destination_id()),
                                        Parameters::node_group_size) ||
-      (routing_table_.IsThisNodeClosestTo(NodeId(message.destination_id()), !message.direct()) &&
+      (routing_table_.IsThisNodeClosestTo(*snapshot, NodeId(message.destination_id()),
+                                          !message.direct()) &&
        message.visited())) {
-    return HandleMessageAsClosestNode(message);
+    return HandleMessageAsClosestNode(message, *snapshot);
   } else {
-    return HandleMessageAsFarNode(message);
+    return HandleMessageAsFarNode(message, *snapshot);
   }
 }
 
@@ -412,7 +435,8 @@ void MessageHandler::HandleMessageForNonRoutingNodes(protobuf::Message& message)
   return network_.SendToClosestNode(message);
 }
 
-void MessageHandler::HandleRelayRequest(protobuf::Message& message) {
+void MessageHandler::HandleRelayRequest(protobuf::Message& message,
+                                        const RoutingTable::Snapshot& snapshot) {
   assert(!message.has_source_id());
   if ((message.destination_id() == routing_table_.kNodeId().string()) && IsRequest(message)) {
     LOG(kVerbose) << "Relay request with this node's ID as destination ID"
@@ -428,11 +452,12 @@ void MessageHandler::HandleRelayRequest(protobuf::Message& message) {
   }
 
   // This node may be closest for group messages.
-  if (message.request() && routing_table_.IsThisNodeClosestTo(NodeId(message.destination_id()))) {
+  if (message.request() &&
+      routing_table_.IsThisNodeClosestTo(snapshot, NodeId(message.destination_id()))) {
     if (message.direct()) {
-      return HandleDirectRelayRequestMessageAsClosestNode(message);
+      return HandleDirectRelayRequestMessageAsClosestNode(message, snapshot);
     } else {
-      return HandleGroupRelayRequestMessageAsClosestNode(message);
+      return HandleGroupRelayRequestMessageAsClosestNode(message, snapshot);
     }
   }
 
@@ -441,13 +466,15 @@ void MessageHandler::HandleRelayRequest(protobuf::Message& message) {
   network_.SendToClosestNode(message);
 }
 
-void MessageHandler::HandleDirectRelayRequestMessageAsClosestNode(protobuf::Message& message) {
+void MessageHandler::HandleDirectRelayRequestMessageAsClosestNode(
+    protobuf::Message& message,
+    const RoutingTable::Snapshot& snapshot) {
   assert(message.direct());
   // Dropping direct messages if this node is closest and destination node is not in routing_table_
   // or client_routing_table_.
   NodeId destination_node_id(message.destination_id());
-  if (routing_table_.IsThisNodeClosestTo(destination_node_id)) {
-    if (routing_table_.Contains(destination_node_id) ||
+  if (routing_table_.IsThisNodeClosestTo(snapshot, destination_node_id)) {
+    if (routing_table_.Contains(snapshot, destination_node_id) ||
       client_routing_table_.Contains(destination_node_id)) {
       message.set_source_id(routing_table_.kNodeId().string());
       return network_.SendToClosestNode(message);
@@ -466,11 +493,14 @@ void MessageHandler::HandleDirectRelayRequestMessageAsClosestNode(protobuf::Mess
   }
 }
 
-void MessageHandler::HandleGroupRelayRequestMessageAsClosestNode(protobuf::Message& message) {
+void MessageHandler::HandleGroupRelayRequestMessageAsClosestNode(
+    protobuf::Message& message,
+    const RoutingTable::Snapshot& snapshot) {
   assert(!message.direct());
-  bool have_node_with_group_id(routing_table_.Contains(NodeId(message.destination_id())));
+  bool have_node_with_group_id(routing_table_.Contains(snapshot, NodeId(message.destination_id())));
   // This node is not closest to the destination node for non-direct message.
-  if (!routing_table_.IsThisNodeClosestTo(NodeId(message.destination_id()), !IsDirect(message)) &&
+  if (!routing_table_.IsThisNodeClosestTo(snapshot, NodeId(message.destination_id()),
+                                          !IsDirect(message)) &&
       !have_node_with_group_id) {
     LOG(kInfo) << "This node is not closest, passing it on." << " id: " << message.id();
     message.set_source_id(routing_table_.kNodeId().string());
@@ -479,8 +509,8 @@ void MessageHandler::HandleGroupRelayRequestMessageAsClosestNode(protobuf::Messa
 
   // Confirming from group matrix. If this node is closest to the target id or else passing on to
   // the connected peer which has the closer node.
-  NodeInfo closest_to_group_leader_node;
-  if (!routing_table_.IsThisNodeGroupLeader(NodeId(message.destination_id()),
+  NextHop closest_to_group_leader_node;
+  if (!routing_table_.IsThisNodeGroupLeader(snapshot, NodeId(message.destination_id()),
                                            closest_to_group_leader_node)) {
     assert(NodeId(message.destination_id()) != closest_to_group_leader_node.node_id);
     return network_.SendToDirect(message,
@@ -499,7 +529,8 @@ void MessageHandler::HandleGroupRelayRequestMessageAsClosestNode(protobuf::Messa
   message.set_direct(true);
   if (have_node_with_group_id)
     ++replication;
-  auto close(routing_table_.GetClosestNodes(NodeId(message.destination_id()), replication));
+  auto close(routing_table_.GetClosestNodes(snapshot, NodeId(message.destination_id()),
+                                            replication));
 
   if (have_node_with_group_id)
     close.erase(close.begin());
@@ -512,15 +543,15 @@ void MessageHandler::HandleGroupRelayRequestMessageAsClosestNode(protobuf::Messa
              << group_members;
   // This node relays back the responses
   message.set_source_id(routing_table_.kNodeId().string());
+  std::vector<NodeInfo> connected_replicas;
   for (const auto& i : close) {
     LOG(kInfo) << "Replicating message to : " << HexSubstr(i.string())
                << " [ group_id : " << HexSubstr(group_id)  << "]" << " id: " << message.id();
-    message.set_destination_id(i.string());
     NodeInfo node;
-    if (routing_table_.GetNodeInfo(i, node)) {
-      network_.SendToDirect(message, node.node_id, node.connection_id);
-    }
+    if (routing_table_.GetNodeInfo(snapshot, i, node))
+      connected_replicas.push_back(node);
   }
+  network_.SendToDirectReplicas(message, connected_replicas);
 
   message.set_destination_id(routing_table_.kNodeId().string());
   message.clear_source_id();
@@ -530,6 +561,20 @@ void MessageHandler::HandleGroupRelayRequestMessageAsClosestNode(protobuf::Messa
     HandleNodeLevelMessageForThisNode(message);
 }
 
+bool MessageHandler::IsDuplicateMultipathRequest(const protobuf::Message& message) {
+  if (!message.has_multipath_nonce())
+    return false;
+  std::lock_guard<std::mutex> lock(multipath_requests_mutex_);
+  if (!multipath_requests_.insert(message.multipath_nonce()).second)
+    return true;
+  multipath_requests_order_.push_back(message.multipath_nonce());
+  while (multipath_requests_order_.size() > Parameters::multipath_request_cache_size) {
+    multipath_requests_.erase(multipath_requests_order_.front());
+    multipath_requests_order_.pop_front();
+  }
+  return false;
+}
+
 // Special case when response of a relay comes through an alternative route.
 bool MessageHandler::IsRelayResponseForThisNode(protobuf::Message& message) {
   if (IsRoutingMessage(message) && message.has_relay_id() &&
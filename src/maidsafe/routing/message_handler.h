@@ -16,13 +16,17 @@ License.
 #ifndef MAIDSAFE_ROUTING_MESSAGE_HANDLER_H_
 #define MAIDSAFE_ROUTING_MESSAGE_HANDLER_H_
 
+#include <deque>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 
 #include "maidsafe/rudp/managed_connections.h"
 
 #include "maidsafe/routing/api_config.h"
 #include "maidsafe/routing/cache_manager.h"
 #include "maidsafe/routing/response_handler.h"
+#include "maidsafe/routing/routing_table.h"
 #include "maidsafe/routing/service.h"
 
 
@@ -39,12 +43,13 @@ namespace test {
   class MessageHandlerTest_BEH_HandleGroupMessage_Test;
   class MessageHandlerTest_BEH_HandleNodeLevelMessage_Test;
   class MessageHandlerTest_BEH_ClientRoutingTable_Test;
+  class MessageHandlerTest_BEH_ClosestNodesUpdateVersionGap_Test;
+  class MessageHandlerTest_BEH_ClosestNodesUpdateResync_Test;
 }
 
 
 class NetworkUtils;
 class ClientRoutingTable;
-class RoutingTable;
 class Timer;
 class RemoveFurthestNode;
 class GroupChangeHandler;
@@ -60,6 +65,8 @@ enum class MessageType : int32_t {
   kRemove = 6,
   kClosestNodesUpdate = 7,
   kGetGroup = 8,
+  kClosestNodesUpdateSubscribe = 9,
+  kClosestNodesUpdateResync = 10,
   kMaxRouting = 100,
   kNodeLevel = 101
 };
@@ -85,29 +92,40 @@ class MessageHandler {
   void HandleRoutingMessage(protobuf::Message& message);
   void HandleNodeLevelMessageForThisNode(protobuf::Message& message);
   void HandleMessageForThisNode(protobuf::Message& message);
-  void HandleMessageAsClosestNode(protobuf::Message& message);
-  void HandleDirectMessageAsClosestNode(protobuf::Message& message);
-  void HandleGroupMessageAsClosestNode(protobuf::Message& message);
-  void HandleMessageAsFarNode(protobuf::Message& message);
-  void HandleRelayRequest(protobuf::Message& message);
+  void HandleMessageAsClosestNode(protobuf::Message& message,
+                                  const RoutingTable::Snapshot& snapshot);
+  void HandleDirectMessageAsClosestNode(protobuf::Message& message,
+                                        const RoutingTable::Snapshot& snapshot);
+  void HandleGroupMessageAsClosestNode(protobuf::Message& message,
+                                       const RoutingTable::Snapshot& snapshot);
+  void HandleMessageAsFarNode(protobuf::Message& message,
+                              const RoutingTable::Snapshot& snapshot);
+  void HandleRelayRequest(protobuf::Message& message,
+                          const RoutingTable::Snapshot& snapshot);
   void HandleGroupMessageToSelfId(protobuf::Message& message);
   bool IsRelayResponseForThisNode(protobuf::Message& message);
   bool IsGroupMessageRequestToSelfId(protobuf::Message& message);
   bool RelayDirectMessageIfNeeded(protobuf::Message& message);
   void HandleClientMessage(protobuf::Message& message);
   void HandleMessageForNonRoutingNodes(protobuf::Message& message);
-  void HandleDirectRelayRequestMessageAsClosestNode(protobuf::Message& message);
-  void HandleGroupRelayRequestMessageAsClosestNode(protobuf::Message& message);
+  void HandleDirectRelayRequestMessageAsClosestNode(protobuf::Message& message,
+                                                    const RoutingTable::Snapshot& snapshot);
+  void HandleGroupRelayRequestMessageAsClosestNode(protobuf::Message& message,
+                                                   const RoutingTable::Snapshot& snapshot);
   void HandleCacheLookup(protobuf::Message& message);
   void StoreCacheCopy(const protobuf::Message& message);
   bool IsCacheableRequest(const protobuf::Message& message);
   bool IsCacheableResponse(const protobuf::Message& message);
+  // Returns true if a copy of this multipath request has already been handled.
+  bool IsDuplicateMultipathRequest(const protobuf::Message& message);
   friend class test::MessageHandlerTest;
   friend class test::MessageHandlerTest_BEH_HandleInvalidMessage_Test;
   friend class test::MessageHandlerTest_BEH_HandleRelay_Test;
   friend class test::MessageHandlerTest_BEH_HandleGroupMessage_Test;
   friend class test::MessageHandlerTest_BEH_HandleNodeLevelMessage_Test;
   friend class test::MessageHandlerTest_BEH_ClientRoutingTable_Test;
+  friend class test::MessageHandlerTest_BEH_ClosestNodesUpdateVersionGap_Test;
+  friend class test::MessageHandlerTest_BEH_ClosestNodesUpdateResync_Test;
 
   RoutingTable& routing_table_;
   ClientRoutingTable& client_routing_table_;
@@ -120,6 +138,11 @@ class MessageHandler {
   std::shared_ptr<ResponseHandler> response_handler_;
   std::shared_ptr<Service> service_;
   MessageReceivedFunctor message_received_functor_;
+  // Nonces of recent multipath requests, evicted oldest first.  Message IDs aren't used since
+  // they're only unique per sender, and the source ID is given by the sender.
+  std::mutex multipath_requests_mutex_;
+  std::unordered_set<uint64_t> multipath_requests_;
+  std::deque<uint64_t> multipath_requests_order_;
 };
 
 }  // namespace routing
@@ -15,7 +15,6 @@ License.
 
 #include "maidsafe/routing/network_statistics.h"
 
-#include <string>
 #include <algorithm>
 
 #include "maidsafe/routing/parameters.h"
@@ -28,7 +27,8 @@ NetworkStatistics::NetworkStatistics(const NodeId& node_id)
     :  mutex_(),
        kNodeId_(node_id),
        distance_(),
-       network_distance_data_() {}
+       network_distance_data_(),
+       round_trip_times_() {}
 
 void NetworkStatistics::UpdateLocalAverageDistance(std::vector<NodeId>& unique_nodes) {
   if (unique_nodes.size() < Parameters::node_group_size)
@@ -50,16 +50,13 @@ void NetworkStatistics::UpdateLocalAverageDistance(std::vector<NodeId>& unique_n
 void NetworkStatistics::UpdateNetworkAverageDistance(const NodeId& distance) {
   if (distance == NodeId())
     return;
-  crypto::BigInt distance_integer((distance.ToStringEncoded(NodeId::kHex) + 'h').c_str());
+  Distance distance_integer(distance);
   {
     std::lock_guard<std::mutex> lock(mutex_);
     network_distance_data_.total_distance += distance_integer;
-    auto average(network_distance_data_.total_distance /
-                 ++network_distance_data_.contributors_count);
-    std::string average_str(NodeId::kSize, '\0');
-    for (auto index(NodeId::kSize - 1); index >= 0; --index)
-      average_str[NodeId::kSize - 1 - index] = average.GetByte(index);
-    network_distance_data_.average_distance = NodeId(average_str);
+    network_distance_data_.average_distance =
+        (network_distance_data_.total_distance /
+         ++network_distance_data_.contributors_count).ToNodeId();
   }
 }
 
@@ -69,15 +66,44 @@ bool NetworkStatistics::EstimateInGroup(const NodeId& sender_id, const NodeId& i
     std::lock_guard<std::mutex> lock(mutex_);
     local_distance = distance_;
   }
-  return crypto::BigInt(((info_id ^ sender_id).ToStringEncoded(NodeId::kHex) + 'h').c_str()) <=
-      crypto::BigInt((local_distance.ToStringEncoded(NodeId::kHex) + 'h').c_str()) *
-      Parameters::accepted_distance_tolerance;
+  return Distance(info_id ^ sender_id) <=
+      Distance(local_distance) * Parameters::accepted_distance_tolerance;
 }
 
 NodeId NetworkStatistics::GetDistance() {
   return distance_;
 }
 
+bool NetworkStatistics::UpdateRoundTripTime(const NodeId& peer_id,
+                                            const boost::posix_time::time_duration& sample) {
+  if (sample.is_special() || sample.is_negative())
+    return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto result(round_trip_times_.insert(std::make_pair(peer_id, sample)));
+  if (result.second)
+    return true;
+  // Same weighting as TCP's smoothed RTT: seven eighths history, one eighth new sample.
+  boost::posix_time::time_duration& smoothed(result.first->second);
+  boost::posix_time::time_duration previous(smoothed);
+  smoothed = (smoothed * 7 + sample) / 8;
+  boost::posix_time::time_duration change(smoothed - previous);
+  if (change.is_negative())
+    change = change.invert_sign();
+  return change * 4 > previous;
+}
+
+boost::posix_time::time_duration NetworkStatistics::GetRoundTripTime(const NodeId& peer_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto itr(round_trip_times_.find(peer_id));
+  return itr == round_trip_times_.end() ? boost::posix_time::time_duration(
+                                              boost::posix_time::not_a_date_time) : itr->second;
+}
+
+void NetworkStatistics::RemoveRoundTripTime(const NodeId& peer_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  round_trip_times_.erase(peer_id);
+}
+
 }  // namespace routing
 
 }  // namespace maidsafe
@@ -16,11 +16,17 @@ License.
 #ifndef MAIDSAFE_ROUTING_NETWORK_STATISTICS_H_
 #define MAIDSAFE_ROUTING_NETWORK_STATISTICS_H_
 
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
-#include "maidsafe/common/crypto.h"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
 
 #include "maidsafe/common/node_id.h"
+
+#include "maidsafe/routing/distance.h"
+#include "maidsafe/routing/node_id_hash.h"
 #include "maidsafe/routing/node_info.h"
 
 
@@ -40,6 +46,12 @@ class NetworkStatistics {
   void UpdateNetworkAverageDistance(const NodeId& distance);
   bool EstimateInGroup(const NodeId& sender_id, const NodeId& info_id);
   NodeId GetDistance();
+  // Smoothed round trip time per peer, fed by rudp send completions and Ping responses.  Update
+  // returns true for a peer's first sample or when its estimate moves by more than a quarter.
+  // Get returns not_a_date_time for a peer with no samples yet.
+  bool UpdateRoundTripTime(const NodeId& peer_id, const boost::posix_time::time_duration& sample);
+  boost::posix_time::time_duration GetRoundTripTime(const NodeId& peer_id);
+  void RemoveRoundTripTime(const NodeId& peer_id);
 
   friend class test::NetworkStatisticsTest_BEH_AverageDistance_Test;
   friend class test::NetworkStatisticsTest_BEH_IsIdInGroupRange_Test;
@@ -49,13 +61,15 @@ class NetworkStatistics {
   NetworkStatistics& operator=(const NetworkStatistics&);
   struct NetworkDistanceData {
     NetworkDistanceData() : contributors_count(), total_distance(), average_distance() {}
-    crypto::BigInt contributors_count, total_distance;
+    uint32_t contributors_count;
+    Distance total_distance;
     NodeId average_distance;
   };
   std::mutex mutex_;
   const NodeId kNodeId_;
   NodeId distance_;
   NetworkDistanceData network_distance_data_;
+  std::unordered_map<NodeId, boost::posix_time::time_duration, NodeIdHash> round_trip_times_;
 };
 
 }  // namespace routing
@@ -15,7 +15,7 @@ License.
 
 #include "maidsafe/routing/network_utils.h"
 
-#include "boost/date_time/posix_time/posix_time_config.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
 
 #include "maidsafe/common/log.h"
 #include "maidsafe/common/utils.h"
@@ -27,6 +27,7 @@ License.
 #include "maidsafe/routing/return_codes.h"
 #include "maidsafe/routing/routing.pb.h"
 #include "maidsafe/routing/routing_table.h"
+#include "maidsafe/routing/rpcs.h"
 #include "maidsafe/routing/utils.h"
 
 namespace bptime = boost::posix_time;
@@ -43,6 +44,27 @@ typedef boost::unique_lock<boost::shared_mutex> UniqueLock;
 
 namespace routing {
 
+namespace {
+
+void AppendVarint(uint32_t value, std::string& output) {
+  while (value >= 0x80) {
+    output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  output.push_back(static_cast<char>(value));
+}
+
+// Appends the wire encoding of protobuf::Message's destination_id field (tag, length, bytes).
+void AppendDestinationIdField(const std::string& destination_id, std::string& output) {
+  const uint32_t kLengthDelimitedWireType(2);
+  AppendVarint((protobuf::Message::kDestinationIdFieldNumber << 3) | kLengthDelimitedWireType,
+               output);
+  AppendVarint(static_cast<uint32_t>(destination_id.size()), output);
+  output.append(destination_id);
+}
+
+}  // unnamed namespace
+
 NetworkUtils::NetworkUtils(RoutingTable& routing_table, ClientRoutingTable& client_routing_table)
     : running_(true),
       running_mutex_(),
@@ -54,11 +76,23 @@ NetworkUtils::NetworkUtils(RoutingTable& routing_table, ClientRoutingTable& clie
       client_routing_table_(client_routing_table),
       nat_type_(rudp::NatType::kUnknown),
       new_bootstrap_endpoint_(),
-      rudp_() {}
+      rudp_(),
+      peer_health_mutex_(),
+      peer_health_(),
+      outbound_queues_mutex_(),
+      outbound_queues_(),
+      timers_(),
+      timer_service_(1) {
+  timer_service_.Start();
+}
 
 NetworkUtils::~NetworkUtils() {
   std::lock_guard<std::mutex> lock(running_mutex_);
   running_ = false;
+  boost::system::error_code error_code;
+  for (const auto& timer : timers_)
+    timer->cancel(error_code);
+  timers_.clear();
 }
 
 int NetworkUtils::Bootstrap(const std::vector<Endpoint>& bootstrap_endpoints,
@@ -177,13 +211,63 @@ void NetworkUtils::RudpSend(const NodeId& peer_id,
     if (!running_)
       return;
   }
-  rudp_.Send(peer_id, message.SerializeAsString(), message_sent_functor);
+  RudpSend(peer_id, message.SerializeAsString(), message.routing_message(),
+           message_sent_functor);
   LOG(kVerbose) << "  [" << DebugId(routing_table_.kNodeId())
              << "] send : " << MessageTypeString(message)
              << " to   " << DebugId(peer_id) << "   (id: " << message.id() << ")"
              << " --To Rudp--";
 }
 
+void NetworkUtils::RudpSend(const NodeId& peer_id,
+                            const std::string& serialised_message,
+                            bool routing_message,
+                            const rudp::MessageSentFunctor& message_sent_functor) {
+  if (routing_message &&
+      Parameters::send_coalescing_window > bptime::time_duration() &&
+      serialised_message.size() <= Parameters::max_coalesced_message_size) {
+    QueueForPeer(peer_id, serialised_message, message_sent_functor);
+  } else {
+    // Keeps this message behind any smaller ones already queued for the same connection.
+    FlushOutboundQueue(peer_id);
+    HandToRudp(peer_id, serialised_message, message_sent_functor);
+  }
+}
+
+void NetworkUtils::HandToRudp(const NodeId& peer_connection_id,
+                              const std::string& serialised_message,
+                              const rudp::MessageSentFunctor& message_sent_functor) {
+  const bptime::ptime kHandOffTime(bptime::microsec_clock::universal_time());
+  rudp_.Send(peer_connection_id, serialised_message, [=](int message_sent) {
+      NodeInfo peer;
+      if (rudp::kSuccess == message_sent &&
+          routing_table_.GetNodeInfoForConnection(peer_connection_id, peer)) {
+        routing_table_.UpdateRoundTripTime(peer.node_id,
+                                           bptime::microsec_clock::universal_time() - kHandOffTime);
+      }
+      if (message_sent_functor)
+        message_sent_functor(message_sent);
+    });
+}
+
+rudp::MessageSentFunctor NetworkUtils::MakeMessageSentFunctor(const protobuf::Message& message,
+                                                              const NodeId& peer_node_id) {
+  const std::string kThisId(routing_table_.kNodeId().string());
+  // Only what is logged is captured, so the payload isn't copied into the functor.
+  const std::string kMessageType(MessageTypeString(message));
+  const int32_t kMessageId(message.id());
+  return [=](int message_sent) {
+      if (rudp::kSuccess == message_sent) {
+        LOG(kVerbose) << "  [" << HexSubstr(kThisId) << "] sent : " << kMessageType
+                      << " to   " << DebugId(peer_node_id) << "   (id: " << kMessageId << ")";
+      } else {
+        LOG(kError) << "Sending type " << kMessageType << " message from "
+                    << HexSubstr(kThisId) << " to " << DebugId(peer_node_id) << " failed with code "
+                    << message_sent << " id: " << kMessageId;
+      }
+    };
+}
+
 void NetworkUtils::SendToDirect(const protobuf::Message& message,
                                 const NodeId& peer_connection_id,
                                 const rudp::MessageSentFunctor& message_sent_functor) {
@@ -196,6 +280,36 @@ void NetworkUtils::SendToDirect(const protobuf::Message& message,
   SendTo(message, peer_node_id, peer_connection_id);
 }
 
+void NetworkUtils::SendToDirectReplicas(protobuf::Message& message,
+                                        const std::vector<NodeInfo>& peers) {
+  if (peers.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(running_mutex_);
+    if (!running_)
+      return;
+  }
+  // Protobuf parsers accept fields in any order, so the per-replica destination ID can be encoded
+  // on its own and prepended to the shared body.
+  const std::string kOriginalDestinationId(message.destination_id());
+  message.clear_destination_id();
+  const std::string kSharedBody(message.SerializeAsString());
+  message.set_destination_id(kOriginalDestinationId);
+
+  std::string serialised_message;
+  for (const auto& peer : peers) {
+    serialised_message.clear();
+    serialised_message.reserve(peer.node_id.string().size() + kSharedBody.size() + 8);
+    AppendDestinationIdField(peer.node_id.string(), serialised_message);
+    serialised_message.append(kSharedBody);
+    RudpSend(peer.connection_id, serialised_message, message.routing_message(),
+             MakeMessageSentFunctor(message, peer.node_id));
+    LOG(kVerbose) << "  [" << DebugId(routing_table_.kNodeId()) << "] send : "
+                  << MessageTypeString(message) << " to   " << DebugId(peer.connection_id)
+                  << "   (id: " << message.id() << ")" << " --To Rudp-- (replica)";
+  }
+}
+
 void NetworkUtils::SendToDirectAdjustedRoute(protobuf::Message& message,
                                             const NodeId& peer_node_id,
                                             const NodeId& peer_connection_id) {
@@ -229,7 +343,7 @@ void NetworkUtils::SendToClosestNode(const protobuf::Message& message) {
         SendTo(message, i.node_id, i.connection_id);
       }
     } else if (routing_table_.size() > 0) {  // getting closer nodes from routing table
-      RecursiveSendOn(message);
+      RecursiveSendOn(std::make_shared<protobuf::Message>(message));
     } else {
       LOG(kError) << " No endpoint to send to; aborting send.  Attempt to send a type "
                   << MessageTypeString(message) << " message to " << HexSubstr(message.source_id())
@@ -254,26 +368,74 @@ void NetworkUtils::SendToClosestNode(const protobuf::Message& message) {
   }
 }
 
+void NetworkUtils::SendToDisjointNextHops(const protobuf::Message& message,
+                                          uint16_t path_count) {
+  const NodeId kDestinationId(message.destination_id());
+  if (!client_routing_table_.GetNodesInfo(kDestinationId).empty())
+    return SendToClosestNode(message);
+
+  std::string exclude(PeersWithOpenCircuit());
+  std::vector<NextHop> next_hops;
+  while (next_hops.size() < path_count) {
+    NextHop peer(routing_table_.GetNodeForSendingMessage(kDestinationId, exclude));
+    if (peer.node_id == NodeId() || peer.node_id == kDestinationId)
+      break;
+    next_hops.push_back(peer);
+    exclude.append(peer.node_id.string());
+  }
+  if (next_hops.size() < 2)
+    return SendToClosestNode(message);
+
+  protobuf::Message path_message(message);
+  AdjustRouteHistory(path_message);
+  for (const auto& next_hop : next_hops) {
+    LOG(kVerbose) << "[" << DebugId(routing_table_.kNodeId()) << "] multipath send to "
+                  << DebugId(kDestinationId) << " via " << DebugId(next_hop.node_id)
+                  << " id: " << message.id();
+    SendTo(path_message, next_hop.node_id, next_hop.connection_id);
+  }
+}
+
+void NetworkUtils::SendPing(const NodeId& peer_node_id, const NodeId& peer_connection_id) {
+  protobuf::Message message(rpcs::Ping(peer_node_id, routing_table_.kNodeId().string()));
+  const bptime::ptime kNow(bptime::microsec_clock::universal_time());
+  {
+    std::lock_guard<std::mutex> lock(pending_pings_mutex_);
+    // Pings still unanswered after the response timeout are forgotten.
+    for (auto itr(pending_pings_.begin()); itr != pending_pings_.end();) {
+      if (kNow - itr->second.send_time > Parameters::default_response_timeout)
+        itr = pending_pings_.erase(itr);
+      else
+        ++itr;
+    }
+    pending_pings_[message.id()] = PendingPing(peer_node_id, kNow);
+  }
+  SendTo(message, peer_node_id, peer_connection_id);
+  // The ping isn't left waiting for the coalescing window, so it reaches rudp at kNow.
+  FlushOutboundQueue(peer_connection_id);
+}
+
+bool NetworkUtils::PingResponseReceived(int32_t message_id,
+                                        const NodeId& peer_node_id,
+                                        bptime::time_duration& round_trip_time) {
+  std::lock_guard<std::mutex> lock(pending_pings_mutex_);
+  auto itr(pending_pings_.find(message_id));
+  if (itr == pending_pings_.end() || itr->second.peer_id != peer_node_id)
+    return false;
+  round_trip_time = bptime::microsec_clock::universal_time() - itr->second.send_time;
+  pending_pings_.erase(itr);
+  return true;
+}
+
 void NetworkUtils::SendTo(const protobuf::Message& message,
                           const NodeId& peer_node_id,
                           const NodeId& peer_connection_id) {
-  const std::string kThisId(routing_table_.kNodeId().string());
-  rudp::MessageSentFunctor message_sent_functor = [=](int message_sent) {
-      if (rudp::kSuccess == message_sent) {
-        LOG(kVerbose) << "  [" << HexSubstr(kThisId) << "] sent : " << MessageTypeString(message)
-                      << " to   " << DebugId(peer_node_id) << "   (id: " << message.id() << ")";
-      } else {
-        LOG(kError) << "Sending type " << MessageTypeString(message) << " message from "
-                    << HexSubstr(kThisId) << " to " << DebugId(peer_node_id) << " failed with code "
-                    << message_sent << " id: " << message.id();
-      }
-    };
   LOG(kVerbose) << " >>>>>>>>> rudp send message to connection id " << DebugId(peer_connection_id);
-  RudpSend(peer_connection_id, message, message_sent_functor);
+  RudpSend(peer_connection_id, message, MakeMessageSentFunctor(message, peer_node_id));
 }
 
-void NetworkUtils::RecursiveSendOn(protobuf::Message message,
-                                   NodeInfo last_node_attempted,
+void NetworkUtils::RecursiveSendOn(std::shared_ptr<protobuf::Message> message,
+                                   NextHop last_node_attempted,
                                    int attempt_count) {
   {
     std::lock_guard<std::mutex> lock(running_mutex_);
@@ -284,7 +446,7 @@ void NetworkUtils::RecursiveSendOn(protobuf::Message message,
     LOG(kWarning) << " Retry attempts failed to send to ["
                   << HexSubstr(last_node_attempted.node_id.string())
                   << "] will drop this node now and try with another node."
-                  << " id: " << message.id();
+                  << " id: " << message->id();
     attempt_count = 0;
     {
       std::lock_guard<std::mutex> lock(running_mutex_);
@@ -298,39 +460,39 @@ void NetworkUtils::RecursiveSendOn(protobuf::Message message,
     }
   }
 
-  if (attempt_count > 0)
-    Sleep(bptime::milliseconds(50));
-
   const std::string kThisId(routing_table_.kNodeId().string());
-  bool ignore_exact_match(!IsDirect(message));
-  std::vector<std::string> route_history;
-  NodeInfo peer;
+  bool ignore_exact_match(!IsDirect(*message));
+  std::string excluded_peers(PeersWithOpenCircuit());
+  NextHop peer;
   {
     std::lock_guard<std::mutex> lock(running_mutex_);
     if (!running_)
       return;
-    if (message.route_history().size() > 1)
-      route_history = std::vector<std::string>(message.route_history().begin(),
-                                               message.route_history().end() -
-                                               static_cast<size_t>(!(message.has_visited() &&
-                                                                     message.visited())));
-    else if ((message.route_history().size() == 1) &&
-             (message.route_history(0) != routing_table_.kNodeId().string()))
-      route_history.push_back(message.route_history(0));
-
-    peer = routing_table_.GetNodeForSendingMessage(NodeId(message.destination_id()),
-                                                   route_history,
-                                                   ignore_exact_match);
-    if (peer.node_id == NodeId() && routing_table_.size() != 0) {
-      peer = routing_table_.GetNodeForSendingMessage(NodeId(message.destination_id()),
-                                                     std::vector<std::string>(),
+    const std::string kRouteHistory(RouteHistoryExclusions(
+        *message, routing_table_.kNodeId(), message->has_visited() && message->visited()));
+
+    // Peers with an open circuit are only used if no other next hop is available.  All of the
+    // fallbacks are looked up in the same version of the routing table.
+    RoutingTable::SnapshotPtr snapshot(routing_table_.GetSnapshot());
+    const NodeId kDestinationId(message->destination_id());
+    if (!excluded_peers.empty()) {
+      excluded_peers.append(kRouteHistory);
+      peer = routing_table_.GetNodeForSendingMessage(*snapshot, kDestinationId, excluded_peers,
+                                                     ignore_exact_match);
+    }
+    if (peer.node_id == NodeId()) {
+      peer = routing_table_.GetNodeForSendingMessage(*snapshot, kDestinationId, kRouteHistory,
+                                                     ignore_exact_match);
+    }
+    if (peer.node_id == NodeId() && !snapshot->nodes.empty()) {
+      peer = routing_table_.GetNodeForSendingMessage(*snapshot, kDestinationId, std::string(),
                                                      ignore_exact_match);
     }
     if (peer.node_id == NodeId()) {
       LOG(kError) << "This node's routing table is empty now.  Need to re-bootstrap.";
       return;
     }
-    AdjustRouteHistory(message);
+    AdjustRouteHistory(*message);
   }
 
   rudp::MessageSentFunctor message_sent_functor = [=](int message_sent) {
@@ -340,26 +502,28 @@ void NetworkUtils::RecursiveSendOn(protobuf::Message message,
           return;
       }
       if (rudp::kSuccess == message_sent) {
+        RecordSendResult(peer.node_id, true);
         LOG(kVerbose) << "  [" << HexSubstr(kThisId) << "] sent : "
-                      << MessageTypeString(message) << " to   "
+                      << MessageTypeString(*message) << " to   "
                       << HexSubstr(peer.node_id.string())
-                      << "   (id: " << message.id() << ")"
-                      << " dst : " << HexSubstr(message.destination_id());
+                      << "   (id: " << message->id() << ")"
+                      << " dst : " << HexSubstr(message->destination_id());
       } else if (rudp::kSendFailure == message_sent) {
-        LOG(kError) << "Sending type " << MessageTypeString(message)
+        LOG(kError) << "Sending type " << MessageTypeString(*message)
                     << " message from " << HexSubstr(routing_table_.kNodeId().string())
                     << " to " << HexSubstr(peer.node_id.string())
-                    << " with destination ID " << HexSubstr(message.destination_id())
+                    << " with destination ID " << HexSubstr(message->destination_id())
                     << " failed with code " << message_sent
                     << ".  Will retry to Send.  Attempt count = " << attempt_count + 1
-                    << " id: " << message.id();
-        RecursiveSendOn(message, peer, attempt_count + 1);
+                    << " id: " << message->id();
+        RecordSendResult(peer.node_id, false);
+        ScheduleRecursiveSendOn(message, peer, attempt_count + 1);
       } else {
-        LOG(kError) << "Sending type " << MessageTypeString(message) << " message from "
+        LOG(kError) << "Sending type " << MessageTypeString(*message) << " message from "
                     << HexSubstr(kThisId) << " to " << HexSubstr(peer.node_id.string())
-                    << " with destination ID " << HexSubstr(message.destination_id())
+                    << " with destination ID " << HexSubstr(message->destination_id())
                     << " failed with code " << message_sent << "  Will remove node."
-                    << " message id: " << message.id();
+                    << " message id: " << message->id();
         {
           std::lock_guard<std::mutex> lock(running_mutex_);
           if (!running_)
@@ -367,31 +531,196 @@ void NetworkUtils::RecursiveSendOn(protobuf::Message message,
           rudp_.Remove(last_node_attempted.connection_id);
         }
         LOG(kWarning) << " Routing-> removing connection " << DebugId(peer.connection_id);
+        {
+          std::lock_guard<std::mutex> lock(peer_health_mutex_);
+          peer_health_.erase(peer.node_id);
+        }
         routing_table_.DropNode(peer.node_id, false);
         client_routing_table_.DropConnection(peer.connection_id);
         RecursiveSendOn(message);
       }
   };
   LOG(kVerbose) << "Rudp recursive send message to " << DebugId(peer.connection_id);
-  RudpSend(peer.connection_id, message, message_sent_functor);
+  RudpSend(peer.connection_id, *message, message_sent_functor);
 }
 
-void NetworkUtils::AdjustRouteHistory(protobuf::Message& message) {
-  assert(message.route_history().size() <= Parameters::max_routing_table_size);
-  if (std::find(message.route_history().begin(), message.route_history().end(),
-                routing_table_.kNodeId().string()) == message.route_history().end()) {
-    message.add_route_history(routing_table_.kNodeId().string());
-    if (message.route_history().size() > Parameters::max_route_history) {
-      std::vector<std::string> route_history(message.route_history().begin() + 1,
-                                             message.route_history().end());
-      message.clear_route_history();
-      for (const auto& route : route_history) {
-        if (!NodeId(route).IsZero())
-          message.add_route_history(route);
+void NetworkUtils::QueueForPeer(const NodeId& peer_id,
+                                const std::string& serialised_message,
+                                const rudp::MessageSentFunctor& message_sent_functor) {
+  OutboundQueue full_queue;
+  std::shared_ptr<boost::asio::deadline_timer> flush_timer;
+  {
+    std::lock_guard<std::mutex> lock(outbound_queues_mutex_);
+    OutboundQueue& queue(outbound_queues_[peer_id]);
+    if (!queue.messages.empty() &&
+        queue.size + serialised_message.size() > Parameters::max_coalesced_batch_size) {
+      full_queue = queue;
+      queue = OutboundQueue();
+    }
+    queue.messages.push_back(serialised_message);
+    queue.message_sent_functors.push_back(message_sent_functor);
+    queue.size += serialised_message.size();
+    if (!queue.flush_timer) {
+      queue.flush_timer = std::make_shared<boost::asio::deadline_timer>(
+          timer_service_.service(), Parameters::send_coalescing_window);
+      flush_timer = queue.flush_timer;
+    }
+  }
+
+  if (full_queue.flush_timer) {
+    boost::system::error_code error_code;
+    full_queue.flush_timer->cancel(error_code);
+  }
+  SendOutboundQueue(peer_id, full_queue);
+
+  if (!flush_timer)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(running_mutex_);
+    if (!running_)
+      return;
+    timers_.insert(flush_timer);
+  }
+  flush_timer->async_wait([=](const boost::system::error_code& error_code) {
+      {
+        std::lock_guard<std::mutex> lock(running_mutex_);
+        if (!running_)
+          return;
+        timers_.erase(flush_timer);
       }
+      if (error_code != boost::asio::error::operation_aborted)
+        FlushOutboundQueue(peer_id, flush_timer);
+    });
+}
+
+void NetworkUtils::FlushOutboundQueue(const NodeId& peer_id,
+                                      std::shared_ptr<boost::asio::deadline_timer> flush_timer) {
+  OutboundQueue queue;
+  {
+    std::lock_guard<std::mutex> lock(outbound_queues_mutex_);
+    auto itr(outbound_queues_.find(peer_id));
+    if (itr == outbound_queues_.end() || (flush_timer && itr->second.flush_timer != flush_timer))
+      return;
+    queue = itr->second;
+    outbound_queues_.erase(itr);
+  }
+  if (!flush_timer && queue.flush_timer) {
+    boost::system::error_code error_code;
+    queue.flush_timer->cancel(error_code);
+  }
+  SendOutboundQueue(peer_id, queue);
+}
+
+void NetworkUtils::SendOutboundQueue(const NodeId& peer_id, const OutboundQueue& queue) {
+  if (queue.messages.empty())
+    return;
+  if (queue.messages.size() == 1) {
+    HandToRudp(peer_id, queue.messages.front(), queue.message_sent_functors.front());
+    return;
+  }
+
+  protobuf::MessageBatch batch;
+  for (const auto& message : queue.messages)
+    batch.add_messages(message);
+  std::vector<rudp::MessageSentFunctor> message_sent_functors(queue.message_sent_functors);
+  LOG(kVerbose) << "  [" << DebugId(routing_table_.kNodeId()) << "] sending batch of "
+                << queue.messages.size() << " messages to " << DebugId(peer_id);
+  HandToRudp(peer_id, batch.SerializeAsString(), [message_sent_functors](int message_sent) {
+      for (const auto& message_sent_functor : message_sent_functors) {
+        if (message_sent_functor)
+          message_sent_functor(message_sent);
+      }
+    });
+}
+
+void NetworkUtils::ScheduleRecursiveSendOn(std::shared_ptr<protobuf::Message> message,
+                                           const NextHop& last_node_attempted,
+                                           int attempt_count) {
+  ScheduleTask(RecursiveSendRetryDelay(attempt_count),
+               [=] { RecursiveSendOn(message, last_node_attempted, attempt_count); });
+}
+
+bptime::time_duration NetworkUtils::RecursiveSendRetryDelay(int attempt_count) {
+  bptime::time_duration delay(Parameters::recursive_send_retry_delay);
+  for (int attempt(1); attempt < attempt_count &&
+                       delay < Parameters::max_recursive_send_retry_delay; ++attempt) {
+    delay *= 2;
+  }
+  if (delay > Parameters::max_recursive_send_retry_delay)
+    delay = Parameters::max_recursive_send_retry_delay;
+  return delay;
+}
+
+void NetworkUtils::ScheduleTask(const bptime::time_duration& delay,
+                                const std::function<void()>& task) {
+  std::shared_ptr<boost::asio::deadline_timer> timer(
+      std::make_shared<boost::asio::deadline_timer>(timer_service_.service(), delay));
+  {
+    std::lock_guard<std::mutex> lock(running_mutex_);
+    if (!running_)
+      return;
+    timers_.insert(timer);
+  }
+  timer->async_wait([=](const boost::system::error_code& error_code) {
+      {
+        std::lock_guard<std::mutex> lock(running_mutex_);
+        if (!running_)
+          return;
+        timers_.erase(timer);
+      }
+      if (error_code != boost::asio::error::operation_aborted)
+        task();
+    });
+}
+
+void NetworkUtils::RecordSendResult(const NodeId& peer_id, bool succeeded) {
+  std::lock_guard<std::mutex> lock(peer_health_mutex_);
+  auto itr(peer_health_.find(peer_id));
+  if (succeeded) {
+    if (itr == peer_health_.end())
+      return;
+    // A successful send once the open period has passed closes the circuit again.
+    if (!itr->second.open_until.is_not_a_date_time() &&
+        bptime::microsec_clock::universal_time() >= itr->second.open_until) {
+      peer_health_.erase(itr);
+      return;
     }
+  } else if (itr == peer_health_.end()) {
+    itr = peer_health_.insert(std::make_pair(peer_id, PeerSendHealth())).first;
   }
-  assert(message.route_history().size() <= Parameters::max_routing_table_size);
+  PeerSendHealth& health(itr->second);
+  // Halving keeps the counts weighted towards recent sends.
+  if (health.sends >= 4 * Parameters::circuit_breaker_failure_threshold) {
+    health.sends /= 2;
+    health.failures /= 2;
+  }
+  ++health.sends;
+  if (succeeded)
+    return;
+  ++health.failures;
+  if (health.failures >= Parameters::circuit_breaker_failure_threshold &&
+      2 * health.failures >= health.sends) {
+    health.open_until = bptime::microsec_clock::universal_time() +
+                        Parameters::circuit_breaker_open_period;
+    LOG(kWarning) << "[" << DebugId(routing_table_.kNodeId()) << "] circuit opened for "
+                  << DebugId(peer_id) << " after " << health.failures << " failures in "
+                  << health.sends << " sends.";
+  }
+}
+
+std::string NetworkUtils::PeersWithOpenCircuit() {
+  std::string open_peers;
+  const bptime::ptime kNow(bptime::microsec_clock::universal_time());
+  std::lock_guard<std::mutex> lock(peer_health_mutex_);
+  for (const auto& health : peer_health_) {
+    if (!health.second.open_until.is_not_a_date_time() && kNow < health.second.open_until)
+      open_peers.append(health.first.string());
+  }
+  return open_peers;
+}
+
+void NetworkUtils::AdjustRouteHistory(protobuf::Message& message) {
+  AddToRouteHistory(message, routing_table_.kNodeId());
 }
 
 void NetworkUtils::set_new_bootstrap_endpoint_functor(
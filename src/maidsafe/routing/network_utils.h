@@ -16,16 +16,26 @@ License.
 #ifndef MAIDSAFE_ROUTING_NETWORK_UTILS_H_
 #define MAIDSAFE_ROUTING_NETWORK_UTILS_H_
 
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "boost/asio/deadline_timer.hpp"
 #include "boost/asio/ip/udp.hpp"
+#include "boost/date_time/posix_time/ptime.hpp"
 
+#include "maidsafe/common/asio_service.h"
 #include "maidsafe/common/node_id.h"
 #include "maidsafe/rudp/managed_connections.h"
 
 #include "maidsafe/routing/api_config.h"
+#include "maidsafe/routing/next_hop.h"
+#include "maidsafe/routing/node_id_hash.h"
 #include "maidsafe/routing/node_info.h"
 #include "maidsafe/routing/timer.h"
 
@@ -42,6 +52,12 @@ class RoutingTable;
 namespace test {
   class GenericNode;
   class MockNetworkUtils;
+  class NetworkUtilsTest_BEH_RecursiveSendRetryDelay_Test;
+  class NetworkUtilsTest_BEH_CircuitBreaker_Test;
+  class NetworkUtilsTest_BEH_ScheduledTasksCancelledOnDestruction_Test;
+  class NetworkUtilsTest_BEH_OutboundQueueFlush_Test;
+  class NetworkUtilsTest_FUNC_OutboundQueueSendBatch_Test;
+  class NetworkUtilsTest_BEH_PingRoundTripTime_Test;
 }
 
 class NetworkUtils {
@@ -69,12 +85,29 @@ class NetworkUtils {
   virtual void SendToDirect(const protobuf::Message& message,
                             const NodeId& peer_node_id,
                             const NodeId& peer_connection_id);
+  // Sends a copy of |message| to each of |peers| with the destination ID set to that peer's ID.
+  // All fields other than the destination ID are serialised once and shared between the sends.
+  virtual void SendToDirectReplicas(protobuf::Message& message, const std::vector<NodeInfo>& peers);
   void SendToDirectAdjustedRoute(protobuf::Message& message,
                                  const NodeId& peer_node_id,
                                  const NodeId& peer_connection_id);
   // Handles relay response messages.  Also leave destination ID empty if needs to send as a relay
   // response message
   virtual void SendToClosestNode(const protobuf::Message& message);
+  // Sends a copy of |message| to each of up to |path_count| different next hops towards its
+  // destination.  Falls back to SendToClosestNode if the destination is directly connected or
+  // fewer than two next hops are available.
+  void SendToDisjointNextHops(const protobuf::Message& message, uint16_t path_count);
+  // Sends a Ping to the peer, remembering locally when it was handed to rudp.
+  void SendPing(const NodeId& peer_node_id, const NodeId& peer_connection_id);
+  // Returns false unless |message_id| is an outstanding ping to |peer_node_id|, in which case
+  // |round_trip_time| is set to the time since it was sent.
+  bool PingResponseReceived(int32_t message_id,
+                            const NodeId& peer_node_id,
+                            boost::posix_time::time_duration& round_trip_time);
+  // Runs |task| on timer_service_ after |delay|, unless this object is destroyed first.
+  void ScheduleTask(const boost::posix_time::time_duration& delay,
+                    const std::function<void()>& task);
   void AddToBootstrapFile(const boost::asio::ip::udp::endpoint& endpoint);
   void clear_bootstrap_connection_info();
   void set_new_bootstrap_endpoint_functor(NewBootstrapEndpointFunctor new_bootstrap_endpoint);
@@ -84,21 +117,88 @@ class NetworkUtils {
 
   friend class test::GenericNode;
   friend class test::MockNetworkUtils;
+  friend class test::NetworkUtilsTest_BEH_RecursiveSendRetryDelay_Test;
+  friend class test::NetworkUtilsTest_BEH_CircuitBreaker_Test;
+  friend class test::NetworkUtilsTest_BEH_ScheduledTasksCancelledOnDestruction_Test;
+  friend class test::NetworkUtilsTest_BEH_OutboundQueueFlush_Test;
+  friend class test::NetworkUtilsTest_FUNC_OutboundQueueSendBatch_Test;
+  friend class test::NetworkUtilsTest_BEH_PingRoundTripTime_Test;
 
  private:
   NetworkUtils(const NetworkUtils&);
   NetworkUtils(const NetworkUtils&&);
   NetworkUtils& operator=(const NetworkUtils&);
 
+  // A Ping sent by SendPing and not yet answered.
+  struct PendingPing {
+    PendingPing() : peer_id(), send_time() {}
+    PendingPing(const NodeId& peer_id_in, const boost::posix_time::ptime& send_time_in)
+        : peer_id(peer_id_in),
+          send_time(send_time_in) {}
+    NodeId peer_id;
+    boost::posix_time::ptime send_time;
+  };
+
+  // Recent send outcomes for one next hop.  While |open_until| is in the future the peer's circuit
+  // is open and it is not picked for RecursiveSendOn.
+  struct PeerSendHealth {
+    PeerSendHealth() : sends(0), failures(0), open_until() {}
+    uint16_t sends, failures;
+    boost::posix_time::ptime open_until;
+  };
+
   void RudpSend(const NodeId& peer_id,
                 const protobuf::Message& message,
                 const rudp::MessageSentFunctor& message_sent_functor);
+  // Sends an already serialised message, coalescing it with others for the same connection if it
+  // is a small enough routing message.
+  void RudpSend(const NodeId& peer_id,
+                const std::string& serialised_message,
+                bool routing_message,
+                const rudp::MessageSentFunctor& message_sent_functor);
+  // Passes |serialised_message| to rudp.  A successful send samples the round trip time of the
+  // routing table peer using |peer_connection_id|, timed from here rather than from when the
+  // message was queued.
+  void HandToRudp(const NodeId& peer_connection_id,
+                  const std::string& serialised_message,
+                  const rudp::MessageSentFunctor& message_sent_functor);
+  // Logs the outcome of sending |message| to |peer_node_id|.
+  rudp::MessageSentFunctor MakeMessageSentFunctor(const protobuf::Message& message,
+                                                  const NodeId& peer_node_id);
   void SendTo(const protobuf::Message& message,
               const NodeId& peer_node_id,
               const NodeId& peer_connection_id);
-  void RecursiveSendOn(protobuf::Message message,
-                       NodeInfo last_node_attempted = NodeInfo(),
+  // |message| is shared by every attempt and retry, rather than copied for each of them.
+  void RecursiveSendOn(std::shared_ptr<protobuf::Message> message,
+                       NextHop last_node_attempted = NextHop(),
                        int attempt_count = 0);
+  // Small routing messages waiting to be sent to one connection as a single MessageBatch.
+  struct OutboundQueue {
+    OutboundQueue() : messages(), message_sent_functors(), size(0), flush_timer() {}
+    std::vector<std::string> messages;
+    std::vector<rudp::MessageSentFunctor> message_sent_functors;
+    size_t size;
+    std::shared_ptr<boost::asio::deadline_timer> flush_timer;
+  };
+
+  void QueueForPeer(const NodeId& peer_id,
+                    const std::string& serialised_message,
+                    const rudp::MessageSentFunctor& message_sent_functor);
+  // Sends whatever is queued for |peer_id|.  If |flush_timer| is given, only does so while it is
+  // still the queue's timer.
+  void FlushOutboundQueue(const NodeId& peer_id,
+                          std::shared_ptr<boost::asio::deadline_timer> flush_timer = nullptr);
+  void SendOutboundQueue(const NodeId& peer_id, const OutboundQueue& queue);
+  // Parameters::recursive_send_retry_delay, doubled for each attempt after the first up to
+  // Parameters::max_recursive_send_retry_delay.
+  static boost::posix_time::time_duration RecursiveSendRetryDelay(int attempt_count);
+  // Retries RecursiveSendOn from a timer on timer_service_ rather than blocking the caller.
+  void ScheduleRecursiveSendOn(std::shared_ptr<protobuf::Message> message,
+                               const NextHop& last_node_attempted,
+                               int attempt_count);
+  void RecordSendResult(const NodeId& peer_id, bool succeeded);
+  // Returns the IDs packed as for PackNodeIds.
+  std::string PeersWithOpenCircuit();
   void AdjustRouteHistory(protobuf::Message& message);
 
   bool running_;
@@ -112,6 +212,15 @@ class NetworkUtils {
   rudp::NatType nat_type_;
   NewBootstrapEndpointFunctor new_bootstrap_endpoint_;
   rudp::ManagedConnections rudp_;
+  std::mutex peer_health_mutex_;
+  std::unordered_map<NodeId, PeerSendHealth, NodeIdHash> peer_health_;
+  std::mutex pending_pings_mutex_;
+  std::map<int32_t, PendingPing> pending_pings_;
+  std::mutex outbound_queues_mutex_;
+  std::unordered_map<NodeId, OutboundQueue, NodeIdHash> outbound_queues_;
+  // Pending retry, flush and scheduled task timers, cancelled on destruction.
+  std::set<std::shared_ptr<boost::asio::deadline_timer>> timers_;
+  AsioService timer_service_;
 };
 
 }  // namespace routing
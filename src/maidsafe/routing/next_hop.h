@@ -0,0 +1,62 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+
+#ifndef MAIDSAFE_ROUTING_NEXT_HOP_H_
+#define MAIDSAFE_ROUTING_NEXT_HOP_H_
+
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/node_id.h"
+
+
+namespace maidsafe {
+
+namespace routing {
+
+// The parts of a peer's NodeInfo needed to forward a message to it.
+struct NextHop {
+  NextHop() : node_id(), connection_id() {}
+  NextHop(const NodeId& node_id_in, const NodeId& connection_id_in)
+      : node_id(node_id_in),
+        connection_id(connection_id_in) {}
+  NodeId node_id, connection_id;
+};
+
+// Peers excluded from a next-hop choice are passed as node IDs packed end to end, the layout of
+// Message::route_history_ring, so a message's route history can be checked without unpacking it.
+inline std::string PackNodeIds(const std::vector<std::string>& node_ids) {
+  std::string packed_ids;
+  for (const auto& node_id : node_ids) {
+    if (node_id.size() == NodeId::kSize)
+      packed_ids.append(node_id);
+  }
+  return packed_ids;
+}
+
+inline bool PackedNodeIdsContain(const std::string& packed_ids, const NodeId& node_id) {
+  const std::string& id(node_id.string());
+  for (size_t offset(0); offset + NodeId::kSize <= packed_ids.size(); offset += NodeId::kSize) {
+    if (packed_ids.compare(offset, NodeId::kSize, id) == 0)
+      return true;
+  }
+  return false;
+}
+
+}  // namespace routing
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ROUTING_NEXT_HOP_H_
@@ -0,0 +1,100 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+#include "maidsafe/routing/next_hop_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+
+namespace maidsafe {
+
+namespace routing {
+
+NextHopCache::NextHopCache(size_t capacity) : slots_(capacity) {}
+
+std::string NextHopCache::MakeKey(const NodeId& target_id,
+                                  const std::string& packed_exclude,
+                                  bool ignore_exact_match,
+                                  const std::vector<NodeId>& routing_ids,
+                                  uint16_t prefix_bits) {
+  std::string key(target_id.string());
+  if (std::binary_search(routing_ids.begin(), routing_ids.end(), target_id)) {
+    // Equality with the target matters as well as distance from it.
+    key += (ignore_exact_match ? '1' : '0');
+  } else {
+    const size_t prefix_bytes((prefix_bits + 7) / 8);
+    key.resize(std::min(prefix_bytes, key.size()));
+    if (prefix_bits % 8 != 0 && prefix_bytes <= static_cast<size_t>(NodeId::kSize))
+      key[prefix_bytes - 1] &= static_cast<char>(0xff << (8 - prefix_bits % 8));
+    key += static_cast<char>(prefix_bits % 256);
+  }
+
+  std::vector<std::string> excluded_ids;
+  for (size_t offset(0); offset + NodeId::kSize <= packed_exclude.size();
+       offset += NodeId::kSize) {
+    std::string excluded_id(packed_exclude.substr(offset, NodeId::kSize));
+    if (std::binary_search(routing_ids.begin(), routing_ids.end(), NodeId(excluded_id)))
+      excluded_ids.push_back(excluded_id);
+  }
+  std::sort(excluded_ids.begin(), excluded_ids.end());
+  for (const auto& excluded_id : excluded_ids)
+    key += excluded_id;
+  return key;
+}
+
+bool NextHopCache::Get(uint64_t epoch, const std::string& key, NextHop& next_hop) const {
+  if (slots_.empty())
+    return false;
+  std::shared_ptr<const Entry> entry(std::atomic_load(&Slot(key)));
+  if (!entry || entry->epoch != epoch || entry->key != key)
+    return false;
+  next_hop = entry->next_hop;
+  return true;
+}
+
+void NextHopCache::Add(uint64_t epoch,
+                       const std::string& key,
+                       const NextHop& next_hop,
+                       const std::vector<NodeId>& ranked_ids) {
+  if (slots_.empty())
+    return;
+  std::atomic_store(&Slot(key), std::shared_ptr<const Entry>(
+                                    std::make_shared<Entry>(epoch, key, next_hop, ranked_ids)));
+}
+
+void NextHopCache::Invalidate(const NodeId& peer_id) {
+  for (auto& slot : slots_) {
+    std::shared_ptr<const Entry> entry(std::atomic_load(&slot));
+    // Leaves the slot alone if a concurrent Add has already replaced the entry.
+    if (entry && (entry->next_hop.node_id == peer_id ||
+                  std::find(entry->ranked_ids.begin(), entry->ranked_ids.end(), peer_id) !=
+                      entry->ranked_ids.end()))
+      std::atomic_compare_exchange_strong(&slot, &entry, std::shared_ptr<const Entry>());
+  }
+}
+
+std::shared_ptr<const NextHopCache::Entry>& NextHopCache::Slot(const std::string& key) {
+  return slots_[std::hash<std::string>()(key) % slots_.size()];
+}
+
+const std::shared_ptr<const NextHopCache::Entry>& NextHopCache::Slot(
+    const std::string& key) const {
+  return slots_[std::hash<std::string>()(key) % slots_.size()];
+}
+
+}  // namespace routing
+
+}  // namespace maidsafe
@@ -0,0 +1,89 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+#ifndef MAIDSAFE_ROUTING_NEXT_HOP_CACHE_H_
+#define MAIDSAFE_ROUTING_NEXT_HOP_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/node_id.h"
+
+#include "maidsafe/routing/next_hop.h"
+
+
+namespace maidsafe {
+
+namespace routing {
+
+// Remembers recent next-hop decisions, each tagged with the routing table epoch it was made
+// against; lookups with any other epoch miss.  Entries live in a fixed array of slots read and
+// replaced with std::atomic_load/atomic_store, so neither lookups nor insertions take a lock, and
+// an insertion evicts only the entry previously held in its slot.
+class NextHopCache {
+ public:
+  explicit NextHopCache(size_t capacity);
+  // Builds the key for a next-hop decision.  |routing_ids| holds, sorted, every ID the decision
+  // compares distances between, and |prefix_bits| is enough leading bits of a target to order all
+  // of them by distance from it.  Targets outside |routing_ids| sharing that many leading bits
+  // therefore share a key, as do exclusions which aren't among |routing_ids|.  Excluded IDs are
+  // packed as for PackNodeIds.
+  static std::string MakeKey(const NodeId& target_id,
+                             const std::string& packed_exclude,
+                             bool ignore_exact_match,
+                             const std::vector<NodeId>& routing_ids,
+                             uint16_t prefix_bits);
+  bool Get(uint64_t epoch, const std::string& key, NextHop& next_hop) const;
+  // |ranked_ids| are the peers whose round trip times decided |next_hop|, if any did.
+  void Add(uint64_t epoch,
+           const std::string& key,
+           const NextHop& next_hop,
+           const std::vector<NodeId>& ranked_ids = std::vector<NodeId>());
+  // Discards the entries whose next hop is |peer_id| or which ranked |peer_id|, e.g. once its
+  // round trip time estimate changes.
+  void Invalidate(const NodeId& peer_id);
+
+ private:
+  NextHopCache(const NextHopCache&);
+  NextHopCache(const NextHopCache&&);
+  NextHopCache& operator=(const NextHopCache&);
+
+  struct Entry {
+    Entry(uint64_t epoch_in,
+          const std::string& key_in,
+          const NextHop& next_hop_in,
+          const std::vector<NodeId>& ranked_ids_in)
+        : epoch(epoch_in),
+          key(key_in),
+          next_hop(next_hop_in),
+          ranked_ids(ranked_ids_in) {}
+    const uint64_t epoch;
+    const std::string key;
+    const NextHop next_hop;
+    const std::vector<NodeId> ranked_ids;
+  };
+
+  std::shared_ptr<const Entry>& Slot(const std::string& key);
+  const std::shared_ptr<const Entry>& Slot(const std::string& key) const;
+
+  std::vector<std::shared_ptr<const Entry>> slots_;
+};
+
+}  // namespace routing
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ROUTING_NEXT_HOP_CACHE_H_
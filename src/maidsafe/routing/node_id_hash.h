@@ -0,0 +1,46 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+
+#ifndef MAIDSAFE_ROUTING_NODE_ID_HASH_H_
+#define MAIDSAFE_ROUTING_NODE_ID_HASH_H_
+
+#include <cstddef>
+#include <string>
+
+#include "maidsafe/common/node_id.h"
+
+
+namespace maidsafe {
+
+namespace routing {
+
+// Hash functor allowing NodeIds as keys of unordered containers.  NodeIds are uniformly random, so
+// a few bytes make a good hash; the trailing bytes are used because peers close to this node share
+// its leading bytes.
+struct NodeIdHash {
+  size_t operator()(const NodeId& node_id) const {
+    const std::string raw_id(node_id.string());
+    size_t hash(0);
+    for (size_t i(raw_id.size() - sizeof(hash)); i != raw_id.size(); ++i)
+      hash = (hash << 8) | static_cast<unsigned char>(raw_id[i]);
+    return hash;
+  }
+};
+
+}  // namespace routing
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ROUTING_NODE_ID_HASH_H_
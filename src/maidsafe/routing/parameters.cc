@@ -34,6 +34,7 @@ uint16_t Parameters::routing_table_size_threshold(max_routing_table_size / 2);
 uint16_t Parameters::max_routing_table_size_for_client(8);
 uint16_t Parameters::max_client_routing_table_size(max_routing_table_size);
 uint16_t Parameters::bucket_target_size(1);
+uint16_t Parameters::validated_key_cache_size(256);
 bptime::time_duration Parameters::default_response_timeout(bptime::seconds(10));
 bptime::time_duration Parameters::find_node_interval(bptime::seconds(10));
 bptime::time_duration Parameters::recovery_time_lag(bptime::seconds(5));
@@ -42,6 +43,23 @@ bptime::time_duration Parameters::find_close_node_interval(bptime::seconds(3));
 uint16_t Parameters::find_node_repeats_per_num_requested(3);
 uint16_t Parameters::maximum_find_close_node_failures(10);
 uint16_t Parameters::max_route_history(5);
+uint16_t Parameters::next_hop_cache_size(256);
+uint16_t Parameters::routing_table_change_log_size(256);
+bptime::time_duration Parameters::routing_table_dump_interval(bptime::seconds(10));
+bptime::time_duration Parameters::group_change_propagation_delay(bptime::milliseconds(100));
+bptime::time_duration Parameters::max_group_change_propagation_delay(bptime::seconds(1));
+bptime::time_duration Parameters::closest_nodes_subscribe_retry_interval(bptime::seconds(5));
+bptime::time_duration Parameters::closest_nodes_full_update_interval(bptime::seconds(60));
+bptime::time_duration Parameters::recursive_send_retry_delay(bptime::milliseconds(50));
+bptime::time_duration Parameters::max_recursive_send_retry_delay(bptime::seconds(1));
+uint16_t Parameters::circuit_breaker_failure_threshold(3);
+bptime::time_duration Parameters::circuit_breaker_open_period(bptime::seconds(5));
+bptime::time_duration Parameters::send_coalescing_window(bptime::milliseconds(0));
+uint32_t Parameters::max_coalesced_message_size(512);
+uint32_t Parameters::max_coalesced_batch_size(8192);
+uint16_t Parameters::proximity_routing_candidates(3);
+uint16_t Parameters::multipath_send_paths(2);
+uint16_t Parameters::multipath_request_cache_size(256);
 uint16_t Parameters::hops_to_live(50);
 uint16_t Parameters::accepted_distance_tolerance(1);
 uint16_t Parameters::greedy_fraction(Parameters::max_routing_table_size * 3 / 4);
@@ -49,6 +67,7 @@ uint16_t Parameters::split_avoidance(4);
 uint16_t Parameters::routing_table_ready_to_response(Parameters::greedy_fraction * 9 / 10);
 bptime::time_duration Parameters::connect_rpc_prune_timeout(
     rudp::Parameters::rendezvous_connect_timeout * 2);
+bptime::time_duration Parameters::connect_batch_window(bptime::seconds(1));
 // 10 KB of book keeping data for Routing
 uint32_t Parameters::max_data_size(rudp::ManagedConnections::kMaxMessageSize() - 10240);
 bool Parameters::append_maidsafe_endpoints(false);
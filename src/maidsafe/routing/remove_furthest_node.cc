@@ -72,7 +72,7 @@ void RemoveFurthestNode::RejectRemoval(protobuf::Message& message) {
   protobuf::RemoveResponse remove_response;
   remove_response.set_original_request(message.data(0));
   message.clear_data();
-  message.clear_route_history();
+  message.clear_route_history_ring();
   message.set_request(false);
   remove_response.set_success(false);
   remove_response.set_peer_id(routing_table_.kNodeId().string());
@@ -66,9 +66,10 @@ void ResponseHandler::Ping(protobuf::Message& message) {
 
   // TODO(dirvine): do we need this and where and how can I update the response
   protobuf::PingResponse ping_response;
-  if (ping_response.ParseFromString(message.data(0))) {
-    // do stuff here
-  }
+  bptime::time_duration round_trip_time;
+  if (ping_response.ParseFromString(message.data(0)) && CheckId(message.source_id()) &&
+      network_.PingResponseReceived(message.id(), NodeId(message.source_id()), round_trip_time))
+    routing_table_.UpdateRoundTripTime(NodeId(message.source_id()), round_trip_time);
 }
 
 void ResponseHandler::Connect(protobuf::Message& message) {
@@ -190,16 +191,18 @@ void ResponseHandler::FindNodes(const protobuf::Message& message) {
 
   LOG(kVerbose) << find_node_result;
 
+  std::vector<NodeId> peer_ids;
   for (int i = 0; i < find_nodes_response.nodes_size(); ++i) {
     if (!find_nodes_response.nodes(i).empty())
-      CheckAndSendConnectRequest(NodeId(find_nodes_response.nodes(i)));
+      peer_ids.push_back(NodeId(find_nodes_response.nodes(i)));
   }
+  SendConnectRequests(peer_ids);
 }
 
-void ResponseHandler::SendConnectRequest(const NodeId peer_node_id) {
+bool ResponseHandler::SendConnectRequest(const NodeId peer_node_id) {
   if (network_.bootstrap_connection_id().IsZero() && (routing_table_.size() == 0)) {
     LOG(kWarning) << "Need to re bootstrap !";
-    return;
+    return false;
   }
   bool send_to_bootstrap_connection((routing_table_.size() < Parameters::closest_nodes_size) &&
                                     !network_.bootstrap_connection_id().IsZero());
@@ -208,7 +211,7 @@ void ResponseHandler::SendConnectRequest(const NodeId peer_node_id) {
 
   if (peer.node_id == NodeId(routing_table_.kNodeId())) {
 //    LOG(kInfo) << "Can't send connect request to self !";
-    return;
+    return false;
   }
 
   if (routing_table_.CheckNode(peer)) {
@@ -234,7 +237,7 @@ void ResponseHandler::SendConnectRequest(const NodeId peer_node_id) {
       } else {
         LOG(kVerbose) << "Already ongoing attempt to : " << DebugId(peer.node_id);
       }
-      return;
+      return false;
     }
     assert((!this_endpoint_pair.external.address().is_unspecified() ||
             !this_endpoint_pair.local.address().is_unspecified()) &&
@@ -262,7 +265,9 @@ void ResponseHandler::SendConnectRequest(const NodeId peer_node_id) {
                             network_.bootstrap_connection_id());
     else
       network_.SendToClosestNode(connect_rpc);
+    return true;
   }
+  return false;
 }
 
 void ResponseHandler::ConnectSuccessAcknowledgement(protobuf::Message& message) {
@@ -337,6 +342,12 @@ void ResponseHandler::ValidateAndCompleteConnectionToNonClient(
                        << DebugId(peer.node_id);
             if (std::shared_ptr<ResponseHandler> response_handler =
                 response_handler_weak_ptr.lock()) {
+              if (!from_requestor) {
+                NodeInfo validated_peer(peer);
+                validated_peer.public_key = key;
+                if (response_handler->AddToConnectBatch(validated_peer, close_ids))
+                  return;
+              }
               if (ValidateAndAddToRoutingTable(response_handler->network_,
                                                response_handler->routing_table_,
                                                response_handler->client_routing_table_,
@@ -379,14 +390,121 @@ void ResponseHandler::HandleSuccessAcknowledgementAsReponder(NodeInfo peer,
 
 void ResponseHandler::HandleSuccessAcknowledgementAsRequestor(
     const std::vector<NodeId>& close_ids) {
-  for (const auto& i : close_ids) {
-    if (!i.IsZero()) {
-      CheckAndSendConnectRequest(i);
+  SendConnectRequests(close_ids);
+}
+
+void ResponseHandler::SendConnectRequests(const std::vector<NodeId>& peer_ids) {
+  std::shared_ptr<ConnectBatch> batch(std::make_shared<ConnectBatch>());
+  std::vector<bool> batched(peer_ids.size(), false);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i(0); i != peer_ids.size(); ++i) {
+      // A peer already awaited by an earlier batch stays with that one.
+      if (!peer_ids[i].IsZero() &&
+          connect_batches_.insert(std::make_pair(peer_ids[i], batch)).second) {
+        batched[i] = true;
+        ++batch->outstanding;
+      }
     }
   }
+
+  for (size_t i(0); i != peer_ids.size(); ++i) {
+    if (peer_ids[i].IsZero() || CheckAndSendConnectRequest(peer_ids[i]) || !batched[i])
+      continue;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto itr(connect_batches_.find(peer_ids[i]));
+    if (itr != connect_batches_.end() && itr->second == batch) {
+      connect_batches_.erase(itr);
+      --batch->outstanding;
+    }
+  }
+
+  bool flush(false);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush = (batch->outstanding == 0);
+  }
+  if (flush) {
+    FlushConnectBatch(batch, false);
+  } else {
+    std::weak_ptr<ResponseHandler> response_handler_weak_ptr(shared_from_this());
+    network_.ScheduleTask(Parameters::connect_batch_window,
+                          [response_handler_weak_ptr, batch] {
+                            if (std::shared_ptr<ResponseHandler> response_handler =
+                                    response_handler_weak_ptr.lock())
+                              response_handler->FlushConnectBatch(batch, true);
+                          });
+  }
+}
+
+bool ResponseHandler::AddToConnectBatch(const NodeInfo& peer,
+                                        const std::vector<NodeId>& close_ids) {
+  std::shared_ptr<ConnectBatch> batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto itr(connect_batches_.find(peer.node_id));
+    if (itr == connect_batches_.end())
+      return false;
+    batch = itr->second;
+    connect_batches_.erase(itr);
+  }
+
+  bool valid(ValidateConnection(network_, routing_table_, peer.node_id, peer.connection_id));
+  bool flush(false);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --batch->outstanding;
+    if (valid) {
+      batch->peers.push_back(peer);
+      batch->close_ids.push_back(close_ids);
+    }
+    flush = (batch->outstanding == 0);
+  }
+  if (flush)
+    FlushConnectBatch(batch, false);
+  return true;
+}
+
+void ResponseHandler::FlushConnectBatch(std::shared_ptr<ConnectBatch> batch,
+                                        bool abandon_outstanding) {
+  std::vector<NodeInfo> peers;
+  std::vector<std::vector<NodeId>> close_ids;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (abandon_outstanding) {
+      for (auto itr(connect_batches_.begin()); itr != connect_batches_.end();) {
+        if (itr->second == batch) {
+          itr = connect_batches_.erase(itr);
+          --batch->outstanding;
+        } else {
+          ++itr;
+        }
+      }
+    }
+    peers.swap(batch->peers);
+    close_ids.swap(batch->close_ids);
+  }
+  if (peers.empty())
+    return;
+
+  std::vector<NodeInfo> added_peers(routing_table_.AddNodes(peers));
+  std::vector<NodeId> added_close_ids;
+  for (size_t i(0); i != peers.size(); ++i) {
+    bool added(std::any_of(added_peers.begin(), added_peers.end(),
+                           [&](const NodeInfo& added_peer) {
+                             return added_peer.node_id == peers[i].node_id;
+                           }));
+    if (CompleteAddToRoutingTable(network_, routing_table_, peers[i].node_id,
+                                  peers[i].connection_id, false, added))
+      added_close_ids.insert(added_close_ids.end(), close_ids[i].begin(), close_ids[i].end());
+  }
+  std::sort(added_close_ids.begin(), added_close_ids.end());
+  added_close_ids.erase(std::unique(added_close_ids.begin(), added_close_ids.end()),
+                        added_close_ids.end());
+  HandleSuccessAcknowledgementAsRequestor(added_close_ids);
 }
 
-void ResponseHandler::CheckAndSendConnectRequest(const NodeId& node_id) {
+bool ResponseHandler::CheckAndSendConnectRequest(const NodeId& node_id) {
   uint16_t limit(routing_table_.client_mode() ? Parameters::max_routing_table_size_for_client :
                                                 Parameters::greedy_fraction);
   if ((routing_table_.size() < limit) ||
@@ -394,7 +512,8 @@ void ResponseHandler::CheckAndSendConnectRequest(const NodeId& node_id) {
                              routing_table_.GetNthClosestNode(routing_table_.kNodeId(),
                                                               limit).node_id,
                              routing_table_.kNodeId()))
-    SendConnectRequest(node_id);
+    return SendConnectRequest(node_id);
+  return false;
 }
 
 void ResponseHandler::CloseNodeUpdateForClient(protobuf::Message& message) {
@@ -422,8 +541,9 @@ void ResponseHandler::CloseNodeUpdateForClient(protobuf::Message& message) {
       closest_nodes.push_back(NodeId(basic_info.node_id()));
     }
   }
-  assert(!closest_nodes.empty());
-  HandleSuccessAcknowledgementAsRequestor(closest_nodes);
+  // An update holding only the changes to the list may have removed nodes without adding any.
+  if (!closest_nodes.empty())
+    HandleSuccessAcknowledgementAsRequestor(closest_nodes);
   message.Clear();
 }
 
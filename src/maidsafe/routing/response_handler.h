@@ -16,8 +16,10 @@ License.
 #ifndef MAIDSAFE_ROUTING_RESPONSE_HANDLER_H_
 #define MAIDSAFE_ROUTING_RESPONSE_HANDLER_H_
 
+#include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "boost/asio/deadline_timer.hpp"
@@ -27,6 +29,8 @@ License.
 #include "maidsafe/rudp/managed_connections.h"
 
 #include "maidsafe/routing/api_config.h"
+#include "maidsafe/routing/node_id_hash.h"
+#include "maidsafe/routing/node_info.h"
 #include "maidsafe/routing/timer.h"
 
 
@@ -72,8 +76,26 @@ class ResponseHandler : public std::enable_shared_from_this<ResponseHandler> {
   friend class test::ResponseHandlerTest_BEH_ConnectAttempts_Test;
 
  private:
-  void SendConnectRequest(const NodeId peer_node_id);
-  void CheckAndSendConnectRequest(const NodeId& node_id);
+  // Peers connected to because of one FindNodes response or one list of close IDs.  Those which
+  // validate are added to the routing table with a single AddNodes call.
+  struct ConnectBatch {
+    ConnectBatch() : peers(), close_ids(), outstanding(0) {}
+    std::vector<NodeInfo> peers;
+    // The close IDs each of |peers| sent in its ConnectSuccessAcknowledgement.
+    std::vector<std::vector<NodeId>> close_ids;
+    size_t outstanding;
+  };
+
+  // Both return true if a Connect RPC was sent to |peer_node_id|.
+  bool SendConnectRequest(const NodeId peer_node_id);
+  bool CheckAndSendConnectRequest(const NodeId& node_id);
+  // Sends Connect RPCs to |peer_ids| as one ConnectBatch.
+  void SendConnectRequests(const std::vector<NodeId>& peer_ids);
+  // Returns false if |peer| isn't awaited by a ConnectBatch, in which case the caller adds it.
+  bool AddToConnectBatch(const NodeInfo& peer, const std::vector<NodeId>& close_ids);
+  // Adds the peers validated so far.  If |abandon_outstanding| is set, peers still outstanding will
+  // be added one at a time as they arrive.
+  void FlushConnectBatch(std::shared_ptr<ConnectBatch> batch, bool abandon_outstanding);
   void HandleSuccessAcknowledgementAsRequestor(const std::vector<NodeId>& close_ids);
   void HandleSuccessAcknowledgementAsReponder(NodeInfo peer, const bool& client);
   void  ValidateAndCompleteConnectionToClient(const NodeInfo& peer, bool from_requestor,
@@ -88,6 +110,7 @@ class ResponseHandler : public std::enable_shared_from_this<ResponseHandler> {
   NetworkUtils& network_;
   GroupChangeHandler& group_change_handler_;
   RequestPublicKeyFunctor request_public_key_functor_;
+  std::unordered_map<NodeId, std::shared_ptr<ConnectBatch>, NodeIdHash> connect_batches_;
 };
 
 }  // namespace routing
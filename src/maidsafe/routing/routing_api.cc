@@ -14,6 +14,7 @@ License.
 */
 
 #include "maidsafe/routing/routing_api.h"
+#include "maidsafe/routing/parameters.h"
 #include "maidsafe/routing/routing_impl.h"
 
 
@@ -52,6 +53,14 @@ void Routing::SendDirect(const NodeId& destination_id,
   return pimpl_->SendDirect(destination_id, message, cacheable, response_functor);
 }
 
+void Routing::SendDirectMultipath(const NodeId& destination_id,
+                                  const std::string& message,
+                                  const bool& cacheable,
+                                  ResponseFunctor response_functor) {
+  return pimpl_->SendDirect(destination_id, message, cacheable, response_functor,
+                            Parameters::multipath_send_paths);
+}
+
 void Routing::SendGroup(const NodeId& destination_id,
                         const std::string& message,
                         const bool& cacheable,
@@ -15,10 +15,14 @@ License.
 
 #include "maidsafe/routing/routing_impl.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <type_traits>
 
+#include "boost/date_time/posix_time/posix_time.hpp"
+
 #include "maidsafe/common/log.h"
+#include "maidsafe/common/utils.h"
 
 #include "maidsafe/rudp/managed_connections.h"
 #include "maidsafe/rudp/return_codes.h"
@@ -63,13 +67,18 @@ Routing::Impl::Impl(bool client_mode,
       remove_furthest_node_(routing_table_, network_),
       group_change_handler_(routing_table_, client_routing_table_, network_),
       network_statistics_(routing_table_.kNodeId()),
+      group_change_mutex_(),
+      pending_close_nodes_(),
+      group_change_pending_(false),
+      group_change_deadline_(),
       message_handler_(),
       asio_service_(2),
       network_(routing_table_, client_routing_table_),
       timer_(asio_service_),
       re_bootstrap_timer_(asio_service_.service()),
       recovery_timer_(asio_service_.service()),
-      setup_timer_(asio_service_.service()) {
+      setup_timer_(asio_service_.service()),
+      group_change_timer_(asio_service_.service()) {
   asio_service_.Start();
   message_handler_.reset(new MessageHandler(routing_table_,
                                             client_routing_table_,
@@ -115,9 +124,7 @@ void Routing::Impl::ConnectFunctors(const Functors& functors) {
                                       remove_furthest_node_.RemoveNodeRequest();
                                     },
                                     [this] (const std::vector<NodeInfo> nodes) {
-                                      std::lock_guard<std::mutex> lock(running_mutex_);
-                                      if (running_)
-                                        group_change_handler_.SendClosestNodesUpdateRpcs(nodes);
+                                      OnConnectedGroupChange(nodes);
                                     },
                                     functors_.close_node_replaced,
                                     functors.matrix_changed);
@@ -132,7 +139,7 @@ void Routing::Impl::BootstrapFromTheseEndpoints(const std::vector<Endpoint>& end
              << (routing_table_.client_mode() ? " Client" : "");
   if (routing_table_.size() > 0) {
     for (uint16_t i = 0; i < routing_table_.size(); ++i) {
-      NodeInfo remove_node = routing_table_.GetClosestNode(kNodeId_);
+      NextHop remove_node(routing_table_.GetClosestNode(kNodeId_));
       network_.Remove(remove_node.connection_id);
       routing_table_.DropNode(remove_node.node_id, true);
     }
@@ -325,8 +332,9 @@ int Routing::Impl::ZeroStateJoin(const Functors& functors,
 void Routing::Impl::SendDirect(const NodeId& destination_id,
                                const std::string& data,
                                const bool& cacheable,
-                               ResponseFunctor response_functor) {
-  Send(destination_id, data, DestinationType::kDirect, cacheable, response_functor);
+                               ResponseFunctor response_functor,
+                               uint16_t path_count) {
+  Send(destination_id, data, DestinationType::kDirect, cacheable, response_functor, path_count);
 }
 
 void Routing::Impl::SendGroup(const NodeId& destination_id,
@@ -340,7 +348,8 @@ void Routing::Impl::Send(const NodeId& destination_id,
                          const std::string& data,
                          const DestinationType& destination_type,
                          const bool& cacheable,
-                         ResponseFunctor response_functor) {
+                         ResponseFunctor response_functor,
+                         uint16_t path_count) {
   CheckSendParameters(destination_id, data);
   protobuf::Message proto_message = CreateNodeLevelPartialMessage(destination_id, destination_type,
                                                                   data, cacheable);
@@ -349,6 +358,17 @@ void Routing::Impl::Send(const NodeId& destination_id,
     expected_response_count = 4;
   proto_message.set_id(timer_.AddTask(Parameters::default_response_timeout, response_functor,
                                       expected_response_count));
+  // Copies after the first response finds the task gone are simply dropped by timer_.  Only
+  // SendMessage's normal branch for another node's ID is bypassed here: a partially joined node
+  // (empty routing table) still relays through its bootstrap connection, and a send to this
+  // node's own ID, including a client's, takes the single path SendMessage gives it.
+  if (path_count > 1 && routing_table_.size() != 0 && kNodeId_ != destination_id) {
+    proto_message.set_source_id(kNodeId_.string());
+    proto_message.set_multipath(true);
+    proto_message.set_multipath_nonce((static_cast<uint64_t>(RandomUint32()) << 32) |
+                                      RandomUint32());
+    return network_.SendToDisjointNextHops(proto_message, path_count);
+  }
   SendMessage(destination_id, proto_message);
 }
 
@@ -486,31 +506,49 @@ void Routing::Impl::OnMessageReceived(const std::string& message) {
 void Routing::Impl::DoOnMessageReceived(const std::string& message) {
   protobuf::Message pb_message;
   if (pb_message.ParseFromString(message)) {
-    bool relay_message(!pb_message.has_source_id());
-    LOG(kVerbose) << "   [" << DebugId(kNodeId_) << "] rcvd : "
-                  << MessageTypeString(pb_message) << " from "
-                  << (relay_message ? HexSubstr(pb_message.relay_id()) :
-                                      HexSubstr(pb_message.source_id()))
-                  << " to " << HexSubstr(pb_message.destination_id())
-                  << "   (id: " << pb_message.id() << ")"
-                  << (relay_message ? " --Relay--" : "");
-    if ((!pb_message.client_node() && pb_message.has_source_id()) ||
-        (!pb_message.direct() && !pb_message.request())) {
-      NodeId source_id(pb_message.source_id());
-      if (!source_id.IsZero())
-        random_node_helper_.Add(source_id);
-    }
-    {
-      std::lock_guard<std::mutex> lock(running_mutex_);
-      if (!running_)
-        return;
-    }
-    message_handler_->HandleMessage(pb_message);
-  } else {
+    HandleReceivedMessage(pb_message);
+    return;
+  }
+
+  // Batches are only unpacked one level: an entry which is itself a batch fails to parse as a
+  // Message and is dropped.
+  protobuf::MessageBatch batch;
+  if (!batch.ParseFromString(message) || batch.messages_size() == 0) {
     LOG(kWarning) << "Message received, failed to parse";
+    return;
+  }
+  for (const auto& batched_message : batch.messages()) {
+    protobuf::Message pb_batched_message;
+    if (pb_batched_message.ParseFromString(batched_message))
+      HandleReceivedMessage(pb_batched_message);
+    else
+      LOG(kWarning) << "Batched message received, failed to parse";
   }
 }
 
+void Routing::Impl::HandleReceivedMessage(protobuf::Message& pb_message) {
+  bool relay_message(!pb_message.has_source_id());
+  LOG(kVerbose) << "   [" << DebugId(kNodeId_) << "] rcvd : "
+                << MessageTypeString(pb_message) << " from "
+                << (relay_message ? HexSubstr(pb_message.relay_id()) :
+                                    HexSubstr(pb_message.source_id()))
+                << " to " << HexSubstr(pb_message.destination_id())
+                << "   (id: " << pb_message.id() << ")"
+                << (relay_message ? " --Relay--" : "");
+  if ((!pb_message.client_node() && pb_message.has_source_id()) ||
+      (!pb_message.direct() && !pb_message.request())) {
+    NodeId source_id(pb_message.source_id());
+    if (!source_id.IsZero())
+      random_node_helper_.Add(source_id);
+  }
+  {
+    std::lock_guard<std::mutex> lock(running_mutex_);
+    if (!running_)
+      return;
+  }
+  message_handler_->HandleMessage(pb_message);
+}
+
 void Routing::Impl::OnConnectionLost(const NodeId& lost_connection_id) {
   std::lock_guard<std::mutex> lock(running_mutex_);
   if (running_)
@@ -527,11 +565,11 @@ void Routing::Impl::DoOnConnectionLost(const NodeId& lost_connection_id) {
   }
 
   NodeInfo dropped_node;
-  bool resend(routing_table_.GetNodeInfo(lost_connection_id, dropped_node) &&
+  bool resend(routing_table_.GetNodeInfoForConnection(lost_connection_id, dropped_node) &&
            routing_table_.IsThisNodeInRange(dropped_node.node_id, Parameters::closest_nodes_size));
 
   // Checking routing table
-  dropped_node = routing_table_.DropNode(lost_connection_id, true);
+  dropped_node = routing_table_.DropConnection(lost_connection_id, true);
   if (!dropped_node.node_id.IsZero()) {
     LOG(kWarning) << "[" << DebugId(kNodeId_) << "]"
                   << "Lost connection with routing node " << DebugId(dropped_node.node_id);
@@ -613,6 +651,47 @@ void Routing::Impl::RemoveNode(const NodeInfo& node, bool internal_rudp_only) {
   }
 }
 
+void Routing::Impl::OnConnectedGroupChange(const std::vector<NodeInfo>& close_nodes) {
+  std::lock_guard<std::mutex> lock(running_mutex_);
+  if (!running_)
+    return;
+  if (Parameters::group_change_propagation_delay.is_zero()) {
+    group_change_handler_.SendClosestNodesUpdateRpcs(close_nodes);
+    return;
+  }
+  // Changes arriving before the timer fires replace the pending one, so a burst of churn is sent to
+  // each subscriber as a single update.
+  std::lock_guard<std::mutex> group_change_lock(group_change_mutex_);
+  boost::posix_time::ptime now(boost::posix_time::microsec_clock::universal_time());
+  if (!group_change_pending_) {
+    group_change_pending_ = true;
+    group_change_deadline_ = now + Parameters::max_group_change_propagation_delay;
+  }
+  pending_close_nodes_ = close_nodes;
+  group_change_timer_.expires_at(std::min(now + Parameters::group_change_propagation_delay,
+                                          group_change_deadline_));
+  group_change_timer_.async_wait([=](const boost::system::error_code& error_code) {
+                                   SendGroupChange(error_code);
+                                 });
+}
+
+void Routing::Impl::SendGroupChange(const boost::system::error_code& error_code) {
+  if (error_code == boost::asio::error::operation_aborted)
+    return;
+  std::vector<NodeInfo> close_nodes;
+  {
+    std::lock_guard<std::mutex> lock(group_change_mutex_);
+    // A handler already queued when the timer was re-armed may have sent the change.
+    if (!group_change_pending_)
+      return;
+    group_change_pending_ = false;
+    close_nodes.swap(pending_close_nodes_);
+  }
+  std::lock_guard<std::mutex> lock(running_mutex_);
+  if (running_)
+    group_change_handler_.SendClosestNodesUpdateRpcs(close_nodes);
+}
+
 bool Routing::Impl::ConfirmGroupMembers(const NodeId& node1, const NodeId& node2) {
   return routing_table_.ConfirmGroupMembers(node1, node2);
 }
@@ -24,6 +24,7 @@ License.
 #include "boost/asio/deadline_timer.hpp"
 #include "boost/asio/ip/udp.hpp"
 #include "boost/date_time/posix_time/posix_time_config.hpp"
+#include "boost/date_time/posix_time/ptime.hpp"
 #include "boost/system/error_code.hpp"
 
 #include "maidsafe/common/asio_service.h"
@@ -68,7 +69,8 @@ class Routing::Impl {
   void SendDirect(const NodeId& destination_id,
                   const std::string& data,
                   const bool& cacheable,
-                  ResponseFunctor response_functor);
+                  ResponseFunctor response_functor,
+                  uint16_t path_count = 1);
 
   void SendGroup(const NodeId& destination_id,
                  const std::string& data,
@@ -113,14 +115,17 @@ class Routing::Impl {
   void ReSendFindNodeRequest(const boost::system::error_code& error_code, bool ignore_size);
   void OnMessageReceived(const std::string& message);
   void DoOnMessageReceived(const std::string& message);
+  void HandleReceivedMessage(protobuf::Message& pb_message);
   void OnConnectionLost(const NodeId& lost_connection_id);
   void DoOnConnectionLost(const NodeId& lost_connection_id);
   void RemoveNode(const NodeInfo& node, bool internal_rudp_only);
+  void OnConnectedGroupChange(const std::vector<NodeInfo>& close_nodes);
+  void SendGroupChange(const boost::system::error_code& error_code);
   bool ConfirmGroupMembers(const NodeId& node1, const NodeId& node2);
   void NotifyNetworkStatus(int return_code) const;
   void Send(const NodeId& destination_id, const std::string& data,
             const DestinationType& destination_type, const bool& cacheable,
-            ResponseFunctor response_functor);
+            ResponseFunctor response_functor, uint16_t path_count = 1);
   void SendMessage(const NodeId& destination_id, protobuf::Message& proto_message);
   void PartiallyJoinedSend(protobuf::Message& proto_message);
   protobuf::Message CreateNodeLevelPartialMessage(
@@ -142,6 +147,11 @@ class Routing::Impl {
   RemoveFurthestNode remove_furthest_node_;
   GroupChangeHandler group_change_handler_;
   NetworkStatistics network_statistics_;
+  // Latest close group awaiting group_change_timer_, and the latest time it can be sent.
+  std::mutex group_change_mutex_;
+  std::vector<NodeInfo> pending_close_nodes_;
+  bool group_change_pending_;
+  boost::posix_time::ptime group_change_deadline_;
   // The following variables' declarations should remain the last ones in this class and should stay
   // in the order: message_handler_, asio_service_, network_, all timers.  This is important for the
   // proper destruction of the routing library, i.e. to avoid segmentation faults.
@@ -149,7 +159,8 @@ class Routing::Impl {
   AsioService asio_service_;
   NetworkUtils network_;
   Timer timer_;
-  boost::asio::deadline_timer re_bootstrap_timer_, recovery_timer_, setup_timer_;
+  boost::asio::deadline_timer re_bootstrap_timer_, recovery_timer_, setup_timer_,
+                              group_change_timer_;
 };
 
 }  // namespace routing
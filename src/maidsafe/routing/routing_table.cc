@@ -15,15 +15,21 @@ License.
 
 #include "maidsafe/routing/routing_table.h"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #include <algorithm>
-#include <bitset>
-#include <limits>
+#include <chrono>
 #include <map>
+#include <string>
 
+#include "maidsafe/common/crypto.h"
 #include "maidsafe/common/log.h"
 #include "maidsafe/common/utils.h"
 #include "maidsafe/common/tools/network_viewer.h"
 
+#include "maidsafe/routing/distance.h"
 #include "maidsafe/routing/parameters.h"
 #include "maidsafe/routing/node_info.h"
 #include "maidsafe/routing/return_codes.h"
@@ -34,12 +40,99 @@ namespace maidsafe {
 
 namespace routing {
 
+namespace {
+
+typedef std::array<uint64_t, NodeId::kSize / sizeof(uint64_t)> NodeIdWords;
+
+NodeIdWords ToWords(const NodeId& node_id) {
+  const std::string raw_id(node_id.string());
+  NodeIdWords words;
+  words.fill(0);
+  for (size_t i(0); i != raw_id.size(); ++i) {
+    uint64_t& word(words[i / sizeof(uint64_t)]);
+    word = (word << 8) | static_cast<unsigned char>(raw_id[i]);
+  }
+  return words;
+}
+
+// value must be non-zero.
+int CountLeadingZeros(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index(0);
+  _BitScanReverse64(&index, value);
+  return 63 - static_cast<int>(index);
+#else
+  int count(0);
+  for (uint64_t mask(uint64_t(1) << 63); (value & mask) == 0; mask >>= 1)
+    ++count;
+  return count;
+#endif
+}
+
+// Number of leading bits lhs and rhs have in common.
+int CommonLeadingBits(const NodeId& lhs, const NodeId& rhs) {
+  const NodeIdWords lhs_words(ToWords(lhs)), rhs_words(ToWords(rhs));
+  for (size_t i(0); i != lhs_words.size(); ++i) {
+    if (lhs_words[i] != rhs_words[i])
+      return static_cast<int>(i * 64) + CountLeadingZeros(lhs_words[i] ^ rhs_words[i]);
+  }
+  return NodeId::kSize * 8;
+}
+
+// Throws if public_key can't be encoded.
+std::string KeyFingerprint(const asymm::PublicKey& public_key) {
+  return crypto::Hash<crypto::SHA1>(asymm::EncodeKey(public_key).data.string()).string();
+}
+
+}  // unnamed namespace
+
+RoutingTable::Entry::Entry(const NodeInfo& node_info)
+    : node_id(node_info.node_id),
+      connection_id(node_info.connection_id),
+      bucket(node_info.bucket),
+      info(new NodeInfo(node_info)) {}
+
+RoutingTable::Snapshot::Snapshot(uint64_t epoch_in,
+                                 const std::vector<Entry>& nodes_in,
+                                 std::shared_ptr<const GroupMatrix> group_matrix_in,
+                                 const NodeId& this_node_id)
+    : epoch(epoch_in),
+      nodes(nodes_in),
+      group_matrix(group_matrix_in),
+      node_index(),
+      connection_index(),
+      routing_ids(group_matrix->GetUniqueNodeIds()),
+      next_hop_prefix_bits(0) {
+  node_index.reserve(nodes.size());
+  connection_index.reserve(nodes.size());
+  for (size_t i(0); i != nodes.size(); ++i) {
+    node_index.insert(std::make_pair(nodes[i].node_id, i));
+    connection_index.insert(std::make_pair(nodes[i].connection_id, i));
+    routing_ids.push_back(nodes[i].node_id);
+  }
+  // The zero ID stands in for "no peer found yet" when distances are compared.
+  routing_ids.push_back(this_node_id);
+  routing_ids.push_back(NodeId());
+  std::sort(routing_ids.begin(), routing_ids.end());
+  routing_ids.erase(std::unique(routing_ids.begin(), routing_ids.end()), routing_ids.end());
+  // Two IDs' order of distance from a target is decided by the target's bit at the first position
+  // where they differ.  Sorted neighbours share the longest prefixes.
+  for (size_t i(1); i < routing_ids.size(); ++i) {
+    next_hop_prefix_bits = std::max(
+        next_hop_prefix_bits,
+        static_cast<uint16_t>(CommonLeadingBits(routing_ids[i - 1], routing_ids[i]) + 1));
+  }
+}
+
 RoutingTable::RoutingTable(bool client_mode,
                            const NodeId& node_id,
                            const asymm::Keys& keys,
                            NetworkStatistics& network_statistics)
     : kClientMode_(client_mode),
       kNodeId_(node_id),
+      kNodeIdWords_(ToWords(kNodeId_)),
       kConnectionId_(kClientMode_ ? NodeId(NodeId::kRandomId) : kNodeId_),
       kKeys_(keys),
       kMaxSize_(kClientMode_ ? Parameters::max_routing_table_size_for_client :
@@ -54,7 +147,20 @@ RoutingTable::RoutingTable(bool client_mode,
       connected_group_change_functor_(),
       close_node_replaced_functor_(),
       nodes_(),
+      bucket_occupancy_(),
+      key_fingerprints_(),
+      key_fingerprint_set_(),
       group_matrix_(kNodeId_, client_mode),
+      group_matrix_snapshot_(new GroupMatrix(group_matrix_)),
+      epoch_(0),
+      snapshot_(new Snapshot(epoch_, nodes_, group_matrix_snapshot_, kNodeId_)),
+      next_hop_cache_(Parameters::next_hop_cache_size),
+      change_log_(Parameters::routing_table_change_log_size,
+                  std::chrono::milliseconds(
+                      Parameters::routing_table_dump_interval.total_milliseconds())),
+      validated_keys_mutex_(),
+      validated_keys_(),
+      validated_keys_order_(),
       ipc_message_queue_(),
       network_statistics_(network_statistics) {
 #ifdef TESTING
@@ -107,98 +213,139 @@ void RoutingTable::InitialiseFunctors(NetworkStatusFunctor network_status_functo
 }
 
 bool RoutingTable::AddNode(const NodeInfo& peer) {
-  return AddOrCheckNode(peer, true);
+  return AddNodes(std::vector<NodeInfo>(1, peer)).size() == 1;
 }
 
 bool RoutingTable::CheckNode(const NodeInfo& peer) {
-  return AddOrCheckNode(peer, false);
-}
-
-bool RoutingTable::AddOrCheckNode(NodeInfo peer, bool remove) {
   if (peer.node_id.IsZero() || peer.node_id == kNodeId_) {
     LOG(kError) << "Attempt to add an invalid node " << DebugId(peer.node_id);
     return false;
   }
-  if (remove && !asymm::ValidateKey(peer.public_key)) {
-    LOG(kInfo) << "Invalid public key for node " << DebugId(peer.node_id);
+  NodeInfo node(peer), removed_node;
+  SetBucketIndex(node);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (Find(node.node_id, lock).first) {
+    LOG(kVerbose) << "Node " << DebugId(node.node_id) << " already in routing table.";
     return false;
   }
+  return MakeSpaceForNodeToBeAdded(node, false, removed_node, lock);
+}
+
+// All peers are inserted under a single lock, after which the group matrix is pruned once and the
+// functors fire at most once for the whole batch.
+std::vector<NodeInfo> RoutingTable::AddNodes(const std::vector<NodeInfo>& peers) {
+  std::vector<std::pair<NodeInfo, std::string>> candidates;
+  candidates.reserve(peers.size());
+  for (const auto& peer : peers) {
+    if (peer.node_id.IsZero() || peer.node_id == kNodeId_) {
+      LOG(kError) << "Attempt to add an invalid node " << DebugId(peer.node_id);
+      continue;
+    }
+    std::string key_fingerprint;
+    if (!ValidatePublicKey(peer, key_fingerprint)) {
+      LOG(kInfo) << "Invalid public key for node " << DebugId(peer.node_id);
+      continue;
+    }
+    candidates.push_back(std::make_pair(peer, key_fingerprint));
+    SetBucketIndex(candidates.back().first);
+  }
 
-  bool return_value(false), remove_furthest_node(false);
-  std::vector<NodeInfo> new_connected_close_nodes, old_connected_close_nodes, new_closest_nodes;
-  NodeInfo removed_node;
+  std::vector<NodeInfo> added_nodes, removed_nodes, new_connected_close_nodes,
+                        old_connected_close_nodes, new_closest_nodes;
+  bool table_changed(false), remove_furthest_node(false);
   uint16_t routing_table_size(0);
   MatrixChange matrix_change;
-
-  if (remove)
-    SetBucketIndex(peer);
   std::vector<NodeId> unique_nodes;
+  if (candidates.empty())
+    return added_nodes;
   {
     std::unique_lock<std::mutex> lock(mutex_);
-    auto found(Find(peer.node_id, lock));
-    if (found.first) {
-      LOG(kVerbose) << "Node " << DebugId(peer.node_id) << " already in routing table.";
-      return false;
-    }
-
-    if (MakeSpaceForNodeToBeAdded(peer, remove, removed_node, lock)) {
-      if (remove) {
-        assert(peer.bucket != NodeInfo::kInvalidBucket);
-        nodes_.push_back(peer);
-        old_connected_close_nodes = group_matrix_.GetConnectedPeers();
-        UpdateCloseNodeChange(lock, peer, new_connected_close_nodes, matrix_change);
-        if (nodes_.size() > Parameters::greedy_fraction)
-          remove_furthest_node = true;
+    old_connected_close_nodes = group_matrix_.GetConnectedPeers();
+    MatrixChange::Snapshot old_matrix(group_matrix_.GetUniqueNodeIdsSnapshot());
+    for (const auto& candidate : candidates) {
+      const NodeInfo& peer(candidate.first);
+      if (Find(peer.node_id, lock).first) {
+        LOG(kVerbose) << "Node " << DebugId(peer.node_id) << " already in routing table.";
+        continue;
+      }
+      if (!CheckPublicKeyIsUnique(candidate.second, lock))
+        continue;
+      NodeInfo removed_node;
+      if (!MakeSpaceForNodeToBeAdded(peer, true, removed_node, lock))
+        continue;
+      if (!removed_node.node_id.IsZero()) {
+        // The node made way for may itself have been added earlier in this batch.
+        auto evicted(std::find_if(added_nodes.begin(), added_nodes.end(),
+                                  [&removed_node](const NodeInfo& node_info) {
+                                    return node_info.node_id == removed_node.node_id;
+                                  }));
+        if (evicted != added_nodes.end())
+          added_nodes.erase(evicted);
+        removed_nodes.push_back(removed_node);
       }
-      return_value = true;
+      assert(peer.bucket != NodeInfo::kInvalidBucket);
+      InsertNode(peer, candidate.second, lock);
+      if (nodes_.size() < Parameters::closest_nodes_size ||
+          !NodeId::CloserToTarget(nodes_[Parameters::closest_nodes_size - 1].node_id,
+                                  peer.node_id,
+                                  kNodeId_)) {
+        group_matrix_.AddConnectedPeer(peer);
+        group_matrix_snapshot_.reset();
+      }
+      added_nodes.push_back(peer);
+      table_changed = true;
+    }
+    if (table_changed) {
+      group_matrix_.Prune();
+      matrix_change = group_matrix_.GetMatrixChange(old_matrix);
+      new_connected_close_nodes = group_matrix_.GetConnectedPeers();
+      remove_furthest_node = nodes_.size() > Parameters::greedy_fraction;
+      PublishSnapshot(lock);
     }
     routing_table_size = static_cast<uint16_t>(nodes_.size());
     unique_nodes = group_matrix_.GetUniqueNodeIds();
   }
 
-  if (return_value && remove) {  // Firing functors on Add only
-    UpdateNetworkStatus(routing_table_size);
+  if (!table_changed)
+    return added_nodes;
 
-    if (!removed_node.node_id.IsZero()) {
-      LOG(kVerbose) << "Routing table removed node id : " << DebugId(removed_node.node_id)
-                    << ", connection id : " << DebugId(removed_node.connection_id);
-      if (remove_node_functor_)
-        remove_node_functor_(removed_node, false);
-    }
+  UpdateNetworkStatus(routing_table_size);
 
-    if ((new_connected_close_nodes.size() != old_connected_close_nodes.size() ||
-         !std::equal(new_connected_close_nodes.begin(),
-                     new_connected_close_nodes.end(),
-                     old_connected_close_nodes.begin(),
-                     [](const NodeInfo& lhs, const NodeInfo& rhs) {
-                       return lhs.node_id == rhs.node_id;
-                     }))) {
-      if (connected_group_change_functor_) {
-        connected_group_change_functor_(new_connected_close_nodes);
-      }
-    }
+  for (const auto& removed_node : removed_nodes) {
+    LOG(kVerbose) << "Routing table removed node id : " << DebugId(removed_node.node_id)
+                  << ", connection id : " << DebugId(removed_node.connection_id);
+    if (remove_node_functor_)
+      remove_node_functor_(removed_node, false);
+  }
 
-    if (!matrix_change.OldEqualsToNew()) {
-      network_statistics_.UpdateLocalAverageDistance(unique_nodes);
-      if (close_node_replaced_functor_)
-        close_node_replaced_functor_(new_closest_nodes);
-      if (matrix_change_functor_)
-        matrix_change_functor_(matrix_change);
-      IpcSendGroupMatrix();
+  if ((new_connected_close_nodes.size() != old_connected_close_nodes.size() ||
+       !std::equal(new_connected_close_nodes.begin(),
+                   new_connected_close_nodes.end(),
+                   old_connected_close_nodes.begin(),
+                   [](const NodeInfo& lhs, const NodeInfo& rhs) {
+                     return lhs.node_id == rhs.node_id;
+                   }))) {
+    if (connected_group_change_functor_) {
+      connected_group_change_functor_(new_connected_close_nodes);
     }
+  }
 
-    if (peer.nat_type == rudp::NatType::kOther) {  // Usable as bootstrap endpoint
-//      if (new_bootstrap_endpoint_)
-//        new_bootstrap_endpoint_(peer.endpoint);
-    }
-    if (remove_furthest_node) {
-      LOG(kVerbose) << "[" << DebugId(kNodeId_) <<  "] Removing furthest node....";
-      if (remove_furthest_node_)
-        remove_furthest_node_();
-    }
-    LOG(kInfo) << PrintRoutingTable();
+  if (!matrix_change.OldEqualsToNew()) {
+    network_statistics_.UpdateLocalAverageDistance(unique_nodes);
+    if (close_node_replaced_functor_)
+      close_node_replaced_functor_(new_closest_nodes);
+    if (matrix_change_functor_)
+      matrix_change_functor_(matrix_change);
+    IpcSendGroupMatrix();
   }
-  return return_value;
+
+  if (remove_furthest_node) {
+    LOG(kVerbose) << "[" << DebugId(kNodeId_) <<  "] Removing furthest node....";
+    if (remove_furthest_node_)
+      remove_furthest_node_();
+  }
+  LogRoutingTableIfDue();
+  return added_nodes;
 }
 
 NodeInfo RoutingTable::DropNode(const NodeId& node_to_drop, bool routing_only) {
@@ -207,26 +354,32 @@ NodeInfo RoutingTable::DropNode(const NodeId& node_to_drop, bool routing_only) {
   MatrixChange matrix_change;
   std::vector<NodeId> unique_nodes;
   bool close_nodes_changed(false);
+  uint16_t routing_table_size(0);
   {
     std::unique_lock<std::mutex> lock(mutex_);
     auto found(Find(node_to_drop, lock));
     if (found.first) {
-      dropped_node = *found.second;
-      nodes_.erase(found.second);
+      dropped_node = *found.second->info;
+      EraseNode(found.second, lock);
       old_connected_close_nodes = group_matrix_.GetConnectedPeers();
       group_matrix_.RemoveConnectedPeer(dropped_node, matrix_change);
+      group_matrix_snapshot_.reset();
       new_connected_close_nodes = group_matrix_.GetConnectedPeers();
       if (new_connected_close_nodes.size() != old_connected_close_nodes.size()) {
         close_nodes_changed = true;
         if (nodes_.size() >= Parameters::closest_nodes_size) {
-          PartialSortFromTarget(kNodeId_, Parameters::closest_nodes_size, lock);
-          group_matrix_.AddConnectedPeer(nodes_[Parameters::closest_nodes_size - 1]);
+          group_matrix_.AddConnectedPeer(*nodes_[Parameters::closest_nodes_size - 1].info);
           new_connected_close_nodes = group_matrix_.GetConnectedPeers();
+          matrix_change = group_matrix_.GetMatrixChange(matrix_change.old_matrix);
         }
       }
+      PublishSnapshot(lock);
     }
+    routing_table_size = static_cast<uint16_t>(nodes_.size());
     unique_nodes = group_matrix_.GetUniqueNodeIds();
   }
+  if (!dropped_node.node_id.IsZero())
+    network_statistics_.RemoveRoundTripTime(dropped_node.node_id);
 
   if (close_nodes_changed && connected_group_change_functor_)
     connected_group_change_functor_(new_connected_close_nodes);
@@ -240,10 +393,8 @@ NodeInfo RoutingTable::DropNode(const NodeId& node_to_drop, bool routing_only) {
     IpcSendGroupMatrix();
   }
 
-  if (!dropped_node.node_id.IsZero()) {
-    assert(nodes_.size() <= std::numeric_limits<uint16_t>::max());
-    UpdateNetworkStatus(static_cast<uint16_t>(nodes_.size()));
-  }
+  if (!dropped_node.node_id.IsZero())
+    UpdateNetworkStatus(routing_table_size);
 
   if (!dropped_node.node_id.IsZero()) {
     LOG(kVerbose) << "Routing table dropped node id : " << DebugId(dropped_node.node_id)
@@ -251,22 +402,35 @@ NodeInfo RoutingTable::DropNode(const NodeId& node_to_drop, bool routing_only) {
     if (remove_node_functor_ && !routing_only)
       remove_node_functor_(dropped_node, false);
   }
-  LOG(kInfo) << PrintRoutingTable();
+  LogRoutingTableIfDue();
   return dropped_node;
 }
 
-bool RoutingTable::IsThisNodeGroupLeader(const NodeId& target_id, NodeInfo& connected_peer) {
+NodeInfo RoutingTable::DropConnection(const NodeId& connection_to_drop, bool routing_only) {
+  NodeInfo node_info;
+  if (!GetNodeInfoForConnection(connection_to_drop, node_info))
+    return NodeInfo();
+  return DropNode(node_info.node_id, routing_only);
+}
+
+bool RoutingTable::IsThisNodeGroupLeader(const NodeId& target_id, NextHop& connected_peer) {
+  return IsThisNodeGroupLeader(*GetSnapshot(), target_id, connected_peer);
+}
+
+bool RoutingTable::IsThisNodeGroupLeader(const Snapshot& snapshot,
+                                         const NodeId& target_id,
+                                         NextHop& connected_peer) const {
   NodeId current_closest_id(kNodeId_);
-  NodeId closest_peer_id(GetClosestNode(target_id, true).node_id);
+  const Entry* closest_peer(GetClosestNode(snapshot, target_id, true));
+  NodeId closest_peer_id(closest_peer ? closest_peer->node_id : NodeId());
   if (NodeId::CloserToTarget(closest_peer_id, current_closest_id, target_id))
     current_closest_id = closest_peer_id;
 
-  std::unique_lock<std::mutex> lock(mutex_);
-  group_matrix_.GetBetterNodeForSendingMessage(target_id, true, current_closest_id);
+  snapshot.group_matrix->GetBetterNodeForSendingMessage(target_id, true, current_closest_id);
   if (current_closest_id != kNodeId_) {
-    auto found(Find(current_closest_id, lock));
+    auto found(Find(current_closest_id, snapshot));
     if (found.first) {
-      connected_peer = *found.second;
+      connected_peer = found.second->next_hop();
       return false;
     }
   }
@@ -274,171 +438,202 @@ bool RoutingTable::IsThisNodeGroupLeader(const NodeId& target_id, NodeInfo& conn
 }
 
 bool RoutingTable::IsThisNodeGroupLeader(const NodeId& target_id,
-                                         NodeInfo& connected_peer,
+                                         NextHop& connected_peer,
                                          const std::vector<std::string>& exclude) {
-  NodeInfo current_closest;
-  current_closest.node_id = kNodeId_;
-  NodeInfo closest_peer(GetClosestNode(target_id, exclude, true));
+  return IsThisNodeGroupLeader(target_id, connected_peer, PackNodeIds(exclude));
+}
+
+bool RoutingTable::IsThisNodeGroupLeader(const NodeId& target_id,
+                                         NextHop& connected_peer,
+                                         const std::string& packed_exclude) {
+  return IsThisNodeGroupLeader(*GetSnapshot(), target_id, connected_peer, packed_exclude);
+}
+
+bool RoutingTable::IsThisNodeGroupLeader(const Snapshot& snapshot,
+                                         const NodeId& target_id,
+                                         NextHop& connected_peer,
+                                         const std::string& packed_exclude) const {
+  NextHop current_closest(kNodeId_, NodeId());
+  const Entry* closest_peer_entry(GetClosestNode(snapshot, target_id, packed_exclude, true));
+  NextHop closest_peer(closest_peer_entry ? closest_peer_entry->next_hop() : NextHop());
   if (NodeId::CloserToTarget(closest_peer.node_id, current_closest.node_id, target_id))
     current_closest = closest_peer;
 
-  std::unique_lock<std::mutex> lock(mutex_);
-  group_matrix_.GetBetterNodeForSendingMessage(target_id, exclude, true, current_closest);
+  snapshot.group_matrix->GetBetterNodeForSendingMessage(target_id, packed_exclude, true,
+                                                       current_closest);
   if (current_closest.node_id != kNodeId_) {
-    auto found(Find(current_closest.node_id, lock));
+    auto found(Find(current_closest.node_id, snapshot));
     if (found.first) {
-      connected_peer = *found.second;
+      connected_peer = found.second->next_hop();
       return false;
     }
   }
-  for (const auto& excluded : exclude) {
-    try {
-      NodeId excluded_id(excluded);
-      if (excluded_id != target_id && NodeId::CloserToTarget(excluded_id, kNodeId_, target_id)) {
-        if (connected_peer.node_id.IsZero())
-          connected_peer = closest_peer;
-        return false;
-      }
-    } catch(const std::exception& ex) {
-      LOG(kError) << "Got invalid string for Node ID. Exception: " << ex.what();
+  for (size_t offset(0); offset + NodeId::kSize <= packed_exclude.size();
+       offset += NodeId::kSize) {
+    NodeId excluded_id(packed_exclude.substr(offset, NodeId::kSize));
+    if (excluded_id != target_id && NodeId::CloserToTarget(excluded_id, kNodeId_, target_id)) {
+      if (connected_peer.node_id.IsZero())
+        connected_peer = closest_peer;
+      return false;
     }
   }
   return true;
 }
 
 bool RoutingTable::ClosestToId(const NodeId& target_id) {
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
+  if (target_id == kNodeId_)
+    return false;
 
-    if (target_id == kNodeId_)
-      return false;
+  SnapshotPtr snapshot(GetSnapshot());
+  if (snapshot->nodes.empty())
+    return true;
 
-    if (nodes_.empty())
+  auto closest_nodes(GetClosestNodesTo(snapshot->nodes, target_id, 2));
+  if (closest_nodes.size() == 1) {
+    if (closest_nodes.at(0)->node_id == target_id)
       return true;
-
-    if (nodes_.size() == 1) {
-      if (nodes_.at(0).node_id == target_id)
-        return true;
-      else
-        return NodeId::CloserToTarget(kNodeId_, nodes_.at(0).node_id, target_id);
-    }
-
-    PartialSortFromTarget(target_id, 2, lock);
-    uint16_t index(0);
-    if (nodes_.at(0).node_id == target_id)
-      index = 1;
-    if (!NodeId::CloserToTarget(kNodeId_, nodes_.at(index).node_id, target_id))
-      return false;
+    else
+      return NodeId::CloserToTarget(kNodeId_, closest_nodes.at(0)->node_id, target_id);
   }
-  return group_matrix_.ClosestToId(target_id);
+
+  uint16_t index(0);
+  if (closest_nodes.at(0)->node_id == target_id)
+    index = 1;
+  if (!NodeId::CloserToTarget(kNodeId_, closest_nodes.at(index)->node_id, target_id))
+    return false;
+  return snapshot->group_matrix->ClosestToId(target_id);
 }
 
 GroupRangeStatus RoutingTable::IsNodeIdInGroupRange(const NodeId& target_id) {
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (group_matrix_.IsNodeIdInGroupRange(target_id))
-      return GroupRangeStatus::kInRange;
-  }
-  NodeId radius_id(kNodeId_ ^ FurthestCloseNode());
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    NodeId distance_id(kNodeId_ ^ target_id);
-    crypto::BigInt radius((radius_id.ToStringEncoded(NodeId::kHex) + 'h').c_str());
-    crypto::BigInt distance((distance_id.ToStringEncoded(NodeId::kHex) + 'h').c_str());
+  SnapshotPtr snapshot(GetSnapshot());
+  if (snapshot->group_matrix->IsNodeIdInGroupRange(target_id))
+    return GroupRangeStatus::kInRange;
 
-    if (distance > Parameters::proximity_factor * radius)
-      return GroupRangeStatus::kOutwithRange;
+  Distance radius(kNodeId_ ^ FurthestCloseNode(*snapshot));
+  Distance distance(kNodeId_ ^ target_id);
 
-    return GroupRangeStatus::kInProximalRange;
-  }
+  if (distance > radius * Parameters::proximity_factor)
+    return GroupRangeStatus::kOutwithRange;
+
+  return GroupRangeStatus::kInProximalRange;
 }
 
 NodeId RoutingTable::RandomConnectedNode() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  assert(nodes_.size() > Parameters::closest_nodes_size &&
+  SnapshotPtr snapshot(GetSnapshot());
+  const std::vector<Entry>& nodes(snapshot->nodes);
+  assert(nodes.size() > Parameters::closest_nodes_size &&
          "Shouldn't call RandomConnectedNode when routing table size is <= closest_nodes_size");
-  if (nodes_.size() <= Parameters::closest_nodes_size)
+  if (nodes.size() <= Parameters::closest_nodes_size)
     return NodeId();
 
-  PartialSortFromTarget(kNodeId_, static_cast<uint16_t>(nodes_.size()), lock);
   size_t index(Parameters::closest_nodes_size +
-               RandomUint32() % (nodes_.size() - Parameters::closest_nodes_size));
-  return nodes_.at(index).node_id;
+               RandomUint32() % (nodes.size() - Parameters::closest_nodes_size));
+  return nodes.at(index).node_id;
 }
 
 std::vector<NodeInfo> RoutingTable::GetMatrixNodes() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return group_matrix_.GetUniqueNodes();
+  return GetSnapshot()->group_matrix->GetUniqueNodes();
 }
 
 bool RoutingTable::IsConnected(const NodeId& node_id) {
-  if (Contains(node_id))
-    return true;
-  std::unique_lock<std::mutex> lock(mutex_);
-  return group_matrix_.Contains(node_id);
+  SnapshotPtr snapshot(GetSnapshot());
+  return Find(node_id, *snapshot).first || snapshot->group_matrix->Contains(node_id);
 }
 
 bool RoutingTable::GetNodeInfo(const NodeId& node_id, NodeInfo& peer) const {
-  std::unique_lock<std::mutex> lock(mutex_);
-  auto found(Find(node_id, lock));
+  return GetNodeInfo(*GetSnapshot(), node_id, peer);
+}
+
+bool RoutingTable::GetNodeInfo(const Snapshot& snapshot,
+                               const NodeId& node_id,
+                               NodeInfo& peer) const {
+  auto found(Find(node_id, snapshot));
   if (found.first)
-    peer = *found.second;
+    peer = *found.second->info;
   return found.first;
 }
 
+bool RoutingTable::GetNodeInfoForConnection(const NodeId& connection_id, NodeInfo& peer) const {
+  SnapshotPtr snapshot(GetSnapshot());
+  auto found(snapshot->connection_index.find(connection_id));
+  if (found == snapshot->connection_index.end())
+    return false;
+  peer = *snapshot->nodes[found->second].info;
+  return true;
+}
+
 bool RoutingTable::IsThisNodeInRange(const NodeId& target_id, const uint16_t range) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  if (nodes_.size() < range)
+  return IsThisNodeInRange(*GetSnapshot(), target_id, range);
+}
+
+bool RoutingTable::IsThisNodeInRange(const Snapshot& snapshot,
+                                     const NodeId& target_id,
+                                     const uint16_t range) const {
+  if (snapshot.nodes.size() < range)
     return true;
-  NthElementSortFromTarget(kNodeId_, range, lock);
-  return NodeId::CloserToTarget(target_id, nodes_[range - 1].node_id, kNodeId_);
+  return NodeId::CloserToTarget(target_id, snapshot.nodes[range - 1].node_id, kNodeId_);
 }
 
 bool RoutingTable::IsThisNodeClosestTo(const NodeId& target_id, bool ignore_exact_match) {
+  return IsThisNodeClosestTo(*GetSnapshot(), target_id, ignore_exact_match);
+}
+
+bool RoutingTable::IsThisNodeClosestTo(const Snapshot& snapshot,
+                                       const NodeId& target_id,
+                                       bool ignore_exact_match) const {
   if (target_id.IsZero()) {
     LOG(kError) << "Invalid target_id passed.";
     return false;
   }
-  NodeInfo closest_node(GetClosestNode(target_id, ignore_exact_match));
-  return (closest_node.bucket == NodeInfo::kInvalidBucket) ||
-         NodeId::CloserToTarget(kNodeId_, closest_node.node_id, target_id);
+  const Entry* closest_node(GetClosestNode(snapshot, target_id, ignore_exact_match));
+  return !closest_node || NodeId::CloserToTarget(kNodeId_, closest_node->node_id, target_id);
 }
 
 bool RoutingTable::IsThisNodeClosestToIncludingMatrix(const NodeId& target_id,
                                                       bool ignore_exact_match) {
+  return IsThisNodeClosestToIncludingMatrix(*GetSnapshot(), target_id, ignore_exact_match);
+}
+
+bool RoutingTable::IsThisNodeClosestToIncludingMatrix(const Snapshot& snapshot,
+                                                      const NodeId& target_id,
+                                                      bool ignore_exact_match) const {
   if (target_id.IsZero()) {
     LOG(kError) << "Invalid target_id passed.";
     return false;
   }
-  NodeInfo closest_node(GetClosestNode(target_id, ignore_exact_match));
-  std::unique_lock<std::mutex> lock(mutex_);
+  const Entry* closest_node(GetClosestNode(snapshot, target_id, ignore_exact_match));
 
-  if (closest_node.bucket == NodeInfo::kInvalidBucket)
+  if (!closest_node)
     return true;  // ?
 
-  if (!NodeId::CloserToTarget(kNodeId_, closest_node.node_id, target_id))
+  if (!NodeId::CloserToTarget(kNodeId_, closest_node->node_id, target_id))
     return false;
 
   NodeId connected_peer;
-  return group_matrix_.IsThisNodeGroupLeader(target_id, connected_peer);  // use connected peer?
+  return snapshot.group_matrix->IsThisNodeGroupLeader(target_id,
+                                                     connected_peer);  // use connected peer?
 }
 
 bool RoutingTable::Contains(const NodeId& node_id) const {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return Find(node_id, lock).first;
+  return Contains(*GetSnapshot(), node_id);
+}
+
+bool RoutingTable::Contains(const Snapshot& snapshot, const NodeId& node_id) const {
+  return Find(node_id, snapshot).first;
 }
 
 bool RoutingTable::ConfirmGroupMembers(const NodeId& node1, const NodeId& node2) {
-  NodeId difference = kNodeId_ ^ FurthestCloseNode();
+  NodeId difference = kNodeId_ ^ FurthestCloseNode(*GetSnapshot());
   return (node1 ^ node2) < difference;
 }
 
 void RoutingTable::GroupUpdateFromConnectedPeer(const NodeId& peer,
-                                                const std::vector<NodeInfo>& nodes) {
+                                                const std::vector<NodeInfo>& nodes,
+                                                uint64_t version) {
   MatrixChange matrix_change;
   {
     std::unique_lock<std::mutex> lock(mutex_);
-    matrix_change.old_matrix = group_matrix_.GetUniqueNodeIds();
+    MatrixChange::Snapshot old_matrix(group_matrix_.GetUniqueNodeIdsSnapshot());
     auto connected_peers(group_matrix_.GetConnectedPeers());
     if (std::find_if(connected_peers.begin(),
                      connected_peers.end(),
@@ -448,66 +643,91 @@ void RoutingTable::GroupUpdateFromConnectedPeer(const NodeId& peer,
       auto found(Find(peer, lock));
       if (!found.first)
         return;
-      group_matrix_.AddConnectedPeer(*found.second);
+      group_matrix_.AddConnectedPeer(*found.second->info);
     }
-    group_matrix_.UpdateFromConnectedPeer(peer, nodes);
-    matrix_change.new_matrix = group_matrix_.GetUniqueNodeIds();
+    group_matrix_.UpdateFromConnectedPeer(peer, nodes, version);
+    group_matrix_snapshot_.reset();
+    matrix_change = group_matrix_.GetMatrixChange(old_matrix);
+    PublishSnapshot(lock);
   }
   if (!matrix_change.OldEqualsToNew() && matrix_change_functor_)
     matrix_change_functor_(matrix_change);
 }
 
-void RoutingTable::UpdateCloseNodeChange(std::unique_lock<std::mutex>& lock,
-                                         const NodeInfo& peer,
-                                         std::vector<NodeInfo>& new_connected_nodes,
-                                         MatrixChange& matrix_change) {
-  assert(lock.owns_lock());
-  PartialSortFromTarget(kNodeId_, Parameters::closest_nodes_size, lock);
-  matrix_change.old_matrix = group_matrix_.GetUniqueNodeIds();
-  if ((nodes_.size() < Parameters::closest_nodes_size ||
-      !NodeId::CloserToTarget(nodes_[Parameters::closest_nodes_size - 1].node_id,
-                              peer.node_id,
-                              kNodeId_))) {
-    group_matrix_.AddConnectedPeer(peer);
+bool RoutingTable::GroupUpdateFromConnectedPeer(const NodeId& peer,
+                                                const std::vector<NodeInfo>& added_nodes,
+                                                const std::vector<NodeId>& removed_nodes,
+                                                uint64_t base_version,
+                                                uint64_t version) {
+  MatrixChange matrix_change;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!Find(peer, lock).first)
+      return true;
+    MatrixChange::Snapshot old_matrix(group_matrix_.GetUniqueNodeIdsSnapshot());
+    if (!group_matrix_.UpdateFromConnectedPeer(peer, added_nodes, removed_nodes, base_version,
+                                               version)) {
+      return false;
+    }
+    group_matrix_snapshot_.reset();
+    matrix_change = group_matrix_.GetMatrixChange(old_matrix);
+    PublishSnapshot(lock);
   }
-  group_matrix_.Prune();
-  matrix_change.new_matrix = group_matrix_.GetUniqueNodeIds();
-  new_connected_nodes = group_matrix_.GetConnectedPeers();
+  if (!matrix_change.OldEqualsToNew() && matrix_change_functor_)
+    matrix_change_functor_(matrix_change);
+  return true;
 }
 
 // bucket 0 is us, 511 is furthest bucket (should fill first)
 void RoutingTable::SetBucketIndex(NodeInfo &node_info) const {
-  std::string holder_raw_id(kNodeId_.string());
-  std::string node_raw_id(node_info.node_id.string());
-  int16_t byte_index(0);
-  while (byte_index != NodeId::kSize) {
-    if (holder_raw_id[byte_index] != node_raw_id[byte_index]) {
-      std::bitset<8> holder_byte(static_cast<int>(holder_raw_id[byte_index]));
-      std::bitset<8> node_byte(static_cast<int>(node_raw_id[byte_index]));
-      int16_t bit_index(0);
-      while (bit_index != 8U) {
-        if (holder_byte[7U - bit_index] != node_byte[7U - bit_index])
-          break;
-        ++bit_index;
-      }
-      node_info.bucket = (8 * (NodeId::kSize - byte_index)) - bit_index - 1;
+  const NodeIdWords node_words(ToWords(node_info.node_id));
+  for (size_t i(0); i != node_words.size(); ++i) {
+    uint64_t difference(kNodeIdWords_[i] ^ node_words[i]);
+    if (difference != 0) {
+      node_info.bucket = static_cast<int32_t>(8 * NodeId::kSize - 1 -
+                                              (64 * i + CountLeadingZeros(difference)));
       return;
     }
-    ++byte_index;
   }
   node_info.bucket = 0;
 }
 
-bool RoutingTable::CheckPublicKeyIsUnique(const NodeInfo& node,
+// Repeat adds of the same key (e.g. a reconnecting peer) are answered from validated_keys_ rather
+// than by validating the key again.
+bool RoutingTable::ValidatePublicKey(const NodeInfo& node, std::string& key_fingerprint) {
+  try {
+    key_fingerprint = KeyFingerprint(node.public_key);
+  }
+  catch(const std::exception& e) {
+    LOG(kWarning) << "Failed to encode public key for node " << DebugId(node.node_id) << ": "
+                  << e.what();
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(validated_keys_mutex_);
+    if (validated_keys_.count(key_fingerprint) != 0)
+      return true;
+  }
+  if (!asymm::ValidateKey(node.public_key))
+    return false;
+  std::lock_guard<std::mutex> lock(validated_keys_mutex_);
+  if (Parameters::validated_key_cache_size == 0 ||
+      !validated_keys_.insert(key_fingerprint).second)
+    return true;
+  validated_keys_order_.push_back(key_fingerprint);
+  if (validated_keys_order_.size() > Parameters::validated_key_cache_size) {
+    validated_keys_.erase(validated_keys_order_.front());
+    validated_keys_order_.pop_front();
+  }
+  return true;
+}
+
+bool RoutingTable::CheckPublicKeyIsUnique(const std::string& key_fingerprint,
                                           std::unique_lock<std::mutex>& lock) const {
   assert(lock.owns_lock());
   static_cast<void>(lock);
   // If we already have a duplicate public key return false
-  if (std::find_if(nodes_.begin(),
-                   nodes_.end(),
-                   [node](const NodeInfo& node_info) {
-                     return asymm::MatchingKeys(node_info.public_key, node.public_key);
-                   }) != nodes_.end()) {
+  if (key_fingerprint_set_.count(key_fingerprint) != 0) {
     LOG(kInfo) << "Already have node with this public key";
     return false;
   }
@@ -534,102 +754,245 @@ bool RoutingTable::MakeSpaceForNodeToBeAdded(const NodeInfo& node,
                                              std::unique_lock<std::mutex>& lock) {
   assert(lock.owns_lock());
 
-  if (remove && !CheckPublicKeyIsUnique(node, lock))
-    return false;
-
   if (nodes_.size() < kMaxSize_)
     return true;
 
-  PartialSortFromTarget(kNodeId_, Parameters::closest_nodes_size, lock);
-  NodeInfo furthest_close_node = nodes_[Parameters::closest_nodes_size - 1];
-  auto const furthest_close_node_iter = nodes_.begin() + (Parameters::closest_nodes_size - 1);
+  auto const furthest_close_node(nodes_.begin() + (Parameters::closest_nodes_size - 1));
 
-  if (NodeId::CloserToTarget(node.node_id, furthest_close_node.node_id, kNodeId_)) {
+  if (NodeId::CloserToTarget(node.node_id, furthest_close_node->node_id, kNodeId_)) {
     if (remove) {
-      assert(node.bucket <= furthest_close_node.bucket &&
+      assert(node.bucket <= furthest_close_node->bucket &&
              "close node replacement to higher bucket");
-      removed_node = *furthest_close_node_iter;
-      nodes_.erase(furthest_close_node_iter);
+      removed_node = *furthest_close_node->info;
+      EraseNode(furthest_close_node, lock);
     }
     return true;
   }
 
-  uint16_t size(Parameters::bucket_target_size + 1);
-  for (auto it = furthest_close_node_iter; it != nodes_.end(); ++it) {
-    if (node.bucket >= (*it).bucket)  // Stop searching as it's worthless
-      return false;
-    // Safety net
-    if ((nodes_.end() - it) < size)  // Reached end of checkable area
+  // Walking outwards from the furthest close node, the first bucket above the new node's own which
+  // holds more than bucket_target_size nodes gives up its closest member.
+  for (auto bucket(bucket_occupancy_.lower_bound(furthest_close_node->bucket));
+       bucket != bucket_occupancy_.end();
+       ++bucket) {
+    if (node.bucket >= bucket->first)  // Stop searching as it's worthless
       return false;
-
-    if ((*it).bucket == (*(it + size)).bucket) {
-      // Here we know the node should fit into a bucket if the bucket has too many nodes AND node to
-      // add has a lower bucket index
-      assert(node.bucket < (*it).bucket);
-      if (remove) {
-        removed_node = *it;
-        nodes_.erase(it);
-      }
-      return true;
+    if (bucket->second <= Parameters::bucket_target_size)
+      continue;
+    if (remove) {
+      auto bucket_begin(std::lower_bound(nodes_.begin(), nodes_.end(), bucket->first,
+                                         [](const Entry& entry, int32_t bucket_index) {
+                                           return entry.bucket < bucket_index;
+                                         }));
+      assert(bucket_begin != nodes_.end() && bucket_begin->bucket == bucket->first);
+      removed_node = *bucket_begin->info;
+      EraseNode(bucket_begin, lock);
     }
+    return true;
   }
   return false;
 }
 
-uint16_t RoutingTable::PartialSortFromTarget(const NodeId& target,
-                                             uint16_t number,
-                                             std::unique_lock<std::mutex>& lock) {
+void RoutingTable::InsertNode(const NodeInfo& peer,
+                              const std::string& key_fingerprint,
+                              std::unique_lock<std::mutex>& lock) {
   assert(lock.owns_lock());
   static_cast<void>(lock);
-  uint16_t count = std::min(number, static_cast<uint16_t>(nodes_.size()));
-  std::partial_sort(nodes_.begin(),
-                    nodes_.begin() + count,
-                    nodes_.end(),
-                    [target](const NodeInfo& lhs, const NodeInfo& rhs) {
-                      return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, target);
+  auto itr(nodes_.insert(std::upper_bound(nodes_.begin(),
+                                          nodes_.end(),
+                                          peer.node_id,
+                                          [this](const NodeId& node_id, const Entry& entry) {
+                                            return NodeId::CloserToTarget(node_id, entry.node_id,
+                                                                          kNodeId_);
+                                          }),
+                         Entry(peer)));
+  ++bucket_occupancy_[peer.bucket];
+  key_fingerprints_.insert(std::make_pair(peer.node_id, key_fingerprint));
+  key_fingerprint_set_.insert(key_fingerprint);
+  change_log_.Record(RoutingTableChange(RoutingTableChange::Type::kAdded, peer.node_id, peer.bucket,
+                                        static_cast<uint16_t>(itr - nodes_.begin()),
+                                        static_cast<uint16_t>(nodes_.size())));
+}
+
+void RoutingTable::EraseNode(std::vector<Entry>::iterator itr,
+                             std::unique_lock<std::mutex>& lock) {
+  assert(lock.owns_lock());
+  static_cast<void>(lock);
+  auto bucket(bucket_occupancy_.find(itr->bucket));
+  assert(bucket != bucket_occupancy_.end());
+  if (--bucket->second == 0)
+    bucket_occupancy_.erase(bucket);
+  auto key_fingerprint(key_fingerprints_.find(itr->node_id));
+  assert(key_fingerprint != key_fingerprints_.end());
+  key_fingerprint_set_.erase(key_fingerprint->second);
+  key_fingerprints_.erase(key_fingerprint);
+  RoutingTableChange change(RoutingTableChange::Type::kRemoved, itr->node_id, itr->bucket,
+                            static_cast<uint16_t>(itr - nodes_.begin()),
+                            static_cast<uint16_t>(nodes_.size() - 1));
+  nodes_.erase(itr);
+  change_log_.Record(change);
+}
+
+// Since nodes are ordered by distance from kNodeId_, every node in the target's own bucket is
+// closer to the target than any node in a lower bucket, which in turn are all closer than any node
+// in a higher bucket (and higher buckets are ordered amongst themselves).  Candidates are collected
+// in that order until enough are held, so only those few pointers need ordering and nodes itself
+// is never modified.
+std::vector<const RoutingTable::Entry*> RoutingTable::GetClosestNodesTo(
+    const std::vector<Entry>& nodes,
+    const NodeId& target,
+    size_t number_to_get) const {
+  std::vector<const Entry*> closest_nodes;
+  size_t count(std::min(number_to_get, nodes.size()));
+  if (count == 0)
+    return closest_nodes;
+  closest_nodes.reserve(count);
+  auto add_range([&closest_nodes](std::vector<Entry>::const_iterator first,
+                                  std::vector<Entry>::const_iterator last) {
+    for (; first != last; ++first)
+      closest_nodes.push_back(&*first);
+  });
+  auto bucket_less([](const Entry& entry, int32_t bucket) {
+    return entry.bucket < bucket;
+  });
+  auto bucket_greater([](int32_t bucket, const Entry& entry) {
+    return bucket < entry.bucket;
+  });
+
+  if (target == kNodeId_) {
+    add_range(nodes.begin(), nodes.begin() + count);
+    return closest_nodes;
+  }
+
+  NodeInfo target_info;
+  target_info.node_id = target;
+  SetBucketIndex(target_info);
+  auto bucket_begin(std::lower_bound(nodes.begin(), nodes.end(), target_info.bucket,
+                                     bucket_less));
+  auto bucket_end(std::upper_bound(bucket_begin, nodes.end(), target_info.bucket,
+                                   bucket_greater));
+  add_range(bucket_begin, bucket_end);
+  if (closest_nodes.size() < count)
+    add_range(nodes.begin(), bucket_begin);
+  while (closest_nodes.size() < count) {
+    auto next_bucket_end(std::upper_bound(bucket_end, nodes.end(), bucket_end->bucket,
+                                          bucket_greater));
+    add_range(bucket_end, next_bucket_end);
+    bucket_end = next_bucket_end;
+  }
+
+  std::partial_sort(closest_nodes.begin(),
+                    closest_nodes.begin() + count,
+                    closest_nodes.end(),
+                    [&target](const Entry* lhs, const Entry* rhs) {
+                      return NodeId::CloserToTarget(lhs->node_id, rhs->node_id, target);
                     });
-  return count;
+  closest_nodes.resize(count);
+  return closest_nodes;
 }
 
-void RoutingTable::NthElementSortFromTarget(const NodeId& target,
-                                            uint16_t nth_element,
-                                            std::unique_lock<std::mutex>& lock) {
+void RoutingTable::PublishSnapshot(std::unique_lock<std::mutex>& lock) {
   assert(lock.owns_lock());
   static_cast<void>(lock);
-  assert((nodes_.size() >= nth_element) &&
-         "This should only be called when n is at max the size of RT");
-  std::nth_element(nodes_.begin(),
-                   nodes_.begin() + nth_element - 1,
-                   nodes_.end(),
-                   [target](const NodeInfo& lhs, const NodeInfo& rhs) {
-                     return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, target);
-                   });
+  if (!group_matrix_snapshot_)
+    group_matrix_snapshot_.reset(new GroupMatrix(group_matrix_));
+  std::atomic_store(&snapshot_, SnapshotPtr(new Snapshot(++epoch_, nodes_, group_matrix_snapshot_,
+                                                        kNodeId_)));
 }
 
-NodeId RoutingTable::FurthestCloseNode() {
-  return GetNthClosestNode(kNodeId_, Parameters::closest_nodes_size).node_id;
+RoutingTable::SnapshotPtr RoutingTable::GetSnapshot() const {
+  return std::atomic_load(&snapshot_);
 }
 
-NodeInfo RoutingTable::GetClosestNode(const NodeId& target_id, bool ignore_exact_match) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  int sorted_count(PartialSortFromTarget(target_id, 2, lock));
-  if (sorted_count == 0)
-    return NodeInfo();
-  if (ignore_exact_match && (nodes_[0].node_id == target_id))
-    return (sorted_count == 1) ? NodeInfo() : nodes_[1];
-  return nodes_[0];
-}
-
-NodeInfo RoutingTable::GetClosestNode(const NodeId& target_id,
-                                      const std::vector<std::string>& exclude,
-                                      bool ignore_exact_match) {
-  std::vector<NodeInfo> closest_nodes(
-      GetClosestNodeInfo(target_id, Parameters::closest_nodes_size, ignore_exact_match));
-  for (const auto& node_info : closest_nodes) {
-    if (std::find(exclude.begin(), exclude.end(), node_info.node_id.string()) == exclude.end())
-      return node_info;
+NodeId RoutingTable::FurthestCloseNode(const Snapshot& snapshot) const {
+  return GetNthClosestNode(snapshot, kNodeId_, Parameters::closest_nodes_size).node_id;
+}
+
+NextHop RoutingTable::GetClosestNode(const NodeId& target_id, bool ignore_exact_match) {
+  SnapshotPtr snapshot(GetSnapshot());
+  const Entry* closest_node(GetClosestNode(*snapshot, target_id, ignore_exact_match));
+  return closest_node ? closest_node->next_hop() : NextHop();
+}
+
+const RoutingTable::Entry* RoutingTable::GetClosestNode(const Snapshot& snapshot,
+                                                        const NodeId& target_id,
+                                                        bool ignore_exact_match) const {
+  auto closest_nodes(GetClosestNodesTo(snapshot.nodes, target_id, 2));
+  if (closest_nodes.empty())
+    return nullptr;
+  if (ignore_exact_match && (closest_nodes[0]->node_id == target_id))
+    return (closest_nodes.size() == 1) ? nullptr : closest_nodes[1];
+  return closest_nodes[0];
+}
+
+NextHop RoutingTable::GetClosestNode(const NodeId& target_id,
+                                     const std::vector<std::string>& exclude,
+                                     bool ignore_exact_match) {
+  SnapshotPtr snapshot(GetSnapshot());
+  const Entry* closest_node(GetClosestNode(*snapshot, target_id, PackNodeIds(exclude),
+                                           ignore_exact_match));
+  return closest_node ? closest_node->next_hop() : NextHop();
+}
+
+const RoutingTable::Entry* RoutingTable::GetClosestNode(const Snapshot& snapshot,
+                                                        const NodeId& target_id,
+                                                        const std::string& packed_exclude,
+                                                        bool ignore_exact_match) const {
+  for (const auto& entry : GetClosestEntries(snapshot, target_id, Parameters::closest_nodes_size,
+                                             ignore_exact_match)) {
+    if (!PackedNodeIdsContain(packed_exclude, entry->node_id))
+      return entry;
+  }
+  return nullptr;
+}
+
+const RoutingTable::Entry* RoutingTable::GetLowLatencyNode(
+    const Snapshot& snapshot,
+    const NodeId& target_id,
+    const std::string& packed_exclude,
+    bool ignore_exact_match,
+    std::vector<NodeId>* ranked_ids) const {
+  std::vector<const Entry*> candidates;
+  for (const auto& entry : GetClosestEntries(snapshot, target_id, Parameters::closest_nodes_size,
+                                             ignore_exact_match)) {
+    if (PackedNodeIdsContain(packed_exclude, entry->node_id))
+      continue;
+    bool makes_progress(NodeId::CloserToTarget(entry->node_id, kNodeId_, target_id));
+    // As GetClosestNode if the target itself is connected or no peer is closer to it than us.
+    if (candidates.empty() && (entry->node_id == target_id || !makes_progress))
+      return entry;
+    if (!makes_progress)
+      break;
+    candidates.push_back(entry);
+    if (candidates.size() >= Parameters::proximity_routing_candidates)
+      break;
   }
-  return NodeInfo();
+  if (candidates.empty())
+    return nullptr;
+  if (ranked_ids && candidates.size() > 1) {
+    for (const auto& candidate : candidates)
+      ranked_ids->push_back(candidate->node_id);
+  }
+
+  // Peers without a measured round trip time are ranked as the slowest measured candidate, so
+  // XOR order decides between them.
+  std::vector<boost::posix_time::time_duration> round_trip_times;
+  boost::posix_time::time_duration slowest(boost::posix_time::not_a_date_time);
+  for (const auto& candidate : candidates) {
+    round_trip_times.push_back(network_statistics_.GetRoundTripTime(candidate->node_id));
+    if (!round_trip_times.back().is_special() &&
+        (slowest.is_special() || round_trip_times.back() > slowest))
+      slowest = round_trip_times.back();
+  }
+  if (slowest.is_special())
+    return candidates.front();
+  size_t fastest(0);
+  for (size_t i(0); i != candidates.size(); ++i) {
+    if (round_trip_times.at(i).is_special())
+      round_trip_times.at(i) = slowest;
+    if (round_trip_times.at(i) < round_trip_times.at(fastest))
+      fastest = i;
+  }
+  return candidates.at(fastest);
 }
 
 /*
@@ -648,35 +1011,75 @@ NodeInfo RoutingTable::GetNodeForSendingMessage(const NodeId& target_id,
 }
 */
 
-NodeInfo RoutingTable::GetNodeForSendingMessage(const NodeId& target_id,
-                                                const std::vector<std::string>& exclude,
-                                                bool ignore_exact_match) {
-  NodeInfo current_peer(GetClosestNode(target_id, exclude, ignore_exact_match));
-  std::unique_lock<std::mutex> lock(mutex_);
+NextHop RoutingTable::GetNodeForSendingMessage(const NodeId& target_id,
+                                               const std::vector<std::string>& exclude,
+                                               bool ignore_exact_match) {
+  return GetNodeForSendingMessage(target_id, PackNodeIds(exclude), ignore_exact_match);
+}
+
+NextHop RoutingTable::GetNodeForSendingMessage(const NodeId& target_id,
+                                               const std::string& packed_exclude,
+                                               bool ignore_exact_match) {
+  return GetNodeForSendingMessage(*GetSnapshot(), target_id, packed_exclude, ignore_exact_match);
+}
+
+NextHop RoutingTable::GetNodeForSendingMessage(const Snapshot& snapshot,
+                                               const NodeId& target_id,
+                                               const std::string& packed_exclude,
+                                               bool ignore_exact_match) {
+  const std::string key(NextHopCache::MakeKey(target_id, packed_exclude, ignore_exact_match,
+                                              snapshot.routing_ids,
+                                              snapshot.next_hop_prefix_bits));
+  NextHop next_hop;
+  if (!next_hop_cache_.Get(snapshot.epoch, key, next_hop)) {
+    std::vector<NodeId> ranked_ids;
+    next_hop = GetUncachedNodeForSendingMessage(snapshot, target_id, packed_exclude,
+                                                ignore_exact_match, &ranked_ids);
+    next_hop_cache_.Add(snapshot.epoch, key, next_hop, ranked_ids);
+  }
+  return next_hop;
+}
+
+NextHop RoutingTable::GetUncachedNodeForSendingMessage(const Snapshot& snapshot,
+                                                       const NodeId& target_id,
+                                                       const std::string& packed_exclude,
+                                                       bool ignore_exact_match,
+                                                       std::vector<NodeId>* ranked_ids) const {
+  const Entry* low_latency_node(GetLowLatencyNode(snapshot, target_id, packed_exclude,
+                                                  ignore_exact_match, ranked_ids));
+  NextHop current_peer(low_latency_node ? low_latency_node->next_hop() : NextHop());
   if (current_peer.node_id != target_id) {
-    group_matrix_.GetBetterNodeForSendingMessage(target_id,
-                                                 exclude,
-                                                 ignore_exact_match,
-                                                 current_peer);
+    snapshot.group_matrix->GetBetterNodeForSendingMessage(target_id,
+                                                         packed_exclude,
+                                                         ignore_exact_match,
+                                                         current_peer);
   }
   std::string excluded_ids;
-  for (const auto& excluded_id : exclude) {
+  for (size_t offset(0); offset + NodeId::kSize <= packed_exclude.size();
+       offset += NodeId::kSize) {
     excluded_ids.append("\t");
-    excluded_ids.append(HexSubstr(excluded_id));
+    excluded_ids.append(HexSubstr(packed_exclude.substr(offset, NodeId::kSize)));
   }
   LOG(kVerbose) << "[" << DebugId(kNodeId_) << "] - best node to send to is "
                 << DebugId(current_peer.node_id) << " (Excluded: " << excluded_ids << ")";
   return current_peer;
 }
 
+void RoutingTable::UpdateRoundTripTime(const NodeId& peer_id,
+                                       const boost::posix_time::time_duration& sample) {
+  // Cached next hops via this peer were chosen with its old estimate.
+  if (Contains(peer_id) && network_statistics_.UpdateRoundTripTime(peer_id, sample) &&
+      Parameters::proximity_routing_candidates > 1)
+    next_hop_cache_.Invalidate(peer_id);
+}
+
 NodeInfo RoutingTable::GetRemovableNode(std::vector<std::string> attempted) {
   std::map<uint32_t, uint16_t> bucket_rank_map;
-  std::unique_lock<std::mutex> lock(mutex_);
-  PartialSortFromTarget(kNodeId_, static_cast<uint16_t>(nodes_.size()), lock);
-
-  auto const from_iterator(nodes_.begin() + Parameters::closest_nodes_size);
+  SnapshotPtr snapshot(GetSnapshot());
+  const std::vector<Entry>& nodes(snapshot->nodes);
+  auto const from_iterator(nodes.begin() + Parameters::closest_nodes_size);
 
-  for (auto it = from_iterator; it != nodes_.end(); ++it) {
+  for (auto it = from_iterator; it != nodes.end(); ++it) {
     if (std::find(attempted.begin(), attempted.end(), ((*it).node_id.string())) ==
            attempted.end()) {
       auto bucket_iter = bucket_rank_map.find((*it).bucket);
@@ -699,15 +1102,15 @@ NodeInfo RoutingTable::GetRemovableNode(std::vector<std::string> attempted) {
   LOG(kVerbose) << "[" << DebugId(kNodeId_) << "] max_bucket " << max_bucket
                 << " count " << max_bucket_count;
   if (max_bucket_count == 1) {
-    return nodes_[Parameters::closest_nodes_size + Parameters::node_group_size];
+    return *nodes[Parameters::closest_nodes_size + Parameters::node_group_size].info;
   }
 
   NodeInfo removable_node;
-  for (auto it(from_iterator); it != nodes_.end(); ++it) {
+  for (auto it(from_iterator); it != nodes.end(); ++it) {
     if (((*it).bucket == max_bucket) &&
         std::find(attempted.begin(), attempted.end(), (*it).node_id.string()) ==
             attempted.end()) {
-      removable_node = (*it);
+      removable_node = *it->info;
       break;
     }
   }
@@ -717,45 +1120,57 @@ NodeInfo RoutingTable::GetRemovableNode(std::vector<std::string> attempted) {
 }
 
 void RoutingTable::GetNodesNeedingGroupUpdates(std::vector<NodeInfo>& nodes_needing_update) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  int sorted_count(PartialSortFromTarget(kNodeId_, Parameters::closest_nodes_size , lock));
-  if (sorted_count == 0)
-    return;
-  for (auto iter(nodes_.begin());
-       iter != (nodes_.begin() + std::min(Parameters::closest_nodes_size,
-                                          static_cast<uint16_t>(nodes_.size())));
+  SnapshotPtr snapshot(GetSnapshot());
+  const std::vector<Entry>& nodes(snapshot->nodes);
+  for (auto iter(nodes.begin());
+       iter != (nodes.begin() + std::min(Parameters::closest_nodes_size,
+                                         static_cast<uint16_t>(nodes.size())));
        ++iter) {
-    if (group_matrix_.IsRowEmpty(*iter))
-      nodes_needing_update.push_back(*iter);
+    if (snapshot->group_matrix->IsRowEmpty(*iter->info))
+      nodes_needing_update.push_back(*iter->info);
   }
 }
 
 NodeInfo RoutingTable::GetNthClosestNode(const NodeId& target_id, uint16_t node_number) {
+  return GetNthClosestNode(*GetSnapshot(), target_id, node_number);
+}
+
+NodeInfo RoutingTable::GetNthClosestNode(const Snapshot& snapshot,
+                                         const NodeId& target_id,
+                                         uint16_t node_number) const {
   assert((node_number > 0) && "Node number starts with position 1");
-  std::unique_lock<std::mutex> lock(mutex_);
-  if (nodes_.size() < node_number) {
+  if (snapshot.nodes.size() < node_number) {
     NodeInfo node_info;
     node_info.node_id = (NodeId(NodeId::kMaxId) ^ kNodeId_);
     return node_info;
   }
-  NthElementSortFromTarget(target_id, node_number, lock);
-  return nodes_[node_number - 1];
+  if (target_id == kNodeId_)
+    return *snapshot.nodes[node_number - 1].info;
+  return *GetClosestNodesTo(snapshot.nodes, target_id, node_number).back()->info;
 }
 
 std::vector<NodeId> RoutingTable::GetClosestNodes(const NodeId& target_id, uint16_t number_to_get) {
-  std::vector<NodeId> close_nodes;
-  std::unique_lock<std::mutex> lock(mutex_);
-  int sorted_count(PartialSortFromTarget(target_id, number_to_get, lock));
+  return GetClosestNodes(*GetSnapshot(), target_id, number_to_get);
+}
 
-  for (int i = 0; i != sorted_count; ++i)
-    close_nodes.push_back(nodes_[i].node_id);
+std::vector<NodeId> RoutingTable::GetClosestNodes(const Snapshot& snapshot,
+                                                  const NodeId& target_id,
+                                                  uint16_t number_to_get) const {
+  std::vector<NodeId> close_nodes;
+  for (const auto& node_info : GetClosestNodesTo(snapshot.nodes, target_id, number_to_get))
+    close_nodes.push_back(node_info->node_id);
   return close_nodes;
 }
 
 std::vector<NodeInfo> RoutingTable::GetClosestMatrixNodes(const NodeId& target_id,
                                                           uint16_t number_to_get) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  std::vector<NodeInfo> closest_matrix_nodes(group_matrix_.GetUniqueNodes());
+  return GetClosestMatrixNodes(*GetSnapshot(), target_id, number_to_get);
+}
+
+std::vector<NodeInfo> RoutingTable::GetClosestMatrixNodes(const Snapshot& snapshot,
+                                                          const NodeId& target_id,
+                                                          uint16_t number_to_get) const {
+  std::vector<NodeInfo> closest_matrix_nodes(snapshot.group_matrix->GetUniqueNodes());
   size_t sorting_size(std::min(static_cast<size_t>(number_to_get),
                                closest_matrix_nodes.size()));
   std::partial_sort(closest_matrix_nodes.begin(),
@@ -769,11 +1184,7 @@ std::vector<NodeInfo> RoutingTable::GetClosestMatrixNodes(const NodeId& target_i
 }
 
 std::vector<NodeId> RoutingTable::GetGroup(const NodeId& target_id) {
-  std::vector<NodeInfo> nodes;
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    nodes = group_matrix_.GetUniqueNodes();
-  }
+  std::vector<NodeInfo> nodes(GetSnapshot()->group_matrix->GetUniqueNodes());
   std::vector<NodeId> group;
   std::partial_sort(nodes.begin(),
                     nodes.begin() + Parameters::node_group_size,
@@ -786,48 +1197,46 @@ std::vector<NodeId> RoutingTable::GetGroup(const NodeId& target_id) {
   return group;
 }
 
-std::vector<NodeInfo> RoutingTable::GetClosestNodeInfo(const NodeId& target_id,
-                                                       uint16_t number_to_get,
-                                                       bool ignore_exact_match) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  int sorted_count(PartialSortFromTarget(target_id, number_to_get + 1, lock));
-  if (sorted_count == 0)
-    return std::vector<NodeInfo>();
-
-  auto itr(nodes_.begin());
-  if (ignore_exact_match && ((*itr).node_id == target_id)) {
-    return (sorted_count == 1) ? std::vector<NodeInfo>() :
-           std::vector<NodeInfo>(nodes_.begin() + 1, nodes_.begin() + sorted_count);
-  }
-
-  return std::vector<NodeInfo>(nodes_.begin(),
-      nodes_.begin() + std::min(sorted_count, static_cast<int>(number_to_get)));
+std::vector<const RoutingTable::Entry*> RoutingTable::GetClosestEntries(
+    const Snapshot& snapshot,
+    const NodeId& target_id,
+    uint16_t number_to_get,
+    bool ignore_exact_match) const {
+  auto closest_nodes(GetClosestNodesTo(snapshot.nodes, target_id, number_to_get + 1));
+  if (closest_nodes.empty())
+    return closest_nodes;
+
+  if (ignore_exact_match && (closest_nodes.front()->node_id == target_id))
+    closest_nodes.erase(closest_nodes.begin());
+  else if (closest_nodes.size() > number_to_get)
+    closest_nodes.pop_back();
+  return closest_nodes;
 }
 
-std::pair<bool, std::vector<NodeInfo>::iterator> RoutingTable::Find(
+std::pair<bool, std::vector<RoutingTable::Entry>::iterator> RoutingTable::Find(
     const NodeId& node_id,
     std::unique_lock<std::mutex>& lock) {
   assert(lock.owns_lock());
   static_cast<void>(lock);
-  auto itr(std::find_if(nodes_.begin(),
-                        nodes_.end(),
-                        [&node_id](const NodeInfo& node_info) {
-                          return node_info.node_id == node_id;
-                        }));
-  return std::make_pair(itr != nodes_.end(), itr);
+  // nodes_ may have changed since snapshot_ was published (e.g. part way through AddNodes), so its
+  // index can't be used here.  Distinct IDs are at distinct distances from kNodeId_, so a binary
+  // search on distance finds the node if it's held.
+  auto itr(std::lower_bound(nodes_.begin(), nodes_.end(), node_id,
+                            [this](const Entry& entry, const NodeId& target) {
+                              return NodeId::CloserToTarget(entry.node_id, target, kNodeId_);
+                            }));
+  if (itr == nodes_.end() || itr->node_id != node_id)
+    return std::make_pair(false, nodes_.end());
+  return std::make_pair(true, itr);
 }
 
-std::pair<bool, std::vector<NodeInfo>::const_iterator> RoutingTable::Find(
+std::pair<bool, std::vector<RoutingTable::Entry>::const_iterator> RoutingTable::Find(
     const NodeId& node_id,
-    std::unique_lock<std::mutex>& lock) const {
-  assert(lock.owns_lock());
-  static_cast<void>(lock);
-  auto itr(std::find_if(nodes_.begin(),
-                        nodes_.end(),
-                        [&node_id](const NodeInfo& node_info) {
-                          return node_info.node_id == node_id;
-                        }));
-  return std::make_pair(itr != nodes_.end(), itr);
+    const Snapshot& snapshot) const {
+  auto found(snapshot.node_index.find(node_id));
+  if (found == snapshot.node_index.end())
+    return std::make_pair(false, snapshot.nodes.end());
+  return std::make_pair(true, snapshot.nodes.begin() + found->second);
 }
 
 void RoutingTable::UpdateNetworkStatus(uint16_t size) const {
@@ -842,19 +1251,15 @@ void RoutingTable::UpdateNetworkStatus(uint16_t size) const {
 }
 
 size_t RoutingTable::size() const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return nodes_.size();
+  return GetSnapshot()->nodes.size();
 }
 
 void RoutingTable::IpcSendGroupMatrix() const {
   if (ipc_message_queue_) {
     network_viewer::MatrixRecord matrix_record(kNodeId_);
-    std::vector<NodeInfo> matrix, close;
-    {
-      std::lock_guard<std::mutex> lock(mutex_);
-      matrix = group_matrix_.GetUniqueNodes();
-      close = group_matrix_.GetConnectedPeers();
-    }
+    SnapshotPtr snapshot(GetSnapshot());
+    std::vector<NodeInfo> matrix(snapshot->group_matrix->GetUniqueNodes()),
+                          close(snapshot->group_matrix->GetConnectedPeers());
     std::string printout("\tMatrix sent by: " + DebugId(kNodeId_) + "\n");
     for (const auto& matrix_element : matrix) {
       matrix_record.AddElement(matrix_element.node_id, network_viewer::ChildType::kMatrix);
@@ -882,20 +1287,12 @@ void RoutingTable::IpcSendGroupMatrix() const {
   }
 }
 
-std::string RoutingTable::PrintRoutingTable() {
-  std::vector<NodeInfo> rt;
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::sort(nodes_.begin(),
-              nodes_.end(),
-              [&](const NodeInfo& lhs, const NodeInfo& rhs) {
-                return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, kNodeId_);
-              });
-    rt = nodes_;
-  }
+std::string RoutingTable::PrintRoutingTable() const {
+  SnapshotPtr snapshot(GetSnapshot());
+  const std::vector<Entry>& rt(snapshot->nodes);
   std::string s = "\n\n[" + DebugId(kNodeId_) +
       "] This node's own routing table and peer connections:\n" +
-      "Routing table size: " + std::to_string(nodes_.size()) + "\n";
+      "Routing table size: " + std::to_string(rt.size()) + "\n";
   for (const auto& node : rt) {
     s += std::string("\tPeer ") + "[" + DebugId(node.node_id) + "]" + "-->";
     s += DebugId(node.connection_id) + " && xored ";
@@ -906,6 +1303,20 @@ std::string RoutingTable::PrintRoutingTable() {
   return s;
 }
 
+// Called after every membership change, so the full table is only printed if the previous dump was
+// at least Parameters::routing_table_dump_interval ago.
+void RoutingTable::LogRoutingTableIfDue() {
+  std::vector<RoutingTableChange> changes;
+  if (change_log_.GetDueDump(changes)) {
+    LOG(kInfo) << "\n[" << DebugId(kNodeId_) << "] Routing table changes since last dump:\n"
+               << PrintRoutingTableChanges(changes) << PrintRoutingTable();
+  }
+}
+
+std::vector<RoutingTableChange> RoutingTable::GetChanges(uint64_t& sequence) const {
+  return change_log_.GetChanges(sequence);
+}
+
 void RoutingTable::PrintGroupMatrix() {
 //  group_matrix_.PrintGroupMatrix();
 }
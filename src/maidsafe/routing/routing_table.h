@@ -16,10 +16,15 @@ License.
 #ifndef MAIDSAFE_ROUTING_ROUTING_TABLE_H_
 #define MAIDSAFE_ROUTING_ROUTING_TABLE_H_
 
+#include <array>
 #include <cstdint>
+#include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -35,7 +40,11 @@ License.
 #include "maidsafe/routing/api_config.h"
 #include "maidsafe/routing/group_matrix.h"
 #include "maidsafe/routing/network_statistics.h"
+#include "maidsafe/routing/next_hop.h"
+#include "maidsafe/routing/next_hop_cache.h"
+#include "maidsafe/routing/node_id_hash.h"
 #include "maidsafe/routing/parameters.h"
+#include "maidsafe/routing/routing_table_change_log.h"
 
 
 namespace maidsafe {
@@ -48,6 +57,9 @@ namespace test {
   class GenericNode;
   class RoutingTableTest;
   class RoutingTableTest_BEH_OrderedGroupChange_Test;
+  class RoutingTableTest_BEH_AddNodesBatch_Test;
+  class RoutingTableTest_BEH_SnapshotsDuringConcurrentChanges_Test;
+  class RoutingTableTest_BEH_CachedNextHopsMatchUncached_Test;
   class RoutingTableTest_BEH_ReverseOrderedGroupChange_Test;
   class RoutingTableTest_BEH_CheckMockSendGroupChangeRpcs_Test;
   class RoutingTableTest_BEH_GroupUpdateFromConnectedPeer_Test;
@@ -75,38 +87,60 @@ class RoutingTable {
                           MatrixChangedFunctor matrix_change_functor);
   bool AddNode(const NodeInfo& peer);
   bool CheckNode(const NodeInfo& peer);
+  // Adds all acceptable peers under one lock, firing the change functors at most once.  Returns the
+  // peers which were added (and not displaced again by later peers in the same batch).
+  std::vector<NodeInfo> AddNodes(const std::vector<NodeInfo>& peers);
   NodeInfo DropNode(const NodeId &node_to_drop, bool routing_only);
+  NodeInfo DropConnection(const NodeId& connection_to_drop, bool routing_only);
   bool ClosestToId(const NodeId& node_id);
   GroupRangeStatus IsNodeIdInGroupRange(const NodeId& target_id);
-  bool IsThisNodeGroupLeader(const NodeId& target_id, NodeInfo& connected_peer);
+  bool IsThisNodeGroupLeader(const NodeId& target_id, NextHop& connected_peer);
   bool IsThisNodeGroupLeader(const NodeId& target_id,
-                             NodeInfo& connected_peer,
+                             NextHop& connected_peer,
                              const std::vector<std::string>& exclude);
+  // As above, with the excluded IDs packed as for PackNodeIds.
+  bool IsThisNodeGroupLeader(const NodeId& target_id,
+                             NextHop& connected_peer,
+                             const std::string& packed_exclude);
   bool GetNodeInfo(const NodeId& node_id, NodeInfo& node_info) const;
+  bool GetNodeInfoForConnection(const NodeId& connection_id, NodeInfo& node_info) const;
   bool IsThisNodeInRange(const NodeId& target_id, uint16_t range);
   bool IsThisNodeClosestTo(const NodeId& target_id, bool ignore_exact_match = false);
   bool IsThisNodeClosestToIncludingMatrix(const NodeId& target_id, bool ignore_exact_match = false);
   bool Contains(const NodeId& node_id) const;
   bool ConfirmGroupMembers(const NodeId& node1, const NodeId& node2);
-  void GroupUpdateFromConnectedPeer(const NodeId& peer, const std::vector<NodeInfo>& nodes);
+  void GroupUpdateFromConnectedPeer(const NodeId& peer,
+                                    const std::vector<NodeInfo>& nodes,
+                                    uint64_t version = 0);
+  // See GroupMatrix::UpdateFromConnectedPeer.  A delta from a peer not in the table is ignored.
+  bool GroupUpdateFromConnectedPeer(const NodeId& peer,
+                                    const std::vector<NodeInfo>& added_nodes,
+                                    const std::vector<NodeId>& removed_nodes,
+                                    uint64_t base_version,
+                                    uint64_t version);
   NodeId RandomConnectedNode();
   std::vector<NodeInfo> GetMatrixNodes();
   bool IsConnected(const NodeId& node_id);
-  // Returns default-constructed NodeId if routing table size is zero
-  NodeInfo GetClosestNode(const NodeId& target_id, bool ignore_exact_match = false);
-  NodeInfo GetClosestNode(const NodeId& target_id,
-                          const std::vector<std::string>& exclude,
-                          bool ignore_exact_match = false);
+  // Returns default-constructed NextHop if routing table size is zero
+  NextHop GetClosestNode(const NodeId& target_id, bool ignore_exact_match = false);
+  NextHop GetClosestNode(const NodeId& target_id,
+                         const std::vector<std::string>& exclude,
+                         bool ignore_exact_match = false);
 //  NodeInfo GetNodeForSendingMessage(const NodeId& target_id, bool ignore_exact_match = false);
-  NodeInfo GetNodeForSendingMessage(const NodeId& target_id,
-                                    const std::vector<std::string>& exclude,
-                                    bool ignore_exact_match = false);
+  NextHop GetNodeForSendingMessage(const NodeId& target_id,
+                                   const std::vector<std::string>& exclude,
+                                   bool ignore_exact_match = false);
+  // As above, with the excluded IDs packed as for PackNodeIds.
+  NextHop GetNodeForSendingMessage(const NodeId& target_id,
+                                   const std::string& packed_exclude,
+                                   bool ignore_exact_match = false);
   // Returns max NodeId if routing table size is less than requested node_number
   NodeInfo GetNthClosestNode(const NodeId& target_id, uint16_t node_number);
   std::vector<NodeId> GetClosestNodes(const NodeId& target_id, uint16_t number_to_get);
   std::vector<NodeInfo> GetClosestMatrixNodes(const NodeId& target_id, uint16_t number_to_get);
   std::vector<NodeId> GetGroup(const NodeId& target_id);
   NodeInfo GetRemovableNode(std::vector<std::string> attempted = std::vector<std::string>());
+  void UpdateRoundTripTime(const NodeId& peer_id, const boost::posix_time::time_duration& sample);
   void GetNodesNeedingGroupUpdates(std::vector<NodeInfo>& nodes_needing_update);
   size_t size() const;
   uint16_t kThresholdSize() const { return kThresholdSize_; }
@@ -115,55 +149,132 @@ class RoutingTable {
   asymm::PublicKey kPublicKey() const { return kKeys_.public_key; }
   NodeId kConnectionId() const { return kConnectionId_; }
   bool client_mode() const { return kClientMode_; }
+  // Changes since 'sequence', see RoutingTableChangeLog::GetChanges.
+  std::vector<RoutingTableChange> GetChanges(uint64_t& sequence) const;
+
+  // Immutable version of the table, defined below.  Each query above works on whichever version is
+  // current when it runs; the overloads taking a snapshot all answer from that one, so a caller
+  // making several queries to reach one decision (e.g. how to route a message) sees no changes
+  // between them.
+  struct Snapshot;
+  typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+  SnapshotPtr GetSnapshot() const;
+  bool IsThisNodeGroupLeader(const Snapshot& snapshot,
+                             const NodeId& target_id,
+                             NextHop& connected_peer) const;
+  bool IsThisNodeGroupLeader(const Snapshot& snapshot,
+                             const NodeId& target_id,
+                             NextHop& connected_peer,
+                             const std::string& packed_exclude) const;
+  bool GetNodeInfo(const Snapshot& snapshot, const NodeId& node_id, NodeInfo& node_info) const;
+  bool IsThisNodeInRange(const Snapshot& snapshot, const NodeId& target_id, uint16_t range) const;
+  bool IsThisNodeClosestTo(const Snapshot& snapshot,
+                           const NodeId& target_id,
+                           bool ignore_exact_match = false) const;
+  bool IsThisNodeClosestToIncludingMatrix(const Snapshot& snapshot,
+                                          const NodeId& target_id,
+                                          bool ignore_exact_match = false) const;
+  bool Contains(const Snapshot& snapshot, const NodeId& node_id) const;
+  NextHop GetNodeForSendingMessage(const Snapshot& snapshot,
+                                   const NodeId& target_id,
+                                   const std::string& packed_exclude,
+                                   bool ignore_exact_match = false);
+  std::vector<NodeId> GetClosestNodes(const Snapshot& snapshot,
+                                      const NodeId& target_id,
+                                      uint16_t number_to_get) const;
+  std::vector<NodeInfo> GetClosestMatrixNodes(const Snapshot& snapshot,
+                                              const NodeId& target_id,
+                                              uint16_t number_to_get) const;
 
   friend class test::GenericNode;
   friend class GroupChangeHandler;
   friend class test::RoutingTableTest;
   friend class test::RoutingTableTest_BEH_OrderedGroupChange_Test;
+  friend class test::RoutingTableTest_BEH_AddNodesBatch_Test;
+  friend class test::RoutingTableTest_BEH_SnapshotsDuringConcurrentChanges_Test;
+  friend class test::RoutingTableTest_BEH_CachedNextHopsMatchUncached_Test;
   friend class test::RoutingTableTest_BEH_ReverseOrderedGroupChange_Test;
   friend class test::RoutingTableTest_BEH_CheckMockSendGroupChangeRpcs_Test;
   friend class test::RoutingTableTest_BEH_GroupUpdateFromConnectedPeer_Test;
   friend class test::NetworkStatisticsTest_BEH_IsIdInGroupRange_Test;
 
  private:
+  // The fields needed to order and route by, with the rest of the peer's NodeInfo (notably its
+  // public key) held once behind 'info' and shared by every snapshot.  Inserting, erasing and
+  // snapshotting only ever moves these small records.
+  struct Entry {
+    explicit Entry(const NodeInfo& node_info);
+    NextHop next_hop() const { return NextHop(node_id, connection_id); }
+    NodeId node_id, connection_id;
+    int32_t bucket;
+    std::shared_ptr<const NodeInfo> info;
+  };
+
   RoutingTable(const RoutingTable&);
   RoutingTable& operator=(const RoutingTable&);
-  bool AddOrCheckNode(NodeInfo node, bool remove);
   void SetBucketIndex(NodeInfo& node_info) const;
-  bool CheckPublicKeyIsUnique(const NodeInfo& node, std::unique_lock<std::mutex>& lock) const;
+  bool ValidatePublicKey(const NodeInfo& node, std::string& key_fingerprint);
+  bool CheckPublicKeyIsUnique(const std::string& key_fingerprint,
+                              std::unique_lock<std::mutex>& lock) const;
   NodeInfo ResolveConnectionDuplication(const NodeInfo& new_duplicate_node,
                                         bool local_endpoint,
                                         NodeInfo& existing_node);
-  void UpdateCloseNodeChange(std::unique_lock<std::mutex>& lock, const NodeInfo& peer,
-                             std::vector<NodeInfo>& new_connected_nodes,
-                             MatrixChange& matrix_change);
   bool MakeSpaceForNodeToBeAdded(const NodeInfo& node,
                                  bool remove,
                                  NodeInfo& removed_node,
                                  std::unique_lock<std::mutex>& lock);
-  uint16_t PartialSortFromTarget(const NodeId& target,
-                                 uint16_t number,
-                                 std::unique_lock<std::mutex>& lock);
-  void NthElementSortFromTarget(const NodeId& target,
-                                uint16_t nth_element,
-                                std::unique_lock<std::mutex>& lock);
-  NodeId FurthestCloseNode();
-  std::vector<NodeInfo> GetClosestNodeInfo(const NodeId& target_id,
-                                           uint16_t number_to_get,
-                                           bool ignore_exact_match = false);
-  std::pair<bool, std::vector<NodeInfo>::iterator> Find(const NodeId& node_id,
-                                                        std::unique_lock<std::mutex>& lock);
-  std::pair<bool, std::vector<NodeInfo>::const_iterator> Find(
-      const NodeId& node_id,
-      std::unique_lock<std::mutex>& lock) const;
+  void InsertNode(const NodeInfo& peer,
+                  const std::string& key_fingerprint,
+                  std::unique_lock<std::mutex>& lock);
+  void EraseNode(std::vector<Entry>::iterator itr, std::unique_lock<std::mutex>& lock);
+  void PublishSnapshot(std::unique_lock<std::mutex>& lock);
+  std::vector<const Entry*> GetClosestNodesTo(const std::vector<Entry>& nodes,
+                                              const NodeId& target,
+                                              size_t number_to_get) const;
+  NodeId FurthestCloseNode(const Snapshot& snapshot) const;
+  // The lookups below return entries of |snapshot|, or nullptr if there is no such peer.
+  const Entry* GetClosestNode(const Snapshot& snapshot,
+                              const NodeId& target_id,
+                              bool ignore_exact_match) const;
+  const Entry* GetClosestNode(const Snapshot& snapshot,
+                              const NodeId& target_id,
+                              const std::string& packed_exclude,
+                              bool ignore_exact_match) const;
+  // Of the first Parameters::proximity_routing_candidates non-excluded peers closer to
+  // |target_id| than this node, returns the one with the lowest round trip time.  If given,
+  // |ranked_ids| is set to those peers when there was more than one.
+  const Entry* GetLowLatencyNode(const Snapshot& snapshot,
+                                 const NodeId& target_id,
+                                 const std::string& packed_exclude,
+                                 bool ignore_exact_match,
+                                 std::vector<NodeId>* ranked_ids = nullptr) const;
+  // Uncached GetNodeForSendingMessage.
+  NextHop GetUncachedNodeForSendingMessage(const Snapshot& snapshot,
+                                           const NodeId& target_id,
+                                           const std::string& packed_exclude,
+                                           bool ignore_exact_match,
+                                           std::vector<NodeId>* ranked_ids = nullptr) const;
+  NodeInfo GetNthClosestNode(const Snapshot& snapshot,
+                             const NodeId& target_id,
+                             uint16_t node_number) const;
+  std::vector<const Entry*> GetClosestEntries(const Snapshot& snapshot,
+                                              const NodeId& target_id,
+                                              uint16_t number_to_get,
+                                              bool ignore_exact_match = false) const;
+  std::pair<bool, std::vector<Entry>::iterator> Find(const NodeId& node_id,
+                                                     std::unique_lock<std::mutex>& lock);
+  std::pair<bool, std::vector<Entry>::const_iterator> Find(const NodeId& node_id,
+                                                           const Snapshot& snapshot) const;
   void UpdateNetworkStatus(uint16_t size) const;
 
   void IpcSendGroupMatrix() const;
-  std::string PrintRoutingTable();
+  std::string PrintRoutingTable() const;
+  void LogRoutingTableIfDue();
   void PrintGroupMatrix();
 
   const bool kClientMode_;
   const NodeId kNodeId_;
+  const std::array<uint64_t, NodeId::kSize / sizeof(uint64_t)> kNodeIdWords_;
   const NodeId kConnectionId_;
   const asymm::Keys kKeys_;
   const uint16_t kMaxSize_;
@@ -176,12 +287,50 @@ class RoutingTable {
   ConnectedGroupChangeFunctor connected_group_change_functor_;
   CloseNodeReplacedFunctor close_node_replaced_functor_;
   MatrixChangedFunctor matrix_change_functor_;
-  std::vector<NodeInfo> nodes_;
+  // Always ordered by distance from kNodeId_, hence also by non-decreasing bucket index.
+  std::vector<Entry> nodes_;
+  // Number of entries in nodes_ per (occupied) bucket index.
+  std::map<int32_t, uint16_t> bucket_occupancy_;
+  // Public key fingerprint of each entry in nodes_, and the set of those fingerprints.
+  std::unordered_map<NodeId, std::string, NodeIdHash> key_fingerprints_;
+  std::unordered_set<std::string> key_fingerprint_set_;
   GroupMatrix group_matrix_;
+  // Copy of group_matrix_ for snapshots, reset whenever group_matrix_ is modified.
+  std::shared_ptr<const GroupMatrix> group_matrix_snapshot_;
+  uint64_t epoch_;
+  SnapshotPtr snapshot_;
+  NextHopCache next_hop_cache_;
+  RoutingTableChangeLog change_log_;
+  // Fingerprints of keys which have passed asymm::ValidateKey, evicted oldest first.
+  std::mutex validated_keys_mutex_;
+  std::unordered_set<std::string> validated_keys_;
+  std::deque<std::string> validated_keys_order_;
   std::unique_ptr<boost::interprocess::message_queue> ipc_message_queue_;
   NetworkStatistics& network_statistics_;
 };
 
+// Immutable copy of the table, republished by every mutation.  Queries work on whichever copy is
+// current when they start, so they never wait on mutex_ and see one consistent view throughout.
+// Only the entries are copied per snapshot; the group matrix is shared until it next changes.
+struct RoutingTable::Snapshot {
+  typedef std::unordered_map<NodeId, size_t, NodeIdHash> Index;
+  Snapshot(uint64_t epoch_in,
+           const std::vector<Entry>& nodes_in,
+           std::shared_ptr<const GroupMatrix> group_matrix_in,
+           const NodeId& this_node_id);
+  // Incremented for each snapshot published.
+  const uint64_t epoch;
+  const std::vector<Entry> nodes;
+  const std::shared_ptr<const GroupMatrix> group_matrix;
+  // Positions in nodes, keyed by node_id and by connection_id.
+  Index node_index, connection_index;
+  // Sorted IDs of nodes, the matrix's unique nodes, this node and the zero ID, and the number of
+  // leading bits of a target which decide its order of distance from all of them.  Next hops are
+  // cached per target prefix of that length; see NextHopCache::MakeKey.
+  std::vector<NodeId> routing_ids;
+  uint16_t next_hop_prefix_bits;
+};
+
 }  // namespace routing
 
 }  // namespace maidsafe
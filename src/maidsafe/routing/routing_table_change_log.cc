@@ -0,0 +1,112 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+#include "maidsafe/routing/routing_table_change_log.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "maidsafe/common/log.h"
+
+
+namespace maidsafe {
+
+namespace routing {
+
+RoutingTableChange::RoutingTableChange()
+    : type(Type::kAdded),
+      node_id(),
+      bucket(0),
+      rank(0),
+      table_size(0) {}
+
+RoutingTableChange::RoutingTableChange(Type type_in,
+                                       const NodeId& node_id_in,
+                                       int32_t bucket_in,
+                                       uint16_t rank_in,
+                                       uint16_t table_size_in)
+    : type(type_in),
+      node_id(node_id_in),
+      bucket(bucket_in),
+      rank(rank_in),
+      table_size(table_size_in) {}
+
+std::string PrintRoutingTableChanges(const std::vector<RoutingTableChange>& changes) {
+  std::string s;
+  for (const auto& change : changes) {
+    s += (change.type == RoutingTableChange::Type::kAdded ? "\tAdded   [" : "\tRemoved [");
+    s += DebugId(change.node_id) + "] bucket " + std::to_string(change.bucket);
+    s += " rank " + std::to_string(change.rank);
+    s += " table size " + std::to_string(change.table_size) + "\n";
+  }
+  return s;
+}
+
+RoutingTableChangeLog::RoutingTableChangeLog(size_t capacity,
+                                             std::chrono::milliseconds dump_interval)
+    : kCapacity_(capacity),
+      kDumpInterval_(dump_interval),
+      changes_(),
+      next_sequence_(0),
+      dumped_sequence_(0),
+      last_dump_(std::chrono::steady_clock::now() - dump_interval),
+      mutex_() {
+  changes_.reserve(kCapacity_);
+}
+
+void RoutingTableChangeLog::Record(const RoutingTableChange& change) {
+  if (kCapacity_ == 0)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (changes_.size() < kCapacity_)
+    changes_.push_back(change);
+  else
+    changes_[next_sequence_ % kCapacity_] = change;
+  ++next_sequence_;
+}
+
+std::vector<RoutingTableChange> RoutingTableChangeLog::GetChanges(uint64_t& sequence) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return GetChanges(sequence, lock);
+}
+
+bool RoutingTableChangeLog::GetDueDump(std::vector<RoutingTableChange>& changes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (dumped_sequence_ == next_sequence_)
+    return false;
+  auto now(std::chrono::steady_clock::now());
+  if (now - last_dump_ < kDumpInterval_)
+    return false;
+  last_dump_ = now;
+  changes = GetChanges(dumped_sequence_, lock);
+  return true;
+}
+
+std::vector<RoutingTableChange> RoutingTableChangeLog::GetChanges(
+    uint64_t& sequence,
+    std::unique_lock<std::mutex>& lock) const {
+  assert(lock.owns_lock());
+  static_cast<void>(lock);
+  uint64_t first(std::max(sequence, next_sequence_ - changes_.size()));
+  std::vector<RoutingTableChange> changes;
+  changes.reserve(static_cast<size_t>(next_sequence_ - first));
+  for (; first < next_sequence_; ++first)
+    changes.push_back(changes_[first % kCapacity_]);
+  sequence = next_sequence_;
+  return changes;
+}
+
+}  // namespace routing
+
+}  // namespace maidsafe
@@ -0,0 +1,80 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+#ifndef MAIDSAFE_ROUTING_ROUTING_TABLE_CHANGE_LOG_H_
+#define MAIDSAFE_ROUTING_ROUTING_TABLE_CHANGE_LOG_H_
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/node_id.h"
+
+
+namespace maidsafe {
+
+namespace routing {
+
+struct RoutingTableChange {
+  enum class Type { kAdded, kRemoved };
+  RoutingTableChange();
+  RoutingTableChange(Type type_in, const NodeId& node_id_in, int32_t bucket_in, uint16_t rank_in,
+                     uint16_t table_size_in);
+  Type type;
+  NodeId node_id;
+  int32_t bucket;
+  // Position by distance from this node (0 is closest) while the node was in the table.
+  uint16_t rank;
+  // Size of the routing table once the change had been applied.
+  uint16_t table_size;
+};
+
+std::string PrintRoutingTableChanges(const std::vector<RoutingTableChange>& changes);
+
+// Fixed-size ring of the most recent routing table changes.  Recording a change only copies it into
+// the ring; nothing is formatted until a reader asks for it.
+class RoutingTableChangeLog {
+ public:
+  RoutingTableChangeLog(size_t capacity, std::chrono::milliseconds dump_interval);
+  void Record(const RoutingTableChange& change);
+  // Returns the changes (oldest first) recorded since 'sequence' which are still held in the ring,
+  // and sets 'sequence' to the current position.  Pass 0 to get everything held.
+  std::vector<RoutingTableChange> GetChanges(uint64_t& sequence) const;
+  // Returns true, and the changes since the previous successful call, at most once per dump
+  // interval and only if there has been a change since.
+  bool GetDueDump(std::vector<RoutingTableChange>& changes);
+
+ private:
+  RoutingTableChangeLog(const RoutingTableChangeLog&);
+  RoutingTableChangeLog(const RoutingTableChangeLog&&);
+  RoutingTableChangeLog& operator=(const RoutingTableChangeLog&);
+
+  std::vector<RoutingTableChange> GetChanges(uint64_t& sequence,
+                                             std::unique_lock<std::mutex>& lock) const;
+
+  const size_t kCapacity_;
+  const std::chrono::milliseconds kDumpInterval_;
+  std::vector<RoutingTableChange> changes_;
+  uint64_t next_sequence_, dumped_sequence_;
+  std::chrono::steady_clock::time_point last_dump_;
+  mutable std::mutex mutex_;
+};
+
+}  // namespace routing
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ROUTING_ROUTING_TABLE_CHANGE_LOG_H_
@@ -46,6 +46,7 @@ protobuf::Message Ping(const NodeId& node_id, const std::string& identity) {
   message.set_direct(true);
   message.set_replication(1);
   message.set_type(static_cast<int32_t>(MessageType::kPing));
+  message.set_id(RandomUint32() % 10000);
   message.set_request(true);
   message.set_client_node(false);
   message.set_hops_to_live(Parameters::hops_to_live);
@@ -148,7 +149,7 @@ protobuf::Message FindNodes(const NodeId& node_id,
   message.set_replication(1);
   message.set_type(static_cast<int32_t>(MessageType::kFindNodes));
   message.set_request(true);
-  message.add_route_history(this_node_id.string());
+  AddToRouteHistory(message, this_node_id);
   message.set_client_node(false);
   message.set_visited(false);
   message.set_id(RandomUint32() % 10000);
@@ -232,7 +233,8 @@ protobuf::Message ConnectSuccessAcknowledgement(const NodeId& node_id,
 protobuf::Message ClosestNodesUpdate(
     const NodeId& node_id,
     const NodeId& my_node_id,
-    const std::vector<NodeInfo>& closest_nodes) {
+    const std::vector<NodeInfo>& closest_nodes,
+    uint64_t version) {
   assert(!node_id.IsZero() && "Invalid node_id");
   assert(!my_node_id.IsZero() && "Invalid my node_id");
   // assert(!close_nodes.empty() && "Empty close nodes");
@@ -245,6 +247,45 @@ protobuf::Message ClosestNodesUpdate(
     basic_node_info->set_node_id(i.node_id.string());
     basic_node_info->set_rank(i.rank);
   }
+  if (version != 0)
+    closest_nodes_update.set_version(version);
+  message.set_destination_id(node_id.string());
+  message.set_source_id(my_node_id.string());
+  message.set_routing_message(true);
+  message.add_data(closest_nodes_update.SerializeAsString());
+  message.set_direct(true);
+  message.set_replication(1);
+  message.set_type(static_cast<int32_t>(MessageType::kClosestNodesUpdate));
+  message.set_request(true);
+  message.set_client_node(false);
+  message.set_hops_to_live(Parameters::hops_to_live);
+  message.set_id(RandomUint32() % 10000);
+  assert(message.IsInitialized() && "Unintialised message");
+  return message;
+}
+
+protobuf::Message ClosestNodesUpdateDelta(
+    const NodeId& node_id,
+    const NodeId& my_node_id,
+    uint64_t version,
+    const std::vector<NodeInfo>& added_nodes,
+    const std::vector<NodeId>& removed_nodes) {
+  assert(!node_id.IsZero() && "Invalid node_id");
+  assert(!my_node_id.IsZero() && "Invalid my node_id");
+  assert(version > 1 && "Invalid version");
+  protobuf::Message message;
+  protobuf::ClosestNodesUpdate closest_nodes_update;
+  closest_nodes_update.set_node(my_node_id.string());
+  for (const auto& i : added_nodes) {
+    protobuf::BasicNodeInfo* basic_node_info;
+    basic_node_info = closest_nodes_update.add_nodes_info();
+    basic_node_info->set_node_id(i.node_id.string());
+    basic_node_info->set_rank(i.rank);
+  }
+  closest_nodes_update.set_version(version);
+  closest_nodes_update.set_base_version(version - 1);
+  for (const auto& removed_node : removed_nodes)
+    closest_nodes_update.add_removed_nodes(removed_node.string());
   message.set_destination_id(node_id.string());
   message.set_source_id(my_node_id.string());
   message.set_routing_message(true);
@@ -260,6 +301,60 @@ protobuf::Message ClosestNodesUpdate(
   return message;
 }
 
+protobuf::Message ClosestNodesUpdateResync(const NodeId& node_id,
+                                           const NodeId& my_node_id,
+                                           const NodeId& my_connection_id,
+                                           const bool& client_node) {
+  assert(!node_id.IsZero() && "Invalid node_id");
+  assert(!my_node_id.IsZero() && "Invalid my node_id");
+  assert(!my_connection_id.IsZero() && "Invalid my connection_id");
+  protobuf::Message message;
+  protobuf::ClosestNodesUpdateResync closest_nodes_update_resync;
+  closest_nodes_update_resync.set_node_id(my_node_id.string());
+  closest_nodes_update_resync.set_connection_id(my_connection_id.string());
+  message.set_destination_id(node_id.string());
+  message.set_source_id(my_node_id.string());
+  message.set_routing_message(true);
+  message.add_data(closest_nodes_update_resync.SerializeAsString());
+  message.set_direct(true);
+  message.set_replication(1);
+  message.set_type(static_cast<int32_t>(MessageType::kClosestNodesUpdateResync));
+  message.set_request(true);
+  message.set_client_node(client_node);
+  message.set_hops_to_live(Parameters::hops_to_live);
+  message.set_id(RandomUint32() % 10000);
+  assert(message.IsInitialized() && "Unintialised message");
+  return message;
+}
+
+protobuf::Message ClosestNodesUpdateSubscribe(const NodeId& node_id,
+                                              const NodeId& this_node_id,
+                                              const NodeId& this_connection_id,
+                                              const bool& client_node,
+                                              const bool& subscribe) {
+  assert(!node_id.IsZero() && "Invalid node_id");
+  assert(!this_node_id.IsZero() && "Invalid my node_id");
+  assert(!this_connection_id.IsZero() && "Invalid my connection_id");
+  protobuf::Message message;
+  protobuf::ClosestNodesUpdateSubscrirbe closest_nodes_update_subscribe;
+  closest_nodes_update_subscribe.set_node_id(this_node_id.string());
+  closest_nodes_update_subscribe.set_connection_id(this_connection_id.string());
+  closest_nodes_update_subscribe.set_subscribe(subscribe);
+  message.set_destination_id(node_id.string());
+  message.set_source_id(this_node_id.string());
+  message.set_routing_message(true);
+  message.add_data(closest_nodes_update_subscribe.SerializeAsString());
+  message.set_direct(true);
+  message.set_replication(1);
+  message.set_type(static_cast<int32_t>(MessageType::kClosestNodesUpdateSubscribe));
+  message.set_request(true);
+  message.set_client_node(client_node);
+  message.set_hops_to_live(Parameters::hops_to_live);
+  message.set_id(RandomUint32() % 10000);
+  assert(message.IsInitialized() && "Unintialised message");
+  return message;
+}
+
 protobuf::Message GetGroup(const NodeId& node_id,
                            const NodeId& my_node_id) {
   assert(!node_id.IsZero() && "Invalid node_id");
@@ -16,6 +16,7 @@ License.
 #ifndef MAIDSAFE_ROUTING_RPCS_H_
 #define MAIDSAFE_ROUTING_RPCS_H_
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -83,7 +84,19 @@ protobuf::Message ConnectSuccessAcknowledgement(
 
 protobuf::Message ClosestNodesUpdate(const NodeId& node_id,
     const NodeId& my_node_id,
-    const std::vector<NodeInfo>& closest_nodes);
+    const std::vector<NodeInfo>& closest_nodes,
+    uint64_t version = 0);
+
+protobuf::Message ClosestNodesUpdateDelta(const NodeId& node_id,
+    const NodeId& my_node_id,
+    uint64_t version,
+    const std::vector<NodeInfo>& added_nodes,
+    const std::vector<NodeId>& removed_nodes);
+
+protobuf::Message ClosestNodesUpdateResync(const NodeId& node_id,
+    const NodeId& my_node_id,
+    const NodeId& my_connection_id,
+    const bool& client_node);
 
 protobuf::Message ClosestNodesUpdateSubscribe(
     const NodeId& node_id,
@@ -76,7 +76,7 @@ void Service::Ping(protobuf::Message& message) {
   ping_response.set_original_signature(message.signature());
   ping_response.set_timestamp(GetTimeStamp());
   message.set_request(false);
-  message.clear_route_history();
+  message.clear_route_history_ring();
   message.clear_data();
   message.add_data(ping_response.SerializeAsString());
   message.set_destination_id(message.source_id());
@@ -130,7 +130,7 @@ void Service::Connect(protobuf::Message& message) {
   connect_response.set_original_request(message.data(0));
   connect_response.set_original_signature(message.signature());
 
-  message.clear_route_history();
+  message.clear_route_history_ring();
   message.clear_data();
   message.set_direct(true);
   message.set_replication(1);
@@ -264,7 +264,7 @@ void Service::FindNodes(protobuf::Message& message) {
     LOG(kVerbose) << "Relay message, so not setting destination ID.";
   }
   message.set_source_id(routing_table_.kNodeId().string());
-  message.clear_route_history();
+  message.clear_route_history_ring();
   message.clear_data();
   message.add_data(found_nodes.SerializeAsString());
   message.set_direct(true);
@@ -339,10 +339,10 @@ void Service::GetGroup(protobuf::Message& message) {
   get_group.set_node_id(routing_table_.kNodeId().string());
   for (const auto& node_id : close_nodes_id)
     get_group.add_group_nodes_id(node_id.string());
-  message.clear_route_history();
+  message.clear_route_history_ring();
   message.set_destination_id(message.source_id());
   message.set_source_id(routing_table_.kNodeId().string());
-  message.clear_route_history();
+  message.clear_route_history_ring();
   message.clear_data();
   message.add_data(get_group.SerializeAsString());
   message.set_direct(true);
@@ -260,6 +260,38 @@ TEST_F(ClientRoutingTableTest, BEH_DropConnection) {
   EXPECT_EQ(0, client_routing_table.size());
 }
 
+TEST_F(ClientRoutingTableTest, BEH_DropConnectionOfSharedNodeId) {
+  ClientRoutingTable client_routing_table(node_id_);
+
+  PopulateNodesSetFurthestCloseNode(Parameters::max_client_routing_table_size,
+                                    client_routing_table.kNodeId());
+  ScrambleNodesOrder();
+
+  std::vector<NodeInfo> expected_nodes;
+  NodeId sought_id(BiasNodeIds(expected_nodes));
+
+  PopulateClientRoutingTable(client_routing_table);
+
+  // Each connection of the node id goes in turn, leaving the others in place
+  while (!expected_nodes.empty()) {
+    EXPECT_TRUE(client_routing_table.Contains(sought_id));
+    NodeInfo dropped_node(client_routing_table.DropConnection(expected_nodes.back().connection_id));
+    EXPECT_EQ(sought_id, dropped_node.node_id);
+    EXPECT_EQ(expected_nodes.back().connection_id, dropped_node.connection_id);
+    expected_nodes.pop_back();
+    EXPECT_EQ(expected_nodes.size(), client_routing_table.GetNodesInfo(sought_id).size());
+  }
+  EXPECT_FALSE(client_routing_table.Contains(sought_id));
+  EXPECT_TRUE(client_routing_table.DropConnection(NodeId(NodeId::kRandomId)).node_id.IsZero());
+
+  // The dropped connections can be added again
+  for (auto& node : nodes_) {
+    if (node.node_id == sought_id)
+      EXPECT_TRUE(client_routing_table.AddNode(node, furthest_close_node_.node_id));
+  }
+  EXPECT_EQ(nodes_.size(), client_routing_table.size());
+}
+
 TEST_F(ClientRoutingTableTest, BEH_GetNodesInfo) {
   ClientRoutingTable client_routing_table(node_id_);
 
@@ -0,0 +1,75 @@
+/* Copyright 2012 MaidSafe.net limited
+
+This MaidSafe Software is licensed under the MaidSafe.net Commercial License, version 1.0 or later,
+and The General Public License (GPL), version 3. By contributing code to this project You agree to
+the terms laid out in the MaidSafe Contributor Agreement, version 1.0, found in the root directory
+of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also available at:
+
+http://www.novinet.com/license
+
+Unless required by applicable law or agreed to in writing, software distributed under the License is
+distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+implied. See the License for the specific language governing permissions and limitations under the
+License.
+*/
+
+#include <string>
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/node_id.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/routing/distance.h"
+
+namespace maidsafe {
+namespace routing {
+namespace test {
+
+namespace {
+
+crypto::BigInt ToBigInt(const NodeId& node_id) {
+  return crypto::BigInt((node_id.ToStringEncoded(NodeId::kHex) + 'h').c_str());
+}
+
+}  // unnamed namespace
+
+TEST(DistanceTest, BEH_RoundTrip) {
+  EXPECT_EQ(NodeId(), Distance().ToNodeId());
+  EXPECT_EQ(NodeId(NodeId::kMaxId), Distance(NodeId(NodeId::kMaxId)).ToNodeId());
+  for (int i(0); i != 100; ++i) {
+    NodeId node_id(NodeId::kRandomId);
+    EXPECT_EQ(node_id, Distance(node_id).ToNodeId());
+  }
+}
+
+TEST(DistanceTest, BEH_CompareMatchesNodeId) {
+  for (int i(0); i != 1000; ++i) {
+    NodeId lhs(NodeId::kRandomId), rhs(i % 10 == 0 ? lhs : NodeId(NodeId::kRandomId));
+    EXPECT_EQ(lhs == rhs, Distance(lhs) == Distance(rhs));
+    EXPECT_EQ(lhs < rhs, Distance(lhs) < Distance(rhs));
+    EXPECT_EQ(lhs <= rhs, Distance(lhs) <= Distance(rhs));
+    EXPECT_EQ(lhs > rhs, Distance(lhs) > Distance(rhs));
+  }
+}
+
+TEST(DistanceTest, BEH_ArithmeticMatchesBigInt) {
+  for (int i(0); i != 100; ++i) {
+    NodeId lhs(NodeId::kRandomId), rhs(NodeId::kRandomId);
+    uint32_t multiplier(RandomUint32() % 10 + 1), divisor(RandomUint32() % 10000 + 1);
+
+    Distance sum(Distance(lhs) + Distance(rhs));
+    EXPECT_EQ((ToBigInt(lhs) + ToBigInt(rhs)) / 2, ToBigInt((sum / 2).ToNodeId()));
+    EXPECT_EQ(ToBigInt(lhs) / divisor, ToBigInt((Distance(lhs) / divisor).ToNodeId()));
+
+    Distance product(Distance(lhs) * multiplier);
+    EXPECT_EQ(Distance(lhs), product / multiplier);
+    EXPECT_EQ(ToBigInt(rhs) <= ToBigInt(lhs) * multiplier, Distance(rhs) <= product);
+  }
+  // Values beyond 512 bits saturate when converted back.
+  EXPECT_EQ(NodeId(NodeId::kMaxId), (Distance(NodeId(NodeId::kMaxId)) * 2).ToNodeId());
+}
+
+}  // namespace test
+}  // namespace routing
+}  // namespace maidsafe
@@ -13,9 +13,11 @@ implied. See the License for the specific language governing permissions and lim
 License.
 */
 
+#include <algorithm>
 #include <bitset>
 #include <memory>
 #include <numeric>
+#include <string>
 #include <vector>
 
 #include "maidsafe/common/node_id.h"
@@ -862,6 +864,25 @@ TEST_P(GroupMatrixTest, BEH_Prune) {
                                    return node.node_id == far_id;
                                  }));
   EXPECT_EQ(far_node_itr, connected_peers.end());
+
+  // Rows are kept in order of distance from this node, and their entries in order of distance from
+  // the row's owner
+  EXPECT_TRUE(std::is_sorted(connected_peers.begin(),
+                             connected_peers.end(),
+                             [this](const NodeInfo& lhs, const NodeInfo& rhs) {
+                               return NodeId::CloserToTarget(lhs.node_id, rhs.node_id,
+                                                             own_node_id_);
+                             }));
+  for (const auto& peer : connected_peers) {
+    std::vector<NodeInfo> row;
+    EXPECT_TRUE(matrix_.GetRow(peer.node_id, row));
+    NodeId peer_id(peer.node_id);
+    EXPECT_TRUE(std::is_sorted(row.begin(),
+                               row.end(),
+                               [peer_id](const NodeInfo& lhs, const NodeInfo& rhs) {
+                                 return NodeId::CloserToTarget(lhs.node_id, rhs.node_id, peer_id);
+                               }));
+  }
 }
 
 TEST_P(GroupMatrixTest, BEH_CheckAssertions) {
@@ -929,6 +950,193 @@ TEST_P(GroupMatrixTest, BEH_CheckAssertions) {
 }
 
 
+TEST_P(GroupMatrixTest, BEH_UniqueNodesSharedBetweenRows) {
+  NodeInfo row_1, row_2, shared, only_1, only_2;
+  row_1.node_id = NodeId(NodeId::kRandomId);
+  row_2.node_id = NodeId(NodeId::kRandomId);
+  shared.node_id = NodeId(NodeId::kRandomId);
+  only_1.node_id = NodeId(NodeId::kRandomId);
+  only_2.node_id = NodeId(NodeId::kRandomId);
+  matrix_.AddConnectedPeer(row_1);
+  matrix_.AddConnectedPeer(row_2);
+  matrix_.UpdateFromConnectedPeer(row_1.node_id, std::vector<NodeInfo>(1, shared));
+  matrix_.UpdateFromConnectedPeer(row_2.node_id, std::vector<NodeInfo>(1, shared));
+  matrix_.UpdateFromConnectedPeer(row_2.node_id, std::vector<NodeInfo>(1, only_2));
+  matrix_.UpdateFromConnectedPeer(row_1.node_id, std::vector<NodeInfo>(1, only_1));
+  matrix_.UpdateFromConnectedPeer(row_1.node_id, std::vector<NodeInfo>(1, shared));
+
+  // 'shared' is still held by row_1, 'only_1' was dropped by the second update of row_1
+  std::vector<NodeInfo> expected;
+  if (!client_mode_)
+    expected.push_back(own_node_info_);
+  expected.push_back(row_1);
+  expected.push_back(row_2);
+  expected.push_back(shared);
+  expected.push_back(only_2);
+  EXPECT_TRUE(CompareListOfNodeInfos(expected, matrix_.GetUniqueNodes()));
+  EXPECT_TRUE(matrix_.Contains(shared.node_id));
+  EXPECT_FALSE(matrix_.Contains(only_1.node_id));
+
+  // Unique node ids are kept sorted by distance from this node
+  std::vector<NodeId> sorted_ids(matrix_.GetUniqueNodeIds());
+  SortIdsFromTarget(own_node_id_, sorted_ids);
+  EXPECT_EQ(sorted_ids, matrix_.GetUniqueNodeIds());
+
+  MatrixChange::Snapshot old_matrix(matrix_.GetUniqueNodeIdsSnapshot());
+  EXPECT_EQ(old_matrix, matrix_.GetUniqueNodeIdsSnapshot());
+  MatrixChange matrix_change;
+  matrix_.RemoveConnectedPeer(row_1, matrix_change);
+  expected.erase(std::remove_if(expected.begin(), expected.end(),
+                                [&](const NodeInfo& node_info) {
+                                  return node_info.node_id == row_1.node_id ||
+                                         node_info.node_id == shared.node_id;
+                                }),
+                 expected.end());
+  EXPECT_TRUE(CompareListOfNodeInfos(expected, matrix_.GetUniqueNodes()));
+  EXPECT_FALSE(matrix_.Contains(shared.node_id));
+  EXPECT_TRUE(matrix_.Contains(only_2.node_id));
+
+  // The change shares the snapshots and lists the removed ids in order of distance
+  EXPECT_EQ(old_matrix, matrix_change.old_matrix);
+  EXPECT_EQ(matrix_.GetUniqueNodeIdsSnapshot(), matrix_change.new_matrix);
+  EXPECT_EQ(matrix_.GetUniqueNodeIds(), *matrix_change.new_matrix);
+  EXPECT_TRUE(matrix_change.added.empty());
+  std::vector<NodeId> removed(1, row_1.node_id);
+  removed.push_back(shared.node_id);
+  SortIdsFromTarget(own_node_id_, removed);
+  EXPECT_EQ(removed, matrix_change.removed);
+  EXPECT_FALSE(matrix_change.OldEqualsToNew());
+
+  matrix_change = matrix_.GetMatrixChange(old_matrix);
+  EXPECT_EQ(removed, matrix_change.removed);
+  matrix_change = matrix_.GetMatrixChange(matrix_.GetUniqueNodeIdsSnapshot());
+  EXPECT_TRUE(matrix_change.OldEqualsToNew());
+
+  matrix_.AddConnectedPeer(row_1);
+  matrix_change = matrix_.GetMatrixChange(old_matrix);
+  EXPECT_TRUE(matrix_change.added.empty());
+  EXPECT_EQ(std::vector<NodeId>(1, shared.node_id), matrix_change.removed);
+}
+
+
+TEST_P(GroupMatrixTest, BEH_GetBetterNodeForSendingMessage) {
+  std::vector<NodeInfo> row_ids, all_nodes;
+  for (uint16_t i(0); i < Parameters::closest_nodes_size; ++i) {
+    NodeInfo row_id;
+    row_id.node_id = NodeId(NodeId::kRandomId);
+    row_ids.push_back(row_id);
+    all_nodes.push_back(row_id);
+    matrix_.AddConnectedPeer(row_id);
+    std::vector<NodeInfo> row_entries;
+    for (uint16_t j(0); j < Parameters::closest_nodes_size; ++j) {
+      NodeInfo node_info;
+      node_info.node_id = NodeId(NodeId::kRandomId);
+      row_entries.push_back(node_info);
+      all_nodes.push_back(node_info);
+    }
+    matrix_.UpdateFromConnectedPeer(row_id.node_id, row_entries);
+  }
+
+  for (int i(0); i < 50; ++i) {
+    NodeId target_id(NodeId::kRandomId);
+    std::vector<std::string> exclude;
+    std::vector<NodeInfo> candidates(all_nodes);
+    for (int j(0); j < 3; ++j) {
+      auto excluded(candidates.begin() + RandomUint32() % candidates.size());
+      exclude.push_back(excluded->node_id.string());
+      candidates.erase(excluded);
+    }
+    SortFromTarget(target_id, candidates);
+
+    NextHop current_closest(own_node_id_, NodeId());
+    matrix_.GetBetterNodeForSendingMessage(target_id, PackNodeIds(exclude), false, current_closest);
+
+    // Rows of excluded peers are ignored, so the expected node is the closest one held by the row
+    // of a peer which isn't excluded.
+    NodeId expected_id(own_node_id_);
+    for (const auto& candidate : candidates) {
+      if (!NodeId::CloserToTarget(candidate.node_id, own_node_id_, target_id))
+        break;
+      if (std::find_if(row_ids.begin(), row_ids.end(),
+                       [&](const NodeInfo& row_id) {
+                         std::vector<NodeInfo> row;
+                         return std::find(exclude.begin(), exclude.end(),
+                                          row_id.node_id.string()) == exclude.end() &&
+                                matrix_.GetRow(row_id.node_id, row) &&
+                                (row_id.node_id == candidate.node_id ||
+                                 std::find_if(row.begin(), row.end(),
+                                              [&](const NodeInfo& node_info) {
+                                                return node_info.node_id == candidate.node_id;
+                                              }) != row.end());
+                       }) != row_ids.end()) {
+        expected_id = candidate.node_id;
+        break;
+      }
+    }
+
+    if (expected_id == own_node_id_) {
+      EXPECT_EQ(own_node_id_, current_closest.node_id);
+      continue;
+    }
+    EXPECT_TRUE(std::find(exclude.begin(), exclude.end(), current_closest.node_id.string()) ==
+                exclude.end());
+    std::vector<NodeInfo> row;
+    ASSERT_TRUE(matrix_.GetRow(current_closest.node_id, row));
+    row.push_back(current_closest);
+    EXPECT_TRUE(std::find_if(row.begin(), row.end(),
+                             [&](const NodeInfo& node_info) {
+                               return node_info.node_id == expected_id;
+                             }) != row.end());
+  }
+}
+
+
+TEST_P(GroupMatrixTest, BEH_UpdateFromConnectedPeerDelta) {
+  NodeInfo row_1;
+  row_1.node_id = NodeId(NodeId::kRandomId);
+  std::vector<NodeInfo> row_entries_1;
+  NodeInfo node_info;
+  while (row_entries_1.size() < 3) {
+    node_info.node_id = NodeId(NodeId::kRandomId);
+    row_entries_1.push_back(node_info);
+  }
+  matrix_.AddConnectedPeer(row_1);
+
+  // No version to build on
+  std::vector<NodeInfo> added_nodes(1, NodeInfo());
+  added_nodes.front().node_id = NodeId(NodeId::kRandomId);
+  std::vector<NodeId> removed_nodes(1, row_entries_1.front().node_id);
+  EXPECT_FALSE(matrix_.UpdateFromConnectedPeer(row_1.node_id, added_nodes, removed_nodes, 1, 2));
+  matrix_.UpdateFromConnectedPeer(row_1.node_id, row_entries_1, 1);
+
+  // Gap in versions
+  EXPECT_FALSE(matrix_.UpdateFromConnectedPeer(row_1.node_id, added_nodes, removed_nodes, 2, 3));
+  std::vector<NodeInfo> row_result;
+  EXPECT_TRUE(matrix_.GetRow(row_1.node_id, row_result));
+  EXPECT_TRUE(CompareListOfNodeInfos(row_entries_1, row_result));
+
+  // Next version
+  EXPECT_TRUE(matrix_.UpdateFromConnectedPeer(row_1.node_id, added_nodes, removed_nodes, 1, 2));
+  row_entries_1.erase(row_entries_1.begin());
+  row_entries_1.push_back(added_nodes.front());
+  EXPECT_TRUE(matrix_.GetRow(row_1.node_id, row_result));
+  EXPECT_TRUE(CompareListOfNodeInfos(row_entries_1, row_result));
+  EXPECT_EQ(row_1.node_id, matrix_.GetConnectedPeerFor(added_nodes.front().node_id).node_id);
+  EXPECT_TRUE(matrix_.GetConnectedPeerFor(removed_nodes.front()).node_id.IsZero());
+
+  // Stale version is ignored
+  EXPECT_TRUE(matrix_.UpdateFromConnectedPeer(row_1.node_id, added_nodes, removed_nodes, 1, 2));
+  EXPECT_TRUE(matrix_.GetRow(row_1.node_id, row_result));
+  EXPECT_TRUE(CompareListOfNodeInfos(row_entries_1, row_result));
+
+  // Changes which don't fit the row
+  EXPECT_FALSE(matrix_.UpdateFromConnectedPeer(row_1.node_id, added_nodes,
+                                               std::vector<NodeId>(), 2, 3));
+  EXPECT_TRUE(matrix_.GetRow(row_1.node_id, row_result));
+  EXPECT_TRUE(CompareListOfNodeInfos(row_entries_1, row_result));
+}
+
+
 INSTANTIATE_TEST_CASE_P(VaultModeClientMode,
                         GroupMatrixTest,
                         testing::Bool());
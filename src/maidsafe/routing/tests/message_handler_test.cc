@@ -13,7 +13,9 @@ implied. See the License for the specific language governing permissions and lim
 License.
 */
 
+#include <algorithm>
 #include <chrono>
+#include <vector>
 
 #include "maidsafe/common/asio_service.h"
 #include "maidsafe/common/utils.h"
@@ -33,6 +35,7 @@ License.
 #include "maidsafe/routing/parameters.h"
 #include "maidsafe/routing/routing.pb.h"
 #include "maidsafe/routing/routing_table.h"
+#include "maidsafe/routing/rpcs.h"
 #include "maidsafe/routing/timer.h"
 
 
@@ -634,6 +637,37 @@ TEST_F(MessageHandlerTest, BEH_HandleNodeLevelMessage) {
     message.set_request(false);
     message_handler.HandleMessage(message);
   }
+  {  // Handle duplicate copies of a multipath node level request to this node
+    EXPECT_CALL(*utils_, SendToClosestNode(testing::_)).Times(1).RetiresOnSaturation();
+    EXPECT_CALL(*utils_, SendToDirect(testing::_, testing::_, testing::_)).Times(0);
+    message.set_hops_to_live(1);
+    message.set_request(true);
+    message.set_multipath(true);
+    message.set_multipath_nonce(5484);
+    message.set_id(5484);
+    message_handler.HandleMessage(message);
+    message.set_hops_to_live(1);
+    message_handler.HandleMessage(message);
+    std::unique_lock<std::mutex> lock(mutex_);
+    EXPECT_TRUE(cond_var_.wait_for(lock,
+                                   std::chrono::seconds(1),
+                                   [this]()->bool { return messages_received_ != 0; } ));  // NOLINT
+    EXPECT_EQ(messages_received_, 1);
+    messages_received_ = 0;
+  }
+  {  // A new multipath request reusing the same source and message IDs isn't a duplicate
+    EXPECT_CALL(*utils_, SendToClosestNode(testing::_)).Times(1).RetiresOnSaturation();
+    EXPECT_CALL(*utils_, SendToDirect(testing::_, testing::_, testing::_)).Times(0);
+    message.set_hops_to_live(1);
+    message.set_multipath_nonce(5485);
+    message_handler.HandleMessage(message);
+    std::unique_lock<std::mutex> lock(mutex_);
+    EXPECT_TRUE(cond_var_.wait_for(lock,
+                                   std::chrono::seconds(1),
+                                   [this]()->bool { return messages_received_ != 0; } ));  // NOLINT
+    EXPECT_EQ(messages_received_, 1);
+    messages_received_ = 0;
+  }
 }
 
 TEST_F(MessageHandlerTest, BEH_ClientRoutingTable) {
@@ -755,6 +789,89 @@ TEST_F(MessageHandlerTest, BEH_ClientRoutingTable) {
   }
 }
 
+
+TEST_F(MessageHandlerTest, BEH_ClosestNodesUpdateVersionGap) {
+  MessageHandler message_handler(*table_, *ntable_, *utils_, timer_, *remove_furthest_node_,
+                                 *group_change_handler_, *network_statistics_);
+  message_handler.service_ = service_;
+  message_handler.response_handler_ = response_handler_;
+  std::vector<NodeInfo> row;
+  for (uint16_t i(0); i != Parameters::closest_nodes_size; ++i)
+    row.push_back(MakeNode());
+
+  {  // Whole list numbered 1, then the delta from it to 2, are applied without a resync
+    EXPECT_CALL(*utils_, SendToDirect(testing::_, testing::_, testing::_)).Times(0);
+    protobuf::Message message(rpcs::ClosestNodesUpdate(table_->kNodeId(), close_info_.node_id,
+                                                       row, 1));
+    message_handler.HandleMessage(message);
+    row.push_back(MakeNode());
+    message = rpcs::ClosestNodesUpdateDelta(table_->kNodeId(), close_info_.node_id, 2,
+                                            std::vector<NodeInfo>(1, row.back()),
+                                            std::vector<NodeId>(1, row.front().node_id));
+    message_handler.HandleMessage(message);
+    testing::Mock::VerifyAndClearExpectations(utils_.get());
+  }
+  {  // Delta from version 3, which was never received, asks the sender for its whole list
+    protobuf::Message resync_message;
+    EXPECT_CALL(*utils_, SendToDirect(testing::_, close_info_.node_id, close_info_.connection_id))
+        .WillOnce(testing::SaveArg<0>(&resync_message));
+    protobuf::Message message(rpcs::ClosestNodesUpdateDelta(
+        table_->kNodeId(), close_info_.node_id, 4, std::vector<NodeInfo>(1, MakeNode()),
+        std::vector<NodeId>()));
+    message_handler.HandleMessage(message);
+    testing::Mock::VerifyAndClearExpectations(utils_.get());
+    EXPECT_EQ(static_cast<int32_t>(MessageType::kClosestNodesUpdateResync), resync_message.type());
+    EXPECT_TRUE(resync_message.request());
+    EXPECT_EQ(close_info_.node_id.string(), resync_message.destination_id());
+    protobuf::ClosestNodesUpdateResync closest_nodes_update_resync;
+    ASSERT_TRUE(closest_nodes_update_resync.ParseFromString(resync_message.data(0)));
+    EXPECT_EQ(table_->kNodeId().string(), closest_nodes_update_resync.node_id());
+  }
+}
+
+TEST_F(MessageHandlerTest, BEH_ClosestNodesUpdateResync) {
+  MessageHandler message_handler(*table_, *ntable_, *utils_, timer_, *remove_furthest_node_,
+                                 *group_change_handler_, *network_statistics_);
+  message_handler.service_ = service_;
+  message_handler.response_handler_ = response_handler_;
+  std::vector<NodeInfo> closest_nodes(1, close_info_);
+  while (closest_nodes.size() < Parameters::closest_nodes_size)
+    closest_nodes.push_back(MakeNode());
+
+  // Versions 1 and 2 of this node's list go out to its close nodes.
+  EXPECT_CALL(*utils_, SendToDirect(testing::_, testing::_, testing::_))
+      .Times(testing::AnyNumber());
+  group_change_handler_->SendClosestNodesUpdateRpcs(closest_nodes);
+  closest_nodes.push_back(MakeNode());
+  group_change_handler_->SendClosestNodesUpdateRpcs(closest_nodes);
+  testing::Mock::VerifyAndClearExpectations(utils_.get());
+
+  protobuf::Message update_message;
+  EXPECT_CALL(*utils_, SendToDirect(testing::_, close_info_.node_id, close_info_.connection_id))
+      .WillOnce(testing::SaveArg<0>(&update_message));
+  protobuf::Message message(rpcs::ClosestNodesUpdateResync(table_->kNodeId(), close_info_.node_id,
+                                                           close_info_.connection_id, false));
+  message_handler.HandleMessage(message);
+  testing::Mock::VerifyAndClearExpectations(utils_.get());
+
+  EXPECT_EQ(static_cast<int32_t>(MessageType::kClosestNodesUpdate), update_message.type());
+  EXPECT_TRUE(update_message.request());
+  protobuf::ClosestNodesUpdate closest_nodes_update;
+  ASSERT_TRUE(closest_nodes_update.ParseFromString(update_message.data(0)));
+  EXPECT_FALSE(closest_nodes_update.has_base_version());
+  EXPECT_EQ(2U, closest_nodes_update.version());
+  EXPECT_EQ(0, closest_nodes_update.removed_nodes_size());
+  ASSERT_EQ(closest_nodes.size(), static_cast<size_t>(closest_nodes_update.nodes_info_size()));
+  for (const auto& node_info : closest_nodes) {
+    EXPECT_NE(closest_nodes_update.nodes_info().end(),
+              std::find_if(closest_nodes_update.nodes_info().begin(),
+                           closest_nodes_update.nodes_info().end(),
+                           [&node_info](const protobuf::BasicNodeInfo& basic_node_info) {
+                             return basic_node_info.node_id() == node_info.node_id.string();
+                           }));
+  }
+}
+
 }  // namespace test
 
 }  // namespace routing
@@ -27,6 +27,16 @@ MockNetworkUtils::MockNetworkUtils(RoutingTable& routing_table,
 
 MockNetworkUtils::~MockNetworkUtils() {}
 
+void MockNetworkUtils::SendToDirectReplicas(protobuf::Message& message,
+                                            const std::vector<NodeInfo>& peers) {
+  const std::string kOriginalDestinationId(message.destination_id());
+  for (const auto& peer : peers) {
+    message.set_destination_id(peer.node_id.string());
+    SendToDirect(message, peer.node_id, peer.connection_id);
+  }
+  message.set_destination_id(kOriginalDestinationId);
+}
+
 }  // namespace test
 
 }  // namespace routing
@@ -17,6 +17,7 @@ License.
 #define MAIDSAFE_ROUTING_TESTS_MOCK_NETWORK_UTILS_H_
 
 #include <string>
+#include <vector>
 
 #include "gmock/gmock.h"
 
@@ -40,6 +41,8 @@ class MockNetworkUtils : public NetworkUtils {
   MOCK_METHOD3(SendToDirect, void(const protobuf::Message& message,
                                   const NodeId& peer,
                                   const NodeId& connection));
+  // Forwards to SendToDirect once per replica so expectations can be set on each replica.
+  virtual void SendToDirectReplicas(protobuf::Message& message, const std::vector<NodeInfo>& peers);
   MOCK_METHOD3(Add, int(const NodeId& peer_id,
                         const rudp::EndpointPair& peer_endpoint_pair,
                         const std::string& validation_data));
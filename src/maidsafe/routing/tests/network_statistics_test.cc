@@ -18,6 +18,7 @@ License.
 #include <numeric>
 #include <vector>
 
+#include "maidsafe/common/crypto.h"
 #include "maidsafe/common/node_id.h"
 #include "maidsafe/common/test.h"
 
@@ -40,7 +41,7 @@ TEST(NetworkStatisticsTest, BEH_AverageDistance) {
   EXPECT_EQ(network_statistics.network_distance_data_.average_distance, average);
 
   node_id = NodeId();
-  network_statistics.network_distance_data_.total_distance = crypto::BigInt::Zero();
+  network_statistics.network_distance_data_.total_distance = Distance();
   network_statistics.network_distance_data_.average_distance = NodeId();
   average = node_id;
   network_statistics.UpdateNetworkAverageDistance(node_id);
@@ -48,14 +49,13 @@ TEST(NetworkStatisticsTest, BEH_AverageDistance) {
 
   node_id = NodeId(NodeId::kMaxId);
   network_statistics.network_distance_data_.total_distance =
-      crypto::BigInt((node_id.ToStringEncoded(NodeId::kHex) + 'h').c_str()) *
-      network_statistics.network_distance_data_.contributors_count;
+      Distance(node_id) * network_statistics.network_distance_data_.contributors_count;
   average = node_id;
   network_statistics.UpdateNetworkAverageDistance(node_id);
   EXPECT_EQ(network_statistics.network_distance_data_.average_distance, average);
 
   network_statistics.network_distance_data_.contributors_count = 0;
-  network_statistics.network_distance_data_.total_distance = crypto::BigInt::Zero();
+  network_statistics.network_distance_data_.total_distance = Distance();
 
   std::vector<NodeId> distances_as_node_id;
   std::vector<crypto::BigInt> distances_as_bigint;
@@ -92,7 +92,7 @@ TEST(NetworkStatisticsTest, BEH_IsIdInGroupRange) {
              Parameters::max_routing_table_size) {
     NodeInfo node(MakeNode());
     nodes_id.push_back(node.node_id);
-    routing_table.group_matrix_.unique_nodes_.push_back(node);
+    routing_table.group_matrix_.AddUniqueNode(node, my_node);
     EXPECT_TRUE(routing_table.AddNode(node));
   }
 
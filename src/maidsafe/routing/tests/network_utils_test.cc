@@ -14,10 +14,12 @@ License.
 */
 
 #include <boost/exception/all.hpp>
+#include <atomic>
 #include <chrono>
 #include <future>
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "boost/filesystem/exception.hpp"
@@ -33,6 +35,7 @@ License.
 #include "maidsafe/routing/return_codes.h"
 #include "maidsafe/routing/routing_table.h"
 #include "maidsafe/routing/routing.pb.h"
+#include "maidsafe/routing/utils.h"
 #include "maidsafe/routing/tests/test_utils.h"
 
 
@@ -57,6 +60,209 @@ void SortFromThisNode(const NodeId& from, std::vector<NodeInfoAndPrivateKey> nod
 
 }  // anonymous namespace
 
+TEST(NetworkUtilsTest, BEH_RouteHistoryRing) {
+  protobuf::Message message;
+  std::vector<NodeId> hops;
+  for (uint16_t i(0); i != Parameters::max_route_history + 2; ++i)
+    hops.push_back(NodeId(NodeId::kRandomId));
+
+  for (uint16_t i(0); i != Parameters::max_route_history; ++i) {
+    AddToRouteHistory(message, hops.at(i));
+    AddToRouteHistory(message, hops.at(i));  // repeated hop isn't added twice
+    EXPECT_EQ(i + 1U, RouteHistorySize(message));
+  }
+  EXPECT_EQ(Parameters::max_route_history * NodeId::kSize, message.route_history_ring().size());
+
+  // Once full, the oldest hops are overwritten in turn.
+  AddToRouteHistory(message, hops.at(Parameters::max_route_history));
+  AddToRouteHistory(message, hops.at(Parameters::max_route_history + 1));
+  EXPECT_EQ(Parameters::max_route_history, RouteHistorySize(message));
+  EXPECT_FALSE(RouteHistoryContains(message, hops.at(0)));
+  EXPECT_FALSE(RouteHistoryContains(message, hops.at(1)));
+  auto route_history(RouteHistoryIds(message));
+  ASSERT_EQ(Parameters::max_route_history, route_history.size());
+  for (uint16_t i(0); i != Parameters::max_route_history; ++i) {
+    EXPECT_TRUE(RouteHistoryContains(message, hops.at(i + 2)));
+    EXPECT_EQ(hops.at(i + 2).string(), route_history.at(i));
+  }
+
+  // Exclusions leave out the newest hop unless asked not to.
+  const NodeId kNewestHop(hops.at(Parameters::max_route_history + 1));
+  std::string exclusions(RouteHistoryExclusions(message, hops.at(0), false));
+  EXPECT_EQ((Parameters::max_route_history - 1) * NodeId::kSize, exclusions.size());
+  EXPECT_FALSE(PackedNodeIdsContain(exclusions, kNewestHop));
+  EXPECT_TRUE(PackedNodeIdsContain(exclusions, hops.at(2)));
+  exclusions = RouteHistoryExclusions(message, hops.at(0), true);
+  EXPECT_EQ(message.route_history_ring(), exclusions);
+
+  message.clear_route_history_ring();
+  AddToRouteHistory(message, hops.at(0));
+  route_history = RouteHistoryIds(message);
+  ASSERT_EQ(1U, route_history.size());
+  EXPECT_EQ(hops.at(0).string(), route_history.front());
+  EXPECT_TRUE(RouteHistoryExclusions(message, hops.at(0), false).empty());
+  EXPECT_EQ(hops.at(0).string(), RouteHistoryExclusions(message, hops.at(1), false));
+}
+
+TEST(NetworkUtilsTest, BEH_RecursiveSendRetryDelay) {
+  const bptime::time_duration kRetryDelay(Parameters::recursive_send_retry_delay);
+  const bptime::time_duration kMaxRetryDelay(Parameters::max_recursive_send_retry_delay);
+  Parameters::recursive_send_retry_delay = bptime::milliseconds(50);
+  Parameters::max_recursive_send_retry_delay = bptime::seconds(1);
+
+  EXPECT_EQ(bptime::milliseconds(50), NetworkUtils::RecursiveSendRetryDelay(0));
+  EXPECT_EQ(bptime::milliseconds(50), NetworkUtils::RecursiveSendRetryDelay(1));
+  bptime::time_duration previous_delay(NetworkUtils::RecursiveSendRetryDelay(1));
+  for (int attempt_count(2); attempt_count != 6; ++attempt_count) {
+    bptime::time_duration delay(NetworkUtils::RecursiveSendRetryDelay(attempt_count));
+    EXPECT_EQ(previous_delay * 2, delay) << "attempt_count " << attempt_count;
+    previous_delay = delay;
+  }
+  // 1600ms for the sixth attempt is over the maximum.
+  EXPECT_EQ(bptime::seconds(1), NetworkUtils::RecursiveSendRetryDelay(6));
+  EXPECT_EQ(bptime::seconds(1), NetworkUtils::RecursiveSendRetryDelay(100));
+
+  Parameters::recursive_send_retry_delay = kRetryDelay;
+  Parameters::max_recursive_send_retry_delay = kMaxRetryDelay;
+}
+
+TEST(NetworkUtilsTest, BEH_CircuitBreaker) {
+  const uint16_t kFailureThreshold(Parameters::circuit_breaker_failure_threshold);
+  const bptime::time_duration kOpenPeriod(Parameters::circuit_breaker_open_period);
+  Parameters::circuit_breaker_failure_threshold = 3;
+  Parameters::circuit_breaker_open_period = bptime::milliseconds(500);
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  ClientRoutingTable client_routing_table(routing_table.kNodeId());
+  NetworkUtils network(routing_table, client_routing_table);
+  NodeId peer_id(NodeId::kRandomId), other_peer_id(NodeId::kRandomId);
+
+  network.RecordSendResult(other_peer_id, true);
+  network.RecordSendResult(peer_id, false);
+  network.RecordSendResult(peer_id, false);
+  EXPECT_TRUE(network.PeersWithOpenCircuit().empty());
+
+  // Reaching the threshold opens the circuit, so the peer is excluded as a next hop.
+  network.RecordSendResult(peer_id, false);
+  EXPECT_EQ(peer_id.string(), network.PeersWithOpenCircuit());
+
+  // Until open_until passes.
+  Sleep(bptime::milliseconds(700));
+  EXPECT_TRUE(network.PeersWithOpenCircuit().empty());
+
+  Parameters::circuit_breaker_failure_threshold = kFailureThreshold;
+  Parameters::circuit_breaker_open_period = kOpenPeriod;
+}
+
+TEST(NetworkUtilsTest, BEH_PingRoundTripTime) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  ClientRoutingTable client_routing_table(routing_table.kNodeId());
+  NetworkUtils network(routing_table, client_routing_table);
+  NodeId peer_id(NodeId::kRandomId);
+
+  network.SendPing(peer_id, peer_id);
+  int32_t message_id(0);
+  {
+    std::lock_guard<std::mutex> lock(network.pending_pings_mutex_);
+    ASSERT_EQ(1U, network.pending_pings_.size());
+    message_id = network.pending_pings_.begin()->first;
+  }
+
+  // Only a response from the pinged peer to that ping gives a round trip time, and only once.
+  bptime::time_duration round_trip_time;
+  EXPECT_FALSE(network.PingResponseReceived(message_id + 1, peer_id, round_trip_time));
+  EXPECT_FALSE(network.PingResponseReceived(message_id, NodeId(NodeId::kRandomId),
+                                            round_trip_time));
+  Sleep(bptime::milliseconds(100));
+  EXPECT_TRUE(network.PingResponseReceived(message_id, peer_id, round_trip_time));
+  EXPECT_LE(bptime::milliseconds(100), round_trip_time);
+  EXPECT_FALSE(network.PingResponseReceived(message_id, peer_id, round_trip_time));
+}
+
+TEST(NetworkUtilsTest, BEH_ScheduledTasksCancelledOnDestruction) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  ClientRoutingTable client_routing_table(routing_table.kNodeId());
+  auto tasks_run(std::make_shared<std::atomic<int>>(0));
+  {
+    NetworkUtils network(routing_table, client_routing_table);
+    network.ScheduleTask(bptime::milliseconds(100), [tasks_run] { ++(*tasks_run); });
+    Sleep(bptime::milliseconds(500));
+    EXPECT_EQ(1, *tasks_run);
+    EXPECT_TRUE(network.timers_.empty());
+
+    network.ScheduleTask(bptime::milliseconds(500), [tasks_run] { ++(*tasks_run); });
+    EXPECT_EQ(1U, network.timers_.size());
+  }
+  Sleep(bptime::seconds(1));
+  EXPECT_EQ(1, *tasks_run);
+}
+
+TEST(NetworkUtilsTest, BEH_OutboundQueueFlush) {
+  const bptime::time_duration kCoalescingWindow(Parameters::send_coalescing_window);
+  const uint32_t kMaxBatchSize(Parameters::max_coalesced_batch_size);
+  Parameters::send_coalescing_window = bptime::milliseconds(500);
+  Parameters::max_coalesced_batch_size = 100;
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  ClientRoutingTable client_routing_table(routing_table.kNodeId());
+  NetworkUtils network(routing_table, client_routing_table);
+  // Not connected, so every send fails.
+  NodeId peer_id(NodeId::kRandomId);
+
+  std::mutex mutex;
+  std::vector<int> sent_count(3, 0), sent_result(3, kSuccess);
+  auto make_message_sent_functor = [&](int index)->rudp::MessageSentFunctor {
+      return [&, index](int message_sent) {
+          std::lock_guard<std::mutex> lock(mutex);
+          ++sent_count[index];
+          sent_result[index] = message_sent;
+        };
+    };
+
+  // The third message takes the queue over max_coalesced_batch_size, so the first two are sent
+  // straight away and the third starts a new queue.
+  const std::string kMessage(40, 'A');
+  for (int index(0); index != 3; ++index)
+    network.QueueForPeer(peer_id, kMessage, make_message_sent_functor(index));
+  {
+    std::lock_guard<std::mutex> lock(network.outbound_queues_mutex_);
+    ASSERT_EQ(1U, network.outbound_queues_.count(peer_id));
+    EXPECT_EQ(1U, network.outbound_queues_[peer_id].messages.size());
+  }
+  Sleep(bptime::milliseconds(200));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(1, sent_count[0]);
+    EXPECT_EQ(1, sent_count[1]);
+    EXPECT_EQ(0, sent_count[2]);
+    EXPECT_NE(kSuccess, sent_result[0]);
+    EXPECT_NE(kSuccess, sent_result[1]);
+  }
+
+  // The third is sent when the coalescing window passes.
+  Sleep(bptime::milliseconds(600));
+  {
+    std::lock_guard<std::mutex> lock(network.outbound_queues_mutex_);
+    EXPECT_TRUE(network.outbound_queues_.empty());
+  }
+  network.FlushOutboundQueue(peer_id);
+  Sleep(bptime::milliseconds(200));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(std::vector<int>(3, 1), sent_count);
+    EXPECT_NE(kSuccess, sent_result[2]);
+  }
+
+  Parameters::send_coalescing_window = kCoalescingWindow;
+  Parameters::max_coalesced_batch_size = kMaxBatchSize;
+}
+
 TEST(NetworkUtilsTest, BEH_ProcessSendDirectInvalidEndpoint) {
   protobuf::Message message;
   message.set_routing_message(true);
@@ -247,6 +453,147 @@ TEST(NetworkUtilsTest, FUNC_ProcessSendDirectEndpoint) {
   }
 }
 
+TEST(NetworkUtilsTest, FUNC_OutboundQueueSendBatch) {
+  const int kMessageCount(3);
+  const bptime::time_duration kCoalescingWindow(Parameters::send_coalescing_window);
+  Parameters::send_coalescing_window = bptime::milliseconds(500);
+  rudp::ManagedConnections rudp1, rudp2;
+  Endpoint endpoint1(GetLocalIp(),  maidsafe::test::GetRandomPort());
+  Endpoint endpoint2(GetLocalIp(),  maidsafe::test::GetRandomPort());
+
+  std::promise<bool> connection_completion_promise;
+  auto connection_completion_future = connection_completion_promise.get_future();
+  std::promise<int> batch_promise;
+  auto batch_future = batch_promise.get_future();
+  bool promised(true);
+
+  rudp::MessageReceivedFunctor message_received_functor1 = [](const std::string& message) {
+      LOG(kInfo) << " -- Received: " << message;
+    };
+
+  rudp::MessageReceivedFunctor message_received_functor2 = [&](const std::string& message) {
+      if ("validation" == message.substr(0, 10))
+        return;
+      protobuf::MessageBatch batch;
+      if (promised && batch.ParseFromString(message)) {
+        batch_promise.set_value(batch.messages_size());
+        promised = false;
+      }
+    };
+
+  rudp::MessageReceivedFunctor message_received_functor3 = [&](const std::string& message) {
+      LOG(kInfo) << " -- Received: " << message;
+      if ("validation" == message.substr(0, 10))
+        connection_completion_promise.set_value(true);
+    };
+
+  rudp::ConnectionLostFunctor connection_lost_functor = [](const NodeId& node_id) {
+      LOG(kInfo) << " -- Lost Connection with : " << HexSubstr(node_id.string());
+    };
+
+  auto pmid1(MakePmid());
+  NodeId node_id1(pmid1.name().data.string());
+  auto private_key1(std::make_shared<asymm::PrivateKey>(pmid1.private_key()));
+  auto public_key1(std::make_shared<asymm::PublicKey>(pmid1.public_key()));
+  rudp::NatType nat_type;
+  auto a1 = std::async(std::launch::async, [=, &rudp1, &nat_type]()->NodeId {
+      std::vector<Endpoint> bootstrap_endpoint(1, endpoint2);
+      NodeId chosen_bootstrap_peer;
+      if (rudp1.Bootstrap(bootstrap_endpoint, message_received_functor1, connection_lost_functor,
+                          node_id1, private_key1, public_key1, chosen_bootstrap_peer, nat_type,
+                          endpoint1) != kSuccess) {
+        chosen_bootstrap_peer = NodeId();
+      }
+      return chosen_bootstrap_peer;
+  });
+
+  auto pmid2(MakePmid());
+  NodeId node_id2(pmid2.name().data.string());
+  auto private_key2(std::make_shared<asymm::PrivateKey>(pmid2.private_key()));
+  auto public_key2(std::make_shared<asymm::PublicKey>(pmid2.public_key()));
+  auto a2 = std::async(std::launch::async, [=, &rudp2, &nat_type]()->NodeId {
+      std::vector<Endpoint> bootstrap_endpoint(1, endpoint1);
+      NodeId chosen_bootstrap_peer;
+      if (rudp2.Bootstrap(bootstrap_endpoint, message_received_functor2, connection_lost_functor,
+                          node_id2, private_key2, public_key2, chosen_bootstrap_peer, nat_type,
+                          endpoint2) != kSuccess) {
+        chosen_bootstrap_peer = NodeId();
+      }
+      return chosen_bootstrap_peer;
+  });
+
+  EXPECT_EQ(node_id2, a1.get());  // wait for promise !
+  EXPECT_EQ(node_id1, a2.get());  // wait for promise !
+  rudp::EndpointPair endpoint_pair_1, endpoint_pair_2, endpoint_pair_3;
+  endpoint_pair_1.local = endpoint1;
+  endpoint_pair_2.local = endpoint2;
+  Sleep(boost::posix_time::milliseconds(250));
+  EXPECT_EQ(rudp::kBootstrapConnectionAlreadyExists,
+            rudp1.GetAvailableEndpoint(node_id2, endpoint_pair_2, endpoint_pair_1, nat_type));
+  EXPECT_EQ(rudp::kBootstrapConnectionAlreadyExists,
+            rudp2.GetAvailableEndpoint(node_id1, endpoint_pair_1, endpoint_pair_2, nat_type));
+  EXPECT_EQ(kSuccess, rudp1.Add(node_id2, endpoint_pair_2, "validation_1->2"));
+  EXPECT_EQ(kSuccess, rudp2.Add(node_id1, endpoint_pair_1, "validation_2->1"));
+  Endpoint endpoint;
+  rudp1.MarkConnectionAsValid(node_id2, endpoint);
+  rudp2.MarkConnectionAsValid(node_id1, endpoint);
+
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  NodeId node_id3(routing_table.kNodeId());
+  ClientRoutingTable client_routing_table(routing_table.kNodeId());
+  NetworkUtils network(routing_table, client_routing_table);
+
+  std::vector<Endpoint> bootstrap_endpoint(1, endpoint2);
+  EXPECT_EQ(kSuccess, network.Bootstrap(bootstrap_endpoint,
+                                        message_received_functor3,
+                                        connection_lost_functor));
+  rudp::NatType this_nat_type;
+  EXPECT_EQ(rudp::kBootstrapConnectionAlreadyExists,
+            network.GetAvailableEndpoint(node_id2, endpoint_pair_2, endpoint_pair_3,
+                                         this_nat_type));
+  EXPECT_EQ(rudp::kBootstrapConnectionAlreadyExists,
+            rudp2.GetAvailableEndpoint(node_id3, endpoint_pair_3, endpoint_pair_2, this_nat_type));
+  EXPECT_EQ(rudp::kSuccess, network.Add(node_id2, endpoint_pair_2, "validation_3->2"));
+  EXPECT_EQ(kSuccess, rudp2.Add(node_id3, endpoint_pair_3, "validation_2->3"));
+  if (connection_completion_future.wait_for(std::chrono::seconds(10)) !=
+      std::future_status::ready) {
+    ASSERT_TRUE(false) << "Failed waiting for node-3 to receive validation data";
+  }
+
+  std::mutex mutex;
+  std::vector<int> sent_count(kMessageCount, 0), sent_result(kMessageCount, -1);
+  protobuf::Message sent_message;
+  sent_message.set_destination_id(node_id2.string());
+  sent_message.set_routing_message(true);
+  sent_message.set_request(true);
+  sent_message.add_data("data");
+  sent_message.set_direct(true);
+  sent_message.set_type(10);
+  sent_message.set_client_node(false);
+  for (int index(0); index != kMessageCount; ++index) {
+    network.QueueForPeer(node_id2, sent_message.SerializeAsString(),
+                         [&, index](int message_sent) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             ++sent_count[index];
+                             sent_result[index] = message_sent;
+                           });
+  }
+
+  // All three go out as one batch when the coalescing window passes.
+  ASSERT_EQ(std::future_status::ready, batch_future.wait_for(std::chrono::seconds(10)));
+  EXPECT_EQ(kMessageCount, batch_future.get());
+  Sleep(bptime::seconds(1));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(std::vector<int>(kMessageCount, 1), sent_count);
+    EXPECT_EQ(std::vector<int>(kMessageCount, kSuccess), sent_result);
+  }
+
+  Parameters::send_coalescing_window = kCoalescingWindow;
+}
+
 // RT with only 1 active node and 7 inactive node
 TEST(NetworkUtilsTest, FUNC_ProcessSendRecursiveSendOn) {
   const int kMessageCount(1);
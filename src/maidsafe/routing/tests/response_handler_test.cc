@@ -55,7 +55,8 @@ class ResponseHandlerTest : public testing::Test {
        client_routing_table_(routing_table_.kNodeId()),
        network_(routing_table_, client_routing_table_),
        group_change_handler_(routing_table_, client_routing_table_, network_),
-       response_handler_(routing_table_, client_routing_table_, network_, group_change_handler_) {}
+       response_handler_(std::make_shared<ResponseHandler>(routing_table_, client_routing_table_,
+                                                           network_, group_change_handler_)) {}
 
   int GetAvailableEndpoint(rudp::EndpointPair& this_endpoint_pair,
                            rudp::NatType& this_nat_type,
@@ -156,7 +157,7 @@ class ResponseHandlerTest : public testing::Test {
     protobuf::Message message;
 //     message.set_destination_id(message.source_id());
     message.set_source_id(routing_table_.kNodeId().string());
-    message.clear_route_history();
+    message.clear_route_history_ring();
     message.clear_data();
     message.add_data(data);
     message.set_direct(true);
@@ -206,28 +207,29 @@ class ResponseHandlerTest : public testing::Test {
   ClientRoutingTable client_routing_table_;
   MockNetworkUtils network_;
   GroupChangeHandler group_change_handler_;
-  ResponseHandler response_handler_;
+  // Held by shared_ptr, as ResponseHandler uses shared_from_this.
+  std::shared_ptr<ResponseHandler> response_handler_;
 };
 
 TEST_F(ResponseHandlerTest, BEH_FindNodes) {
   protobuf::Message message;
   // Incorrect FindNodeResponse msg
   message = ComposeMsg(RandomString(128));
-  response_handler_.FindNodes(message);
+  response_handler_->FindNodes(message);
 
   // Incorrect Original FindNodesRequest part
   message = ComposeMsg(ComposeFindNodesResponse(RandomString(128), 4).SerializeAsString());
-  response_handler_.FindNodes(message);
+  response_handler_->FindNodes(message);
 
   // In case of collision
   std::vector<NodeId> nodes;
   nodes.push_back(routing_table_.kNodeId());
   message = ComposeFindNodesResponseMsg(1, nodes);
-  response_handler_.FindNodes(message);
+  response_handler_->FindNodes(message);
 
   // In case of need to re-bootstrap
   message = ComposeFindNodesResponseMsg(4);
-  response_handler_.FindNodes(message);
+  response_handler_->FindNodes(message);
 
   NodeInfo node_info = MakeNodeInfoAndKeys().node_info;
   routing_table_.AddNode(node_info);
@@ -239,7 +241,7 @@ TEST_F(ResponseHandlerTest, BEH_FindNodes) {
       .WillOnce(testing::WithArgs<2, 3>(testing::Invoke(
             boost::bind(&ResponseHandlerTest::GetAvailableEndpoint, this, _1, _2, kSuccess))));
   EXPECT_CALL(network_, SendToClosestNode(testing::_)).Times(1);
-  response_handler_.FindNodes(message);
+  response_handler_->FindNodes(message);
 
   // Properly found 4 nodes and trying to connect
   message = ComposeFindNodesResponseMsg(4);
@@ -248,7 +250,7 @@ TEST_F(ResponseHandlerTest, BEH_FindNodes) {
       .WillRepeatedly(testing::WithArgs<2, 3>(testing::Invoke(
             boost::bind(&ResponseHandlerTest::GetAvailableEndpoint, this, _1, _2, kSuccess))));
   EXPECT_CALL(network_, SendToClosestNode(testing::_)).Times(4);
-  response_handler_.FindNodes(message);
+  response_handler_->FindNodes(message);
 
   // In case routing_table_ is full
   while (routing_table_.size() < Parameters::greedy_fraction) {
@@ -280,54 +282,107 @@ TEST_F(ResponseHandlerTest, BEH_FindNodes) {
       .WillRepeatedly(testing::WithArgs<2, 3>(testing::Invoke(
             boost::bind(&ResponseHandlerTest::GetAvailableEndpoint, this, _1, _2, kSuccess))));
   EXPECT_CALL(network_, SendToClosestNode(testing::_)).Times(static_cast<int>(num_of_closer));
-  response_handler_.FindNodes(message);
+  response_handler_->FindNodes(message);
+}
+
+TEST_F(ResponseHandlerTest, BEH_FindNodesAddsValidatedPeersTogether) {
+  const boost::posix_time::time_duration kDefaultConnectBatchWindow(
+      Parameters::connect_batch_window);
+  Parameters::connect_batch_window = boost::posix_time::milliseconds(100);
+  response_handler_->set_request_public_key_functor(
+      boost::bind(&ResponseHandlerTest::RequestPublicKey, this, _1, _2));
+  routing_table_.AddNode(MakeNodeInfoAndKeys().node_info);
+
+  auto find_nodes([&](const std::vector<NodeId>& nodes) {
+    EXPECT_CALL(network_, GetAvailableEndpoint(testing::_, testing::_, testing::_, testing::_))
+        .Times(static_cast<int>(nodes.size()))
+        .WillRepeatedly(testing::WithArgs<2, 3>(testing::Invoke(
+              boost::bind(&ResponseHandlerTest::GetAvailableEndpoint, this, _1, _2, kSuccess))));
+    EXPECT_CALL(network_, SendToClosestNode(testing::_)).Times(static_cast<int>(nodes.size()));
+    response_handler_->FindNodes(ComposeFindNodesResponseMsg(nodes.size(), nodes));
+  });
+  auto acknowledge([&](const NodeId& node_id) {
+    EXPECT_CALL(network_, MarkConnectionAsValid(testing::_))
+        .WillOnce(testing::Return(kSuccess));
+    protobuf::Message message(ComposeMsg(ComposeConnectSuccessAcknowledgement(
+        node_id, NodeId(NodeId::kRandomId), false).SerializeAsString()));
+    response_handler_->ConnectSuccessAcknowledgement(message);
+  });
+
+  // Nothing is added until every found peer has been validated.
+  const size_t kNumOfFoundNodes(4);
+  std::vector<NodeId> nodes;
+  for (size_t i(0); i < kNumOfFoundNodes; ++i)
+    nodes.push_back(NodeId(NodeId::kRandomId));
+  find_nodes(nodes);
+  for (const auto& node_id : nodes) {
+    EXPECT_EQ(1U, routing_table_.size());
+    acknowledge(node_id);
+  }
+  EXPECT_EQ(1U + kNumOfFoundNodes, routing_table_.size());
+
+  // Once the batch window has passed, the peers validated so far are added, and any later ones are
+  // added as they arrive.
+  nodes.clear();
+  for (size_t i(0); i < kNumOfFoundNodes; ++i)
+    nodes.push_back(NodeId(NodeId::kRandomId));
+  find_nodes(nodes);
+  for (size_t i(0); i < kNumOfFoundNodes - 1; ++i)
+    acknowledge(nodes[i]);
+  EXPECT_EQ(1U + kNumOfFoundNodes, routing_table_.size());
+  Sleep(Parameters::connect_batch_window * 3);
+  EXPECT_EQ(kNumOfFoundNodes * 2, routing_table_.size());
+  acknowledge(nodes.back());
+  EXPECT_EQ(1U + kNumOfFoundNodes * 2, routing_table_.size());
+
+  Parameters::connect_batch_window = kDefaultConnectBatchWindow;
 }
 
 TEST_F(ResponseHandlerTest, BEH_Connect) {
   protobuf::Message message;
   // Incorrect ConnectResponse msg
   message = ComposeMsg(RandomString(128));
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // Incorrect Original ConnectRequest part
   message = ComposeMsg(ComposeConnectResponse(protobuf::ConnectResponseType::kAccepted,
       RandomString(128), NodeId(RandomString(64)), true).SerializeAsString());
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // In case of rejected
   message = ComposeConnectResponseMsg(protobuf::ConnectResponseType::kRejected);
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // In case of Already ongoing connection attempt
   message = ComposeConnectResponseMsg(
       protobuf::ConnectResponseType::kConnectAttemptAlreadyRunning);
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // In case of node already added
   message = ComposeConnectResponseMsg(protobuf::ConnectResponseType::kAccepted,
                                       routing_table_.kNodeId());
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // Invalid contact node_id details
   message = ComposeConnectResponseMsg(protobuf::ConnectResponseType::kAccepted, NodeId());
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // Invalid contact peer endpoint details
   message = ComposeConnectResponseMsg(protobuf::ConnectResponseType::kAccepted,
                                       NodeId(RandomString(64)), false);
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // Failed add to RUDP
   message = ComposeConnectResponseMsg(protobuf::ConnectResponseType::kAccepted);
   EXPECT_CALL(network_, Add(testing::_, testing::_, testing::_))
       .WillOnce(testing::Return(-350023));
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // Succeed add to RUDP
   message = ComposeConnectResponseMsg(protobuf::ConnectResponseType::kAccepted);
   EXPECT_CALL(network_, Add(testing::_, testing::_, testing::_))
       .WillOnce(testing::Return(kSuccess));
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 
   // Special case with bootstrapping peer in which kSuccess comes before connect response
   NodeId node_id(RandomString(64));
@@ -336,7 +391,7 @@ TEST_F(ResponseHandlerTest, BEH_Connect) {
   EXPECT_CALL(network_, Add(testing::_, testing::_, testing::_))
       .WillOnce(testing::Return(kSuccess));
   EXPECT_CALL(network_, SendToDirect(testing::_, testing::_, testing::_)).Times(1);
-  response_handler_.Connect(message);
+  response_handler_->Connect(message);
 }
 
 TEST_F(ResponseHandlerTest, BEH_ConnectSuccessAcknowledgement) {
@@ -344,17 +399,17 @@ TEST_F(ResponseHandlerTest, BEH_ConnectSuccessAcknowledgement) {
   NodeId node_id(RandomString(64)), connection_id(RandomString(64));
   // Incorrect ConnectSuccessAcknowledgement msg
   message = ComposeMsg(RandomString(128));
-  response_handler_.ConnectSuccessAcknowledgement(message);
+  response_handler_->ConnectSuccessAcknowledgement(message);
 
   // Invalid node_id
   message = ComposeMsg(ComposeConnectSuccessAcknowledgement(NodeId(),
                                                             connection_id).SerializeAsString());
-  response_handler_.ConnectSuccessAcknowledgement(message);
+  response_handler_->ConnectSuccessAcknowledgement(message);
 
   // Invalid peer connection_id
   message = ComposeMsg(ComposeConnectSuccessAcknowledgement(node_id,
                                                             NodeId()).SerializeAsString());
-  response_handler_.ConnectSuccessAcknowledgement(message);
+  response_handler_->ConnectSuccessAcknowledgement(message);
 
   // shared_from_this function inside requires the response_handler holder to be shared_ptr
   // if holding as a normal object, shared_from_this will throw an exception
@@ -458,11 +513,11 @@ TEST_F(ResponseHandlerTest, BEH_Ping) {
   protobuf::Message message;
   // Incorrect Ping msg
   message = ComposeMsg(RandomString(128));
-  response_handler_.Ping(message);
+  response_handler_->Ping(message);
 
   // Correct Ping msg
   message = ComposePingResponseMsg();
-  response_handler_.Ping(message);
+  response_handler_->Ping(message);
 }
 
 }  // namespace test
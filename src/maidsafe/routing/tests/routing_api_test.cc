@@ -40,6 +40,7 @@ License.
 #include "maidsafe/routing/routing_api.h"
 #include "maidsafe/routing/routing_impl.h"
 #include "maidsafe/routing/routing_table.h"
+#include "maidsafe/routing/tests/routing_network.h"
 #include "maidsafe/routing/tests/test_utils.h"
 
 namespace maidsafe {
@@ -890,6 +891,37 @@ TEST(APITest, BEH_API_PartiallyJoinedSend) {
   EXPECT_EQ(count, 2);
 }
 
+
+TEST(APITest, BEH_API_GroupChangeBurstSentOnce) {
+  const bptime::time_duration kDelay(Parameters::group_change_propagation_delay);
+  const bptime::time_duration kMaxDelay(Parameters::max_group_change_propagation_delay);
+  Parameters::group_change_propagation_delay = bptime::milliseconds(500);
+  Parameters::max_group_change_propagation_delay = bptime::seconds(5);
+  GenericNode node;
+  std::vector<NodeInfo> close_nodes;
+  while (close_nodes.size() < Parameters::closest_nodes_size)
+    close_nodes.push_back(MakeNode());
+
+  // Each change within the window replaces the pending one and restarts the timer.
+  for (int i(0); i != 5; ++i) {
+    close_nodes.back() = MakeNode();
+    node.ConnectedGroupChange(close_nodes);
+  }
+  uint64_t version(0);
+  EXPECT_TRUE(node.ClosestNodesSent(version).empty());
+  EXPECT_EQ(0U, version);
+
+  Sleep(bptime::seconds(2));
+  std::vector<NodeInfo> sent(node.ClosestNodesSent(version));
+  EXPECT_EQ(1U, version);
+  ASSERT_EQ(close_nodes.size(), sent.size());
+  for (size_t i(0); i != close_nodes.size(); ++i)
+    EXPECT_EQ(close_nodes.at(i).node_id, sent.at(i).node_id);
+
+  Parameters::group_change_propagation_delay = kDelay;
+  Parameters::max_group_change_propagation_delay = kMaxDelay;
+}
+
 }  // namespace test
 
 }  // namespace routing
@@ -243,7 +243,11 @@ bool GenericNode::HasSymmetricNat() const {
 } */
 
 std::vector<NodeInfo> GenericNode::RoutingTable() const {
-  return routing_->pimpl_->routing_table_.nodes_;
+  std::vector<NodeInfo> nodes;
+  std::lock_guard<std::mutex> lock(routing_->pimpl_->routing_table_.mutex_);
+  for (const auto& entry : routing_->pimpl_->routing_table_.nodes_)
+    nodes.push_back(*entry.info);
+  return nodes;
 }
 
 std::vector<NodeInfo> GenericNode::ClosestNodes() {
@@ -292,6 +296,17 @@ std::vector<NodeInfo> GenericNode::GetGroupMatrixConnectedPeers() {
   return routing_->pimpl_->routing_table_.group_matrix_.GetConnectedPeers();
 }
 
+void GenericNode::ConnectedGroupChange(const std::vector<NodeInfo>& close_nodes) {
+  routing_->pimpl_->OnConnectedGroupChange(close_nodes);
+}
+
+std::vector<NodeInfo> GenericNode::ClosestNodesSent(uint64_t& version) {
+  GroupChangeHandler& group_change_handler(routing_->pimpl_->group_change_handler_);
+  std::lock_guard<std::mutex> lock(group_change_handler.mutex_);
+  version = group_change_handler.closest_nodes_version_;
+  return group_change_handler.closest_nodes_;
+}
+
 void GenericNode::SendDirect(const NodeId& destination_id,
                              const std::string& data,
                              const bool& cacheable,
@@ -327,23 +342,13 @@ void GenericNode::SendToClosestNode(const protobuf::Message& message) {
 bool GenericNode::RoutingTableHasNode(const NodeId& node_id) {
   for (auto info : routing_->pimpl_->routing_table_.nodes_)
     LOG(kVerbose) << "RoutingTableHasNode " << DebugId(info.node_id);
-  auto node(std::find_if(routing_->pimpl_->routing_table_.nodes_.begin(),
-                         routing_->pimpl_->routing_table_.nodes_.end(),
-                         [node_id](const NodeInfo& node_info) {
-                           return node_id == node_info.node_id;
-                         }));
-  bool result(node != routing_->pimpl_->routing_table_.nodes_.end());
+  bool result(routing_->pimpl_->routing_table_.Contains(node_id));
   LOG(kVerbose) << DebugId(node_id) << ", result: " << result;
   return result;
 }
 
 bool GenericNode::ClientRoutingTableHasNode(const NodeId& node_id) {
-  return std::find_if(routing_->pimpl_->client_routing_table_.nodes_.begin(),
-                      routing_->pimpl_->client_routing_table_.nodes_.end(),
-                      [&node_id](const NodeInfo& node_info) {
-                        return (node_id == node_info.node_id);
-                      }) !=
-         routing_->pimpl_->client_routing_table_.nodes_.end();
+  return routing_->pimpl_->client_routing_table_.Contains(node_id);
 }
 
 NodeInfo GenericNode::GetRemovableNode() {
@@ -358,16 +363,12 @@ NodeInfo GenericNode::GetNthClosestNode(const NodeId& target_id, uint16_t node_n
 testing::AssertionResult GenericNode::DropNode(const NodeId& node_id) {
   LOG(kInfo) << " DropNode " << HexSubstr(routing_->pimpl_->routing_table_.kNodeId_.string())
              << " Removes " << HexSubstr(node_id.string());
-  auto iter = std::find_if(routing_->pimpl_->routing_table_.nodes_.begin(),
-                           routing_->pimpl_->routing_table_.nodes_.end(),
-                           [&node_id] (const NodeInfo& node_info) {
-                             return (node_id == node_info.node_id);
-                           });
-  if (iter != routing_->pimpl_->routing_table_.nodes_.end()) {
+  NodeInfo node_info;
+  if (routing_->pimpl_->routing_table_.GetNodeInfo(node_id, node_info)) {
     LOG(kVerbose) << HexSubstr(routing_->pimpl_->routing_table_.kNodeId_.string())
                   << " Removes " << HexSubstr(node_id.string());
 //    routing_->pimpl_->network_.Remove(iter->connection_id);
-    routing_->pimpl_->routing_table_.DropNode(iter->connection_id, false);
+    routing_->pimpl_->routing_table_.DropNode(node_info.connection_id, false);
   } else {
     testing::AssertionFailure() << DebugId(routing_->pimpl_->routing_table_.kNodeId_)
                                 << " does not have " << DebugId(node_id) << " in routing table of ";
@@ -418,8 +419,7 @@ void GenericNode::PrintRoutingTable() {
   }
   LOG(kInfo) << "[" << HexSubstr(node_info_plus_->node_info.node_id.string())
             << "]'s Non-RoutingTable : ";
-  std::lock_guard<std::mutex> lock(routing_->pimpl_->client_routing_table_.mutex_);
-  for (const auto& node_info : routing_->pimpl_->client_routing_table_.nodes_) {
+  for (const auto& node_info : routing_->pimpl_->client_routing_table_.nodes()) {
     LOG(kInfo) << "\tNodeId : " << HexSubstr(node_info.node_id.string());
   }
 }
@@ -13,10 +13,14 @@ implied. See the License for the specific language governing permissions and lim
 License.
 */
 
+#include <algorithm>
+#include <atomic>
 #include <bitset>
+#include <future>
 #include <memory>
 #include <vector>
 
+#include "maidsafe/common/crypto.h"
 #include "maidsafe/common/log.h"
 #include "maidsafe/common/node_id.h"
 #include "maidsafe/common/rsa.h"
@@ -85,6 +89,52 @@ TEST(RoutingTableTest, BEH_AddTooManyNodes) {
   EXPECT_EQ(routing_table.size(), Parameters::max_routing_table_size);
 }
 
+TEST(RoutingTableTest, BEH_FullTableRejectsNodeOutsideCloseGroup) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  NodeInfo removed_node;
+  routing_table.InitialiseFunctors([](const int&) {},
+                                   [&removed_node](const NodeInfo& node, bool) {
+                                     removed_node = node;
+                                   },
+                                   []() {},
+                                   [](const std::vector<NodeInfo>&) {},
+                                   [](const std::vector<NodeInfo>&) {},
+                                   [](const MatrixChange&) {});
+  while (routing_table.size() < Parameters::max_routing_table_size)
+    EXPECT_TRUE(routing_table.AddNode(MakeNode()));
+
+  // A node no closer than the furthest close node is never in a lower bucket than it, so no bucket
+  // gives up a member for it.
+  NodeId furthest_close_node(
+      routing_table.GetNthClosestNode(node_id, Parameters::closest_nodes_size).node_id);
+  NodeInfo node(MakeNode());
+  do {
+    node.node_id = GenerateUniqueRandomId(node_id, 8 * NodeId::kSize - 2);
+  } while (!NodeId::CloserToTarget(furthest_close_node, node.node_id, node_id));
+  node.connection_id = node.node_id;
+
+  EXPECT_FALSE(routing_table.CheckNode(node));
+  EXPECT_FALSE(routing_table.AddNode(node));
+  EXPECT_EQ(Parameters::max_routing_table_size, routing_table.size());
+  EXPECT_FALSE(routing_table.Contains(node.node_id));
+  EXPECT_TRUE(removed_node.node_id.IsZero());
+
+  // A node closer than the furthest close node replaces it.
+  NodeInfo close_node(MakeNode());
+  do {
+    close_node.node_id = GenerateUniqueRandomId(node_id, 8 * NodeId::kSize - 2);
+  } while (!NodeId::CloserToTarget(close_node.node_id, furthest_close_node, node_id));
+  close_node.connection_id = close_node.node_id;
+
+  EXPECT_TRUE(routing_table.CheckNode(close_node));
+  EXPECT_TRUE(routing_table.AddNode(close_node));
+  EXPECT_EQ(Parameters::max_routing_table_size, routing_table.size());
+  EXPECT_TRUE(routing_table.Contains(close_node.node_id));
+  EXPECT_EQ(furthest_close_node, removed_node.node_id);
+}
+
 TEST(RoutingTableTest, BEH_PopulateAndDepopulateGroupCheckGroupChange) {
   NodeId node_id(NodeId::kRandomId);
   NetworkStatistics network_statistics(node_id);
@@ -179,6 +229,85 @@ TEST(RoutingTableTest, BEH_OrderedGroupChange) {
     EXPECT_EQ(expected_close_nodes.at(i), close_nodes.at(i).node_id);
 }
 
+TEST(RoutingTableTest, BEH_AddNodesBatch) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> nodes;
+  for (uint16_t i = 0; i < Parameters::max_routing_table_size; ++i)
+    nodes.push_back(MakeNode());
+
+  int group_change_count(0), matrix_change_count(0), remove_furthest_count(0);
+  routing_table.InitialiseFunctors(
+      [](const int& status) { LOG(kVerbose) << "Status : " << status; },
+      [](const NodeInfo&, bool) {},
+      [&remove_furthest_count]() { ++remove_furthest_count; },
+      [&group_change_count](const std::vector<NodeInfo>&) { ++group_change_count; },
+      [](const std::vector<NodeInfo>&) {},
+      [&matrix_change_count](const MatrixChange&) { ++matrix_change_count; });
+
+  // A repeated node and one with an invalid key are skipped without affecting the rest.
+  std::vector<NodeInfo> batch(nodes);
+  batch.push_back(nodes.front());
+  NodeInfo invalid_node(MakeNode());
+  invalid_node.public_key = asymm::PublicKey();
+  batch.push_back(invalid_node);
+  std::vector<NodeInfo> added(routing_table.AddNodes(batch));
+  EXPECT_TRUE(CompareListOfNodeInfos(nodes, added));
+  EXPECT_EQ(Parameters::max_routing_table_size, routing_table.size());
+  EXPECT_EQ(1, group_change_count);
+  EXPECT_EQ(1, matrix_change_count);
+  EXPECT_EQ(1, remove_furthest_count);
+
+  SortFromTarget(node_id, nodes);
+  std::vector<NodeInfo> close_nodes(routing_table.group_matrix_.GetConnectedPeers());
+  ASSERT_EQ(Parameters::closest_nodes_size, close_nodes.size());
+  for (uint16_t i(0); i < Parameters::closest_nodes_size; ++i)
+    EXPECT_EQ(nodes.at(i).node_id, close_nodes.at(i).node_id);
+
+  EXPECT_TRUE(routing_table.AddNodes(nodes).empty());
+  EXPECT_EQ(1, group_change_count);
+  EXPECT_EQ(1, matrix_change_count);
+}
+
+TEST(RoutingTableTest, BEH_AddNodesBatchWithExistingAndRepeatedNodes) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> existing_nodes;
+  for (int i(0); i != 4; ++i) {
+    existing_nodes.push_back(MakeNode());
+    EXPECT_TRUE(routing_table.AddNode(existing_nodes.back()));
+  }
+
+  // The first new node is closer than every existing one, so inserting it moves them all within
+  // the table before they are looked up again later in the same batch.
+  std::string closest_id(node_id.string());
+  closest_id.back() ^= 1;
+  std::vector<NodeInfo> new_nodes(1, MakeNode());
+  new_nodes.front().node_id = NodeId(closest_id);
+  new_nodes.front().connection_id = new_nodes.front().node_id;
+  for (int i(0); i != 3; ++i)
+    new_nodes.push_back(MakeNode());
+  std::vector<NodeInfo> batch(new_nodes);
+  batch.insert(batch.end(), existing_nodes.begin(), existing_nodes.end());
+  // A node repeated within the batch under a different key is only added once.
+  NodeInfo rekeyed_node(new_nodes.back());
+  rekeyed_node.public_key = asymm::GenerateKeyPair().public_key;
+  batch.push_back(rekeyed_node);
+
+  std::vector<NodeInfo> added(routing_table.AddNodes(batch));
+  EXPECT_TRUE(CompareListOfNodeInfos(new_nodes, added));
+  EXPECT_EQ(existing_nodes.size() + new_nodes.size(), routing_table.size());
+  std::vector<NodeInfo> all_nodes(existing_nodes);
+  all_nodes.insert(all_nodes.end(), new_nodes.begin(), new_nodes.end());
+  for (const auto& node : all_nodes) {
+    NodeInfo node_info;
+    ASSERT_TRUE(routing_table.GetNodeInfo(node.node_id, node_info));
+    EXPECT_TRUE(maidsafe::rsa::MatchingKeys(node.public_key, node_info.public_key));
+  }
+}
+
 TEST(RoutingTableTest, BEH_ReverseOrderedGroupChange) {
   NodeId node_id(NodeId::kRandomId);
   NetworkStatistics network_statistics(node_id);
@@ -786,6 +915,52 @@ TEST(RoutingTableTest, BEH_GroupUpdateFromConnectedPeer) {
   }
 }
 
+TEST(RoutingTableTest, BEH_GroupUpdateFromConnectedPeerWithoutRow) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  while (routing_table.size() <= Parameters::closest_nodes_size)
+    routing_table.AddNode(MakeNode());
+  // Only the closest nodes have rows in the matrix.
+  const NodeId kFarPeer(routing_table.GetNthClosestNode(node_id, Parameters::closest_nodes_size + 1)
+                            .node_id);
+  const NodeId kClosePeer(routing_table.GetNthClosestNode(node_id, 1).node_id);
+  std::vector<NodeInfo> far_row(1, MakeNode()), close_row(1, MakeNode());
+  std::vector<NodeInfo> added_nodes(1, MakeNode());
+  std::vector<NodeId> far_removed(1, far_row.front().node_id),
+                      close_removed(1, close_row.front().node_id);
+
+  // Neither has a version to build on, so each needs its whole list first.
+  EXPECT_FALSE(routing_table.GroupUpdateFromConnectedPeer(kFarPeer, added_nodes, far_removed,
+                                                          1, 2));
+  EXPECT_FALSE(routing_table.GroupUpdateFromConnectedPeer(kClosePeer, added_nodes, close_removed,
+                                                          1, 2));
+  routing_table.GroupUpdateFromConnectedPeer(kFarPeer, far_row, 2);
+  routing_table.GroupUpdateFromConnectedPeer(kClosePeer, close_row, 2);
+  EXPECT_TRUE(routing_table.IsConnected(close_row.front().node_id));
+
+  // The far peer's row is pruned again, but its later deltas are followed rather than each needing
+  // the whole list.
+  EXPECT_FALSE(routing_table.IsConnected(far_row.front().node_id));
+  EXPECT_TRUE(routing_table.GroupUpdateFromConnectedPeer(kFarPeer, added_nodes, far_removed,
+                                                         2, 3));
+  EXPECT_TRUE(routing_table.GroupUpdateFromConnectedPeer(kFarPeer, added_nodes, far_removed,
+                                                         3, 4));
+  EXPECT_FALSE(routing_table.IsConnected(added_nodes.front().node_id));
+  EXPECT_FALSE(routing_table.GroupUpdateFromConnectedPeer(kFarPeer, added_nodes, far_removed,
+                                                          5, 6));
+
+  // The close peer's row is kept and updated.
+  EXPECT_TRUE(routing_table.GroupUpdateFromConnectedPeer(kClosePeer, added_nodes, close_removed,
+                                                         2, 3));
+  EXPECT_TRUE(routing_table.IsConnected(added_nodes.front().node_id));
+  EXPECT_FALSE(routing_table.IsConnected(close_row.front().node_id));
+
+  // A peer not in the table is ignored.
+  EXPECT_TRUE(routing_table.GroupUpdateFromConnectedPeer(NodeId(NodeId::kRandomId), added_nodes,
+                                                         close_removed, 1, 2));
+}
+
 TEST(RoutingTableTest, BEH_GetNthClosest) {
   std::vector<NodeId> nodes_id;
   NodeId node_id(NodeId::kRandomId);
@@ -810,18 +985,249 @@ TEST(RoutingTableTest, BEH_GetNthClosest) {
   }
 }
 
+TEST(RoutingTableTest, BEH_GetClosestNodesToRandomTargets) {
+  std::vector<NodeId> nodes_id;
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+
+  while (routing_table.size() < Parameters::max_routing_table_size) {
+    NodeInfo node(MakeNode());
+    if (routing_table.AddNode(node))
+      nodes_id.push_back(node.node_id);
+  }
+
+  for (int i(0); i != 100; ++i) {
+    NodeId target(i % 2 == 0 ? NodeId(NodeId::kRandomId) :
+                               nodes_id.at(RandomUint32() % nodes_id.size()));
+    SortIdsFromTarget(target, nodes_id);
+    std::vector<NodeId> closest_nodes(
+        routing_table.GetClosestNodes(target, Parameters::closest_nodes_size));
+    ASSERT_EQ(Parameters::closest_nodes_size, closest_nodes.size());
+    EXPECT_TRUE(std::equal(closest_nodes.begin(), closest_nodes.end(), nodes_id.begin()));
+    EXPECT_EQ(nodes_id.at(i % 2), routing_table.GetClosestNode(target, i % 2 != 0).node_id);
+  }
+}
+
+TEST(RoutingTableTest, BEH_QueriesDuringChurn) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> nodes;
+  for (uint16_t i(0); i < Parameters::max_routing_table_size; ++i)
+    nodes.push_back(MakeNode());
+
+  std::atomic<bool> done(false);
+  auto reader(std::async(std::launch::async, [&]()->int {
+    int inconsistencies(0);
+    while (!done) {
+      NodeId target(NodeId::kRandomId);
+      std::vector<NodeId> closest(routing_table.GetClosestNodes(target, 2));
+      if (closest.size() == 2 && NodeId::CloserToTarget(closest.at(1), closest.at(0), target))
+        ++inconsistencies;
+      routing_table.IsThisNodeClosestTo(target);
+      routing_table.IsThisNodeInRange(target, Parameters::closest_nodes_size);
+    }
+    return inconsistencies;
+  }));
+
+  for (int round(0); round != 3; ++round) {
+    for (const auto& node : nodes)
+      routing_table.AddNode(node);
+    for (const auto& node : nodes)
+      routing_table.DropNode(node.node_id, true);
+  }
+  done = true;
+  EXPECT_EQ(0, reader.get());
+  EXPECT_EQ(0, routing_table.size());
+}
+
+TEST(RoutingTableTest, BEH_SnapshotsDuringConcurrentChanges) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> nodes;
+  for (uint16_t i(0); i < Parameters::max_routing_table_size; ++i)
+    nodes.push_back(MakeNode());
+
+  // Each snapshot must be internally consistent, and no reader may see an older one after a newer.
+  std::atomic<bool> done(false);
+  auto check_snapshots([&]()->int {
+    int inconsistencies(0);
+    uint64_t last_epoch(0);
+    while (!done) {
+      auto snapshot(routing_table.GetSnapshot());
+      if (snapshot->epoch < last_epoch)
+        ++inconsistencies;
+      last_epoch = snapshot->epoch;
+      const auto& entries(snapshot->nodes);
+      if (snapshot->node_index.size() != entries.size() ||
+          snapshot->connection_index.size() != entries.size())
+        ++inconsistencies;
+      for (size_t i(0); i != entries.size(); ++i) {
+        if (i != 0 && NodeId::CloserToTarget(entries[i].node_id, entries[i - 1].node_id, node_id))
+          ++inconsistencies;
+        auto found(snapshot->node_index.find(entries[i].node_id));
+        if (found == snapshot->node_index.end() || found->second != i)
+          ++inconsistencies;
+        if (entries[i].info->node_id != entries[i].node_id)
+          ++inconsistencies;
+      }
+      for (const auto& peer : snapshot->group_matrix->GetConnectedPeers()) {
+        if (snapshot->node_index.count(peer.node_id) == 0)
+          ++inconsistencies;
+      }
+    }
+    return inconsistencies;
+  });
+  auto reader_1(std::async(std::launch::async, check_snapshots));
+  auto reader_2(std::async(std::launch::async, check_snapshots));
+
+  for (int round(0); round != 3; ++round) {
+    for (const auto& node : nodes)
+      routing_table.AddNode(node);
+    for (const auto& node : nodes) {
+      std::vector<NodeInfo> row(1);
+      row.front().node_id = NodeId(NodeId::kRandomId);
+      routing_table.GroupUpdateFromConnectedPeer(node.node_id, row);
+    }
+    for (const auto& node : nodes)
+      routing_table.DropNode(node.node_id, true);
+  }
+  done = true;
+  EXPECT_EQ(0, reader_1.get());
+  EXPECT_EQ(0, reader_2.get());
+  EXPECT_EQ(0, routing_table.size());
+}
+
+TEST(RoutingTableTest, BEH_QueriesOnHeldSnapshot) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  for (int i(0); i != 4; ++i)
+    EXPECT_TRUE(routing_table.AddNode(MakeNode()));
+
+  // A node closer than any already held changes every answer below once it's added, but not those
+  // given from a snapshot taken beforehand.
+  std::string closest_id(node_id.string());
+  closest_id.back() ^= 1;
+  NodeInfo closest_node(MakeNode());
+  closest_node.node_id = NodeId(closest_id);
+  closest_node.connection_id = closest_node.node_id;
+  const NodeId kTarget(closest_node.node_id);
+  auto snapshot(routing_table.GetSnapshot());
+  EXPECT_TRUE(routing_table.IsThisNodeClosestTo(*snapshot, kTarget));
+  EXPECT_TRUE(routing_table.AddNode(closest_node));
+
+  EXPECT_FALSE(routing_table.Contains(*snapshot, closest_node.node_id));
+  EXPECT_TRUE(routing_table.Contains(closest_node.node_id));
+  NodeInfo node_info;
+  EXPECT_FALSE(routing_table.GetNodeInfo(*snapshot, closest_node.node_id, node_info));
+  EXPECT_TRUE(routing_table.IsThisNodeClosestTo(*snapshot, kTarget));
+  EXPECT_FALSE(routing_table.IsThisNodeClosestTo(kTarget));
+  EXPECT_NE(closest_node.node_id,
+            routing_table.GetNodeForSendingMessage(*snapshot, kTarget, std::string()).node_id);
+  EXPECT_EQ(closest_node.node_id,
+            routing_table.GetNodeForSendingMessage(kTarget, std::string()).node_id);
+  EXPECT_EQ(4U, snapshot->nodes.size());
+  EXPECT_EQ(5U, routing_table.size());
+}
+
+TEST(RoutingTableTest, BEH_LookupAndDropByConnectionId) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> nodes;
+  while (routing_table.size() < Parameters::closest_nodes_size) {
+    NodeInfo node(MakeNode());
+    node.connection_id = NodeId(NodeId::kRandomId);
+    EXPECT_TRUE(routing_table.AddNode(node));
+    nodes.push_back(node);
+  }
+
+  NodeInfo node_info;
+  EXPECT_FALSE(routing_table.GetNodeInfoForConnection(NodeId(NodeId::kRandomId), node_info));
+  EXPECT_TRUE(routing_table.DropConnection(NodeId(NodeId::kRandomId), true).node_id.IsZero());
+  for (const auto& node : nodes) {
+    EXPECT_TRUE(routing_table.Contains(node.node_id));
+    EXPECT_FALSE(routing_table.Contains(node.connection_id));
+    ASSERT_TRUE(routing_table.GetNodeInfoForConnection(node.connection_id, node_info));
+    EXPECT_EQ(node.node_id, node_info.node_id);
+  }
+
+  for (const auto& node : nodes) {
+    EXPECT_EQ(node.node_id, routing_table.DropConnection(node.connection_id, true).node_id);
+    EXPECT_FALSE(routing_table.Contains(node.node_id));
+    EXPECT_FALSE(routing_table.GetNodeInfoForConnection(node.connection_id, node_info));
+  }
+  EXPECT_EQ(0, routing_table.size());
+}
+
+TEST(RoutingTableTest, BEH_RejectDuplicatePublicKey) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  NodeInfo node(MakeNode());
+  EXPECT_TRUE(routing_table.AddNode(node));
+
+  // Same key under a different ID is rejected, also when only a copy of the key is presented.
+  NodeInfo duplicate(MakeNode());
+  duplicate.public_key = node.public_key;
+  EXPECT_FALSE(routing_table.AddNode(duplicate));
+  duplicate.public_key = asymm::DecodeKey(asymm::EncodeKey(node.public_key));
+  EXPECT_FALSE(routing_table.AddNode(duplicate));
+  EXPECT_EQ(1, routing_table.size());
+
+  // Once the holder has gone, the key (now in the validated-key cache) can be re-added.
+  EXPECT_EQ(node.node_id, routing_table.DropNode(node.node_id, true).node_id);
+  EXPECT_TRUE(routing_table.AddNode(duplicate));
+  EXPECT_FALSE(routing_table.AddNode(node));
+  EXPECT_EQ(duplicate.node_id, routing_table.DropNode(duplicate.node_id, true).node_id);
+  EXPECT_TRUE(routing_table.AddNode(node));
+  EXPECT_EQ(1, routing_table.size());
+}
+
+TEST(RoutingTableTest, BEH_ChangeLog) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> nodes;
+  for (int i(0); i != 4; ++i) {
+    nodes.push_back(MakeNode());
+    EXPECT_TRUE(routing_table.AddNode(nodes.back()));
+  }
+  uint64_t sequence(0);
+  auto changes(routing_table.GetChanges(sequence));
+  ASSERT_EQ(nodes.size(), changes.size());
+  for (size_t i(0); i != changes.size(); ++i) {
+    EXPECT_TRUE(RoutingTableChange::Type::kAdded == changes[i].type);
+    EXPECT_EQ(nodes[i].node_id, changes[i].node_id);
+    EXPECT_EQ(i + 1, changes[i].table_size);
+  }
+  EXPECT_TRUE(routing_table.GetChanges(sequence).empty());
+
+  SortFromTarget(node_id, nodes);
+  routing_table.DropNode(nodes[1].node_id, true);
+  changes = routing_table.GetChanges(sequence);
+  ASSERT_EQ(1U, changes.size());
+  EXPECT_TRUE(RoutingTableChange::Type::kRemoved == changes[0].type);
+  EXPECT_EQ(nodes[1].node_id, changes[0].node_id);
+  EXPECT_EQ(1, changes[0].rank);
+  EXPECT_EQ(3, changes[0].table_size);
+}
+
 TEST(RoutingTableTest, BEH_GetClosestNodeWithExclusion) {
   NodeId node_id(NodeId::kRandomId);
   NetworkStatistics network_statistics(node_id);
   RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
   std::vector<NodeId> nodes_id;
   std::vector<std::string> exclude;
-  NodeInfo node_info;
+  NextHop node_info;
   NodeId my_node(routing_table.kNodeId());
 
   // Empty routing_table
   node_info = routing_table.GetClosestNode(my_node, exclude, false);
-  NodeInfo node_info2(routing_table.GetClosestNode(my_node, exclude, true));
+  NextHop node_info2(routing_table.GetClosestNode(my_node, exclude, true));
   EXPECT_EQ(node_info.node_id, node_info2.node_id);
   EXPECT_EQ(node_info.node_id, NodeInfo().node_id);
 
@@ -931,7 +1337,7 @@ TEST(RoutingTableTest, BEH_IsThisNodeGroupLeader) {
   }
 
   SortFromTarget(target_id, nodes);
-  NodeInfo connected_peer;
+  NextHop connected_peer;
 
   // Test 'true' version
   EXPECT_TRUE(routing_table.IsThisNodeGroupLeader(inverse_target_id, connected_peer));
@@ -1117,6 +1523,130 @@ TEST(RoutingTableTest, BEH_GetNodeForSendingMessage) {
   }
 }
 
+TEST(RoutingTableTest, BEH_GetNodeForSendingMessageAfterChange) {
+  NodeId node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(node_id);
+  RoutingTable routing_table(false, node_id, asymm::GenerateKeyPair(), network_statistics);
+  for (uint16_t i(0); i < Parameters::closest_nodes_size; ++i)
+    EXPECT_TRUE(routing_table.AddNode(MakeNode()));
+
+  NodeInfo target(MakeNode());
+  std::vector<std::string> exclude;
+  NextHop next_hop(routing_table.GetNodeForSendingMessage(target.node_id, exclude));
+  EXPECT_EQ(next_hop.node_id,
+            routing_table.GetNodeForSendingMessage(target.node_id, exclude).node_id);
+  exclude.push_back(next_hop.node_id.string());
+  EXPECT_NE(next_hop.node_id,
+            routing_table.GetNodeForSendingMessage(target.node_id, exclude).node_id);
+
+  // Decisions made before a change to the table must not be reused.
+  EXPECT_TRUE(routing_table.AddNode(target));
+  EXPECT_EQ(target.node_id,
+            routing_table.GetNodeForSendingMessage(target.node_id, exclude).node_id);
+  routing_table.DropNode(target.node_id, true);
+  EXPECT_NE(target.node_id,
+            routing_table.GetNodeForSendingMessage(target.node_id, exclude).node_id);
+}
+
+TEST(RoutingTableTest, BEH_CachedNextHopsMatchUncached) {
+  NodeId own_node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(own_node_id);
+  RoutingTable routing_table(false, own_node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> nodes_in_table;
+  for (uint16_t i(0); i < Parameters::max_routing_table_size; ++i)
+    nodes_in_table.push_back(MakeNode());
+  for (const auto& node : nodes_in_table)
+    EXPECT_TRUE(routing_table.AddNode(node));
+  SortFromTarget(own_node_id, nodes_in_table);
+  for (uint16_t i(0); i < Parameters::closest_nodes_size; ++i) {
+    std::vector<NodeInfo> row;
+    while (row.size() < Parameters::closest_nodes_size - 1U)
+      row.push_back(MakeNode());
+    routing_table.GroupUpdateFromConnectedPeer(nodes_in_table.at(i).node_id, row);
+  }
+
+  // Targets are drawn as variations of a few bases in their trailing half, so that many of them
+  // share a cached decision.  Some bases are peers, so that targets equal to or just beside a peer
+  // are covered too.
+  std::vector<NodeId> bases;
+  for (int i(0); i < 8; ++i) {
+    bases.push_back(NodeId(NodeId::kRandomId));
+    bases.push_back(nodes_in_table.at(RandomUint32() % nodes_in_table.size()).node_id);
+  }
+  std::vector<std::vector<std::string>> excludes(3);
+  excludes.at(1).push_back(nodes_in_table.front().node_id.string());
+  excludes.at(2).push_back(NodeId(NodeId::kRandomId).string());
+  excludes.at(2).push_back(nodes_in_table.at(1).node_id.string());
+
+  const auto snapshot(routing_table.GetSnapshot());
+  for (int i(0); i < 1000; ++i) {
+    const NodeId& base(bases.at(i % bases.size()));
+    NodeId target(base);
+    if (i % 3 != 0) {
+      std::string raw_target(base.string());
+      raw_target.replace(NodeId::kSize / 2, NodeId::kSize / 2, RandomString(NodeId::kSize / 2));
+      target = NodeId(raw_target);
+    }
+    const std::vector<std::string>& exclude(excludes.at(RandomUint32() % excludes.size()));
+    bool ignore_exact_match(RandomUint32() % 2 == 0);
+    EXPECT_EQ(routing_table.GetUncachedNodeForSendingMessage(*snapshot, target,
+                                                             PackNodeIds(exclude),
+                                                             ignore_exact_match).node_id,
+              routing_table.GetNodeForSendingMessage(target, exclude, ignore_exact_match).node_id);
+  }
+}
+
+TEST(RoutingTableTest, BEH_GetNodeForSendingMessagePrefersLowRoundTripTime) {
+  NodeId own_node_id(NodeId::kRandomId);
+  NetworkStatistics network_statistics(own_node_id);
+  RoutingTable routing_table(false, own_node_id, asymm::GenerateKeyPair(), network_statistics);
+  std::vector<NodeInfo> nodes_in_table;
+  for (uint16_t i(0); i < Parameters::max_routing_table_size; ++i)
+    nodes_in_table.push_back(MakeNode());
+  for (const auto& node : nodes_in_table)
+    EXPECT_TRUE(routing_table.AddNode(node));
+
+  // Every peer is closer than this node to the target, and the group matrix (holding the peers
+  // closest to this node) has nothing better to offer.
+  NodeId target(own_node_id ^ NodeId(std::string(NodeId::kSize, static_cast<char>(-1))));
+  const uint16_t kCandidates(Parameters::proximity_routing_candidates);
+  ASSERT_LT(1, kCandidates);
+  PartialSortFromTarget(target, nodes_in_table, kCandidates + 1);
+  std::vector<std::string> exclude;
+  EXPECT_EQ(nodes_in_table.at(0).node_id,
+            routing_table.GetNodeForSendingMessage(target, exclude).node_id);
+
+  // A peer without samples ranks as the slowest measured candidate.
+  routing_table.UpdateRoundTripTime(nodes_in_table.at(0).node_id,
+                                    boost::posix_time::milliseconds(200));
+  routing_table.UpdateRoundTripTime(nodes_in_table.at(kCandidates - 1).node_id,
+                                    boost::posix_time::milliseconds(20));
+  EXPECT_EQ(nodes_in_table.at(kCandidates - 1).node_id,
+            routing_table.GetNodeForSendingMessage(target, exclude).node_id);
+
+  // Peers beyond the candidate count are never picked, however fast.
+  routing_table.UpdateRoundTripTime(nodes_in_table.at(kCandidates).node_id,
+                                    boost::posix_time::milliseconds(1));
+  EXPECT_EQ(nodes_in_table.at(kCandidates - 1).node_id,
+            routing_table.GetNodeForSendingMessage(target, exclude).node_id);
+
+  // A slower estimate for the cached next hop is noticed too.
+  routing_table.UpdateRoundTripTime(nodes_in_table.at(kCandidates - 1).node_id,
+                                    boost::posix_time::seconds(2));
+  EXPECT_EQ(nodes_in_table.at(0).node_id,
+            routing_table.GetNodeForSendingMessage(target, exclude).node_id);
+
+  exclude.push_back(nodes_in_table.at(kCandidates - 1).node_id.string());
+  EXPECT_NE(nodes_in_table.at(kCandidates - 1).node_id,
+            routing_table.GetNodeForSendingMessage(target, exclude).node_id);
+  exclude.clear();
+
+  // Estimates are forgotten along with the peer.
+  routing_table.DropNode(nodes_in_table.at(kCandidates - 1).node_id, true);
+  EXPECT_TRUE(network_statistics.GetRoundTripTime(
+                  nodes_in_table.at(kCandidates - 1).node_id).is_not_a_date_time());
+}
+
 TEST(RoutingTableTest, BEH_GetNodeForSendingMessageIgnoreExactMatch) {
   // populate routing table
   NodeId own_node_id(NodeId::kRandomId);
@@ -1160,7 +1690,7 @@ TEST(RoutingTableTest, BEH_GetNodeForSendingMessageIgnoreExactMatch) {
   NodeInfo row_leader(nodes_in_table.at(row_index));
   LOG(kInfo) << "Row leader: " << DebugId(row_leader.node_id);
   routing_table.GroupUpdateFromConnectedPeer(row_leader.node_id, row);
-  NodeInfo node_for_message(routing_table.GetNodeForSendingMessage(target, exclude, true));
+  NextHop node_for_message(routing_table.GetNodeForSendingMessage(target, exclude, true));
   EXPECT_EQ(row_leader.node_id, node_for_message.node_id)
       << "For target: " << DebugId(target) << "\tExpected: " << DebugId(row_leader.node_id)
       << "\tGot: " << DebugId(node_for_message.node_id);
@@ -192,6 +192,25 @@ TEST(RpcsTest, BEH_FindNodesMessageNodeRelayMode) {
   ASSERT_FALSE(node.IsZero());
 }
 
+TEST(RpcsTest, BEH_ClosestNodesUpdateSubscribeMessageNode) {
+  NodeInfo us(MakeNode());
+  NodeId peer(NodeId::kRandomId);
+  protobuf::Message message = rpcs::ClosestNodesUpdateSubscribe(peer, us.node_id,
+                                                                us.connection_id, true, false);
+  protobuf::ClosestNodesUpdateSubscrirbe closest_nodes_update_subscribe;
+  EXPECT_TRUE(closest_nodes_update_subscribe.ParseFromString(message.data(0)));
+  EXPECT_EQ(us.node_id.string(), closest_nodes_update_subscribe.node_id());
+  EXPECT_EQ(us.connection_id.string(), closest_nodes_update_subscribe.connection_id());
+  EXPECT_FALSE(closest_nodes_update_subscribe.subscribe());
+  EXPECT_EQ(peer.string(), message.destination_id());
+  EXPECT_EQ(us.node_id.string(), message.source_id());
+  EXPECT_TRUE(message.direct());
+  EXPECT_EQ(1, message.replication());
+  EXPECT_EQ(static_cast<int32_t>(MessageType::kClosestNodesUpdateSubscribe), message.type());
+  EXPECT_TRUE(message.request());
+  EXPECT_TRUE(message.client_node());
+}
+
 }  // namespace test
 
 }  // namespace routing
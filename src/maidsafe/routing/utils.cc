@@ -27,6 +27,7 @@ License.
 #include "maidsafe/routing/client_routing_table.h"
 #include "maidsafe/routing/message_handler.h"
 #include "maidsafe/routing/network_utils.h"
+#include "maidsafe/routing/next_hop.h"
 #include "maidsafe/routing/return_codes.h"
 #include "maidsafe/routing/routing.pb.h"
 #include "maidsafe/routing/routing_table.h"
@@ -68,14 +69,8 @@ bool ValidateAndAddToRoutingTable(NetworkUtils& network,
                                   const NodeId& connection_id,
                                   const asymm::PublicKey& public_key,
                                   const bool& client) {
-  if (network.MarkConnectionAsValid(connection_id) != kSuccess) {
-    LOG(kError) << "[" << DebugId(routing_table.kNodeId()) << "] "
-                << ". Rudp failed to validate connection with  Peer id : "
-                << DebugId(peer_id)
-                << " , Connection id : "
-                << DebugId(connection_id);
+  if (!ValidateConnection(network, routing_table, peer_id, connection_id))
     return false;
-  }
 
   NodeInfo peer;
   peer.node_id = peer_id;
@@ -93,8 +88,32 @@ bool ValidateAndAddToRoutingTable(NetworkUtils& network,
     if (routing_table.AddNode(peer))
       routing_accepted_node = true;
   }
+  return CompleteAddToRoutingTable(network, routing_table, peer_id, connection_id, client,
+                                   routing_accepted_node);
+}
+
+bool ValidateConnection(NetworkUtils& network,
+                        const RoutingTable& routing_table,
+                        const NodeId& peer_id,
+                        const NodeId& connection_id) {
+  if (network.MarkConnectionAsValid(connection_id) != kSuccess) {
+    LOG(kError) << "[" << DebugId(routing_table.kNodeId()) << "] "
+                << ". Rudp failed to validate connection with  Peer id : "
+                << DebugId(peer_id)
+                << " , Connection id : "
+                << DebugId(connection_id);
+    return false;
+  }
+  return true;
+}
 
-  if (routing_accepted_node) {
+bool CompleteAddToRoutingTable(NetworkUtils& network,
+                               const RoutingTable& routing_table,
+                               const NodeId& peer_id,
+                               const NodeId& connection_id,
+                               bool client,
+                               bool added) {
+  if (added) {
     LOG(kVerbose) << "[" << DebugId(routing_table.kNodeId()) << "] "
                   << "added " << (client ? "client-" : "") << "node to "
                   << (client ? "non-" : "") << "routing table.  Node ID: "
@@ -174,7 +193,7 @@ bool ValidateMessage(const protobuf::Message &message) {
   // Message has traversed more hops than expected
   if (message.hops_to_live() <= 0) {
     std::string route_history;
-    for (const auto& route : message.route_history())
+    for (const auto& route : RouteHistoryIds(message))
       route_history += HexSubstr(route) + ", ";
     LOG(kError) << "Message has traversed more hops than expected. "
                 <<  Parameters::max_route_history << " last hops in route history are: "
@@ -200,6 +219,11 @@ bool ValidateMessage(const protobuf::Message &message) {
     return false;
   }
 
+  if (message.route_history_ring().size() % NodeId::kSize != 0) {
+    LOG(kWarning) << "Invalid route history field." << " id: " << message.id();
+    return false;
+  }
+
   if (message.has_source_id() && !CheckId(message.source_id())) {
       LOG(kWarning) << "Invalid source id field.";
       return false;
@@ -244,6 +268,57 @@ boost::asio::ip::udp::endpoint GetEndpointFromProtobuf(const protobuf::Endpoint&
                                         static_cast<uint16_t>(pb_endpoint.port()));
 }
 
+void AddToRouteHistory(protobuf::Message& message, const NodeId& node_id) {
+  if (Parameters::max_route_history == 0 || RouteHistoryContains(message, node_id))
+    return;
+  std::string& route_history(*message.mutable_route_history_ring());
+  size_t size(route_history.size() / NodeId::kSize);
+  if (size < Parameters::max_route_history) {
+    route_history.append(node_id.string());
+    message.clear_route_history_head();
+    return;
+  }
+  size_t head(message.route_history_head() % size);
+  route_history.replace(head * NodeId::kSize, NodeId::kSize, node_id.string());
+  message.set_route_history_head(static_cast<uint32_t>((head + 1) % size));
+}
+
+bool RouteHistoryContains(const protobuf::Message& message, const NodeId& node_id) {
+  return PackedNodeIdsContain(message.route_history_ring(), node_id);
+}
+
+size_t RouteHistorySize(const protobuf::Message& message) {
+  return message.route_history_ring().size() / NodeId::kSize;
+}
+
+std::vector<std::string> RouteHistoryIds(const protobuf::Message& message) {
+  std::vector<std::string> route_history;
+  size_t size(RouteHistorySize(message));
+  if (size == 0)
+    return route_history;
+  route_history.reserve(size);
+  size_t head(message.route_history_head() % size);
+  for (size_t i(0); i != size; ++i) {
+    route_history.push_back(message.route_history_ring().substr(((head + i) % size) * NodeId::kSize,
+                                                                NodeId::kSize));
+  }
+  return route_history;
+}
+
+std::string RouteHistoryExclusions(const protobuf::Message& message,
+                                   const NodeId& this_node_id,
+                                   bool exclude_newest) {
+  size_t size(RouteHistorySize(message));
+  if (size == 0 || (size == 1 && RouteHistoryContains(message, this_node_id)))
+    return std::string();
+  std::string exclusions(message.route_history_ring(), 0, size * NodeId::kSize);
+  if (size > 1 && !exclude_newest) {
+    size_t newest((message.route_history_head() + size - 1) % size);
+    exclusions.erase(newest * NodeId::kSize, NodeId::kSize);
+  }
+  return exclusions;
+}
+
 std::string MessageTypeString(const protobuf::Message& message) {
   std::string message_type;
   switch (static_cast<MessageType>(message.type())) {
@@ -271,6 +346,12 @@ std::string MessageTypeString(const protobuf::Message& message) {
     case MessageType::kGetGroup :
       message_type = "kGetGroup";
       break;
+    case MessageType::kClosestNodesUpdateSubscribe :
+      message_type = "kCloses_Nodes_Subscribe";
+      break;
+    case MessageType::kClosestNodesUpdateResync :
+      message_type = "kCloses_Nodes_Resync";
+      break;
     case MessageType::kNodeLevel :
       message_type = "kNodeLevel";
       break;
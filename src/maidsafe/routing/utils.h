@@ -71,6 +71,19 @@ bool ValidateAndAddToRoutingTable(NetworkUtils& network,
                                   const NodeId& connection_id,
                                   const asymm::PublicKey& public_key,
                                   const bool& client);
+// The two halves of ValidateAndAddToRoutingTable, for callers adding peers in batches.  The first
+// marks the rudp connection valid, the second logs whether the peer was then added to the
+// (client) routing table and removes the rudp connection if not.  Both return their outcome.
+bool ValidateConnection(NetworkUtils& network,
+                        const RoutingTable& routing_table,
+                        const NodeId& peer_id,
+                        const NodeId& connection_id);
+bool CompleteAddToRoutingTable(NetworkUtils& network,
+                               const RoutingTable& routing_table,
+                               const NodeId& peer_id,
+                               const NodeId& connection_id,
+                               bool client,
+                               bool added);
 void HandleSymmetricNodeAdd(RoutingTable& routing_table, const NodeId& peer_id,
                             const asymm::PublicKey& public_key);
 bool IsRoutingMessage(const protobuf::Message& message);
@@ -81,6 +94,19 @@ bool IsDirect(const protobuf::Message& message);
 bool IsCacheable(const protobuf::Message& message);
 bool CheckId(const std::string& id_to_test);
 bool ValidateMessage(const protobuf::Message &message);
+// Route history is held in Message::route_history as a ring of at most
+// Parameters::max_route_history packed node IDs.  Once full, each new hop overwrites the oldest
+// entry, which Message::route_history_head indexes.  Adding an ID already present does nothing.
+void AddToRouteHistory(protobuf::Message& message, const NodeId& node_id);
+bool RouteHistoryContains(const protobuf::Message& message, const NodeId& node_id);
+size_t RouteHistorySize(const protobuf::Message& message);
+// Returns the IDs oldest first.
+std::vector<std::string> RouteHistoryIds(const protobuf::Message& message);
+// Returns the route history IDs, still packed, which should not be chosen as the next hop: all
+// but the newest unless |exclude_newest|, and none if the only entry is |this_node_id|.
+std::string RouteHistoryExclusions(const protobuf::Message& message,
+                                   const NodeId& this_node_id,
+                                   bool exclude_newest);
 void SetProtobufEndpoint(const boost::asio::ip::udp::endpoint& endpoint,
                          protobuf::Endpoint* pb_endpoint);
 boost::asio::ip::udp::endpoint GetEndpointFromProtobuf(const protobuf::Endpoint& pb_endpoint);